@@ -0,0 +1,139 @@
+#include "area_table.h"
+
+#include <stdlib.h>
+
+#include "world.h"
+
+// Typedef'd so the compiler checks the table matches the chunk
+typedef char AreaTableMatchesChunk[(AREA_TABLE_SIDE == CHUNK_SIZE + 1) ? 1 : -1];
+
+static void BuildAreaTable(AreaTable *table, const Chunk *chunk)
+{
+	for (int type = 0; type < TILE_TYPE_COUNT; type++)
+	{
+		for (int x = 0; x < AREA_TABLE_SIDE; x++)
+			table->counts[type][x] = 0;
+	}
+
+	for (int y = 0; y < CHUNK_SIZE; y++)
+	{
+		// Tiles of this row seen so far, the occupancy counted under BLANK_SPACE
+		uint16_t rowCounts[TILE_TYPE_COUNT] = {0};
+		const int above = y * AREA_TABLE_SIDE;
+		const int row = above + AREA_TABLE_SIDE;
+		for (int type = 0; type < TILE_TYPE_COUNT; type++)
+			table->counts[type][row] = 0;
+
+		for (int x = 0; x < CHUNK_SIZE; x++)
+		{
+			rowCounts[BLANK_SPACE] += (chunk->occupancy[y] >> x) & 1;
+			for (int type = BLANK_SPACE + 1; type < TILE_TYPE_COUNT; type++)
+				rowCounts[type] += (chunk->planes[type - 1][y] >> x) & 1;
+			for (int type = 0; type < TILE_TYPE_COUNT; type++)
+				table->counts[type][row + x + 1] = (uint16_t)(table->counts[type][above + x + 1] + rowCounts[type]);
+		}
+	}
+}
+
+static uint64_t ScanChunkRect(const Chunk *chunk, int x0, int y0, int x1, int y1, uint64_t counts[TILE_TYPE_COUNT])
+{
+	const uint32_t columns = BitRange32(x0, x1);
+	uint64_t occupied = 0;
+	for (int y = y0; y < y1; y++)
+	{
+		occupied += PopCount32(chunk->occupancy[y] & columns);
+		for (int type = BLANK_SPACE + 1; type < TILE_TYPE_COUNT; type++)
+			counts[type] += PopCount32(chunk->planes[type - 1][y] & columns);
+	}
+	return occupied;
+}
+
+// Free slot if there is one, otherwise the least recently used table, taken from its chunk
+static AreaTable *TakeAreaTable(AreaTablePool *pool, Chunk *chunk)
+{
+	if (pool->tables == NULL)
+	{
+		pool->tables = (AreaTable *)calloc(MAX_AREA_TABLES, sizeof(AreaTable));
+		if (pool->tables == NULL)
+			return NULL;
+	}
+
+	AreaTable *table = &pool->tables[0];
+	for (int i = 0; i < MAX_AREA_TABLES && table->owner != NULL; i++)
+	{
+		if (pool->tables[i].owner == NULL || pool->tables[i].lastUsed < table->lastUsed)
+			table = &pool->tables[i];
+	}
+	if (table->owner != NULL)
+	{
+		// Has to earn a table again like any other chunk
+		table->owner->areaTable = NULL;
+		table->owner->areaTableCut = 0;
+	}
+	table->owner = chunk;
+	chunk->areaTable = table;
+	chunk->areaTableStale = true;
+	return table;
+}
+
+uint64_t CountChunkTilesInRect(AreaTablePool *pool, const Chunk *chunk, int x0, int y0, int x1, int y1, uint64_t counts[TILE_TYPE_COUNT])
+{
+	if (x0 >= x1 || y0 >= y1)
+		return 0;
+
+	if (pool == NULL)
+		return ScanChunkRect(chunk, x0, y0, x1, y1, counts);
+
+	// The table is a cache, filling it does not change what the chunk holds
+	Chunk *cache = (Chunk *)chunk;
+	pool->clock++;
+	if (cache->areaTable == NULL)
+	{
+		// Cut again before MAX_AREA_TABLES other cuts went by, so a table would have lasted
+		const bool reused = cache->areaTableCut != 0 && pool->clock - cache->areaTableCut <= MAX_AREA_TABLES;
+		cache->areaTableCut = pool->clock;
+		if (!reused || TakeAreaTable(pool, cache) == NULL)
+			return ScanChunkRect(chunk, x0, y0, x1, y1, counts);
+	}
+	if (cache->areaTableStale)
+	{
+		BuildAreaTable(cache->areaTable, chunk);
+		cache->areaTableStale = false;
+	}
+	cache->areaTable->lastUsed = pool->clock;
+
+	const int topLeft = y0 * AREA_TABLE_SIDE + x0;
+	const int topRight = y0 * AREA_TABLE_SIDE + x1;
+	const int bottomLeft = y1 * AREA_TABLE_SIDE + x0;
+	const int bottomRight = y1 * AREA_TABLE_SIDE + x1;
+	uint64_t rect[TILE_TYPE_COUNT];
+	for (int type = 0; type < TILE_TYPE_COUNT; type++)
+	{
+		const uint16_t *table = cache->areaTable->counts[type];
+		rect[type] = (uint64_t)(table[bottomRight] - table[bottomLeft] - table[topRight] + table[topLeft]);
+	}
+	for (int type = BLANK_SPACE + 1; type < TILE_TYPE_COUNT; type++)
+		counts[type] += rect[type];
+	return rect[BLANK_SPACE];
+}
+
+void FreeAreaTable(Chunk *chunk)
+{
+	if (chunk->areaTable != NULL)
+		chunk->areaTable->owner = NULL;
+	chunk->areaTable = NULL;
+}
+
+void UnloadAreaTablePool(AreaTablePool *pool)
+{
+	if (pool->tables != NULL)
+	{
+		for (int i = 0; i < MAX_AREA_TABLES; i++)
+		{
+			if (pool->tables[i].owner != NULL)
+				pool->tables[i].owner->areaTable = NULL;
+		}
+	}
+	free(pool->tables);
+	pool->tables = NULL;
+}
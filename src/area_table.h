@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tiles.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Summed area table of a chunk: entry (x, y) of a type holds how many tiles of that type
+// lie in columns [0, x) and rows [0, y), for 0 <= x, y <= CHUNK_SIZE. Any rectangle inside
+// the chunk is then four lookups per type. A chunk only gets one when count queries cut it
+// twice in quick succession, other cuts just popcount the bit planes, so queries scattered
+// over the world never build tables they will not reuse. SetTile marks the table stale and
+// the next query rebuilds it, so a run of writes costs one rebuild.
+#define AREA_TABLE_SIDE 33 // CHUNK_SIZE + 1, the zero row and column spare a branch per lookup
+// Tables a world keeps, about 13 KB each. The least recently used one is taken over when
+// another chunk earns a table
+#define MAX_AREA_TABLES 64
+
+struct Chunk;
+
+typedef struct AreaTable
+{
+	struct Chunk *owner; // NULL while the slot is free
+	uint32_t lastUsed;
+	// counts[BLANK_SPACE] holds the positions with anything on any layer, the blanks are
+	// whatever that leaves
+	uint16_t counts[TILE_TYPE_COUNT][AREA_TABLE_SIDE * AREA_TABLE_SIDE];
+} AreaTable;
+
+typedef struct AreaTablePool
+{
+	AreaTable *tables; // MAX_AREA_TABLES of them, allocated for the first chunk that earns one
+	uint32_t clock; // Counts the cuts, chunks a query only covers part of
+} AreaTablePool;
+
+// Adds the non blank tiles of each type in columns [x0, x1) and rows [y0, y1) of the chunk
+// (chunk local, 0..CHUNK_SIZE) to counts and returns how many positions there have anything
+// on them. pool is NULL for a scratch copy of a chunk, which is always scanned, otherwise
+// chunk has to be one FreeChunk will see. Scans instead of building when out of memory
+uint64_t CountChunkTilesInRect(AreaTablePool *pool, const struct Chunk *chunk, int x0, int y0, int x1, int y1, uint64_t counts[TILE_TYPE_COUNT]);
+// Hands the chunk's table back to its pool
+void FreeAreaTable(struct Chunk *chunk);
+// Takes the tables away from the chunks still holding one and frees them
+void UnloadAreaTablePool(AreaTablePool *pool);
+
+#if defined(__cplusplus)
+}
+#endif
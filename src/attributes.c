@@ -0,0 +1,176 @@
+#include "attributes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "world.h"
+
+TileAttribute RegisterTileAttribute(World *world, const char *name, int size, uint32_t defaultValue)
+{
+	if (size != 1 && size != 2 && size != 4)
+		return -1;
+
+	const TileAttribute existing = FindTileAttribute(world, name);
+	if (existing >= 0)
+		return world->attributes[existing].size == size ? existing : -1;
+	if (world->attributeCount >= MAX_TILE_ATTRIBUTES)
+		return -1;
+
+	TileAttributeInfo *info = &world->attributes[world->attributeCount];
+	memset(info, 0, sizeof(TileAttributeInfo));
+	strncpy(info->name, name, MAX_TILE_ATTRIBUTE_NAME - 1);
+	info->size = size;
+	info->defaultValue = defaultValue;
+	return world->attributeCount++;
+}
+
+TileAttribute FindTileAttribute(const World *world, const char *name)
+{
+	for (int i = 0; i < world->attributeCount; i++)
+	{
+		if (strncmp(world->attributes[i].name, name, MAX_TILE_ATTRIBUTE_NAME - 1) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static bool IsAttributeOfSize(const World *world, TileAttribute attribute, int size)
+{
+	return attribute >= 0 && attribute < world->attributeCount && world->attributes[attribute].size == size;
+}
+
+static uint32_t ReadPlaneValue(const TileAttributeInfo *info, const void *plane, int index)
+{
+	if (plane == NULL)
+		return info->defaultValue;
+
+	switch (info->size)
+	{
+	case 1:
+		return ((const uint8_t *)plane)[index];
+	case 2:
+		return ((const uint16_t *)plane)[index];
+	default:
+		return ((const uint32_t *)plane)[index];
+	}
+}
+
+static uint32_t ReadAttribute(const World *world, TileAttribute attribute, int x, int y)
+{
+	const TileAttributeInfo *info = &world->attributes[attribute];
+	const int cx = x >> CHUNK_SHIFT;
+	const int cy = y >> CHUNK_SHIFT;
+	const int index = ChunkTileIndex(x, y);
+	const Chunk *chunk = GetChunk(world, cx, cy);
+	if (chunk != NULL)
+		return ReadPlaneValue(info, chunk->attributes[attribute], index);
+
+	// An evicted chunk keeps its planes in the backing file, not reading them would report
+	// the default for every value written before the eviction
+	const StreamedChunk *record = GetStreamedChunk(world, cx, cy);
+	Chunk streamed;
+	if (record == NULL || !ReadStreamedChunk(world, record, &streamed))
+		return info->defaultValue;
+	const uint32_t value = ReadPlaneValue(info, streamed.attributes[attribute], index);
+	UnloadStreamedChunkCopy(&streamed);
+	return value;
+}
+
+static void *AllocAttributePlane(const TileAttributeInfo *info)
+{
+	void *plane = malloc((size_t)CHUNK_AREA * info->size);
+	if (plane == NULL)
+		return NULL;
+
+	for (int i = 0; i < CHUNK_AREA; i++)
+	{
+		switch (info->size)
+		{
+		case 1:
+			((uint8_t *)plane)[i] = (uint8_t)info->defaultValue;
+			break;
+		case 2:
+			((uint16_t *)plane)[i] = (uint16_t)info->defaultValue;
+			break;
+		default:
+			((uint32_t *)plane)[i] = info->defaultValue;
+			break;
+		}
+	}
+	return plane;
+}
+
+static void WriteAttribute(World *world, TileAttribute attribute, int x, int y, uint32_t value)
+{
+	if (x < 0 || y < 0 || x >= world->width || y >= world->height)
+		return;
+
+	const TileAttributeInfo *info = &world->attributes[attribute];
+	const int cx = x >> CHUNK_SHIFT;
+	const int cy = y >> CHUNK_SHIFT;
+	// An evicted chunk is loaded back first, as SetLayerTile does, so the comparison sees
+	// what the write would replace
+	if (world->stream != NULL && GetChunk(world, cx, cy) == NULL)
+		LoadStreamedChunk(world, cx, cy);
+	// Unchanged values, defaults on a missing plane included, need no chunk, plane or copy
+	if (ReadAttribute(world, attribute, x, y) == value)
+		return;
+
+	Chunk *chunk = EnsureChunk(world, cx, cy);
+	if (chunk == NULL)
+		return;
+	if (chunk->attributes[attribute] == NULL)
+	{
+		chunk->attributes[attribute] = AllocAttributePlane(info);
+		if (chunk->attributes[attribute] == NULL)
+			return;
+	}
+
+	void *plane = chunk->attributes[attribute];
+	const int index = ChunkTileIndex(x, y);
+	switch (info->size)
+	{
+	case 1:
+		((uint8_t *)plane)[index] = (uint8_t)value;
+		break;
+	case 2:
+		((uint16_t *)plane)[index] = (uint16_t)value;
+		break;
+	default:
+		((uint32_t *)plane)[index] = value;
+		break;
+	}
+}
+
+uint8_t GetTileAttributeU8(const World *world, TileAttribute attribute, int x, int y)
+{
+	return IsAttributeOfSize(world, attribute, 1) ? (uint8_t)ReadAttribute(world, attribute, x, y) : 0;
+}
+
+uint16_t GetTileAttributeU16(const World *world, TileAttribute attribute, int x, int y)
+{
+	return IsAttributeOfSize(world, attribute, 2) ? (uint16_t)ReadAttribute(world, attribute, x, y) : 0;
+}
+
+uint32_t GetTileAttributeU32(const World *world, TileAttribute attribute, int x, int y)
+{
+	return IsAttributeOfSize(world, attribute, 4) ? ReadAttribute(world, attribute, x, y) : 0;
+}
+
+void SetTileAttributeU8(World *world, TileAttribute attribute, int x, int y, uint8_t value)
+{
+	if (IsAttributeOfSize(world, attribute, 1))
+		WriteAttribute(world, attribute, x, y, value);
+}
+
+void SetTileAttributeU16(World *world, TileAttribute attribute, int x, int y, uint16_t value)
+{
+	if (IsAttributeOfSize(world, attribute, 2))
+		WriteAttribute(world, attribute, x, y, value);
+}
+
+void SetTileAttributeU32(World *world, TileAttribute attribute, int x, int y, uint32_t value)
+{
+	if (IsAttributeOfSize(world, attribute, 4))
+		WriteAttribute(world, attribute, x, y, value);
+}
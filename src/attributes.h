@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+#define MAX_TILE_ATTRIBUTES 8
+#define MAX_TILE_ATTRIBUTE_NAME 32
+
+// Per tile data that is not the tile type (owner, build date, elevation, signal state...).
+// Every attribute is its own plane next to the Chunk.layers instead of a field in a per tile
+// struct, so scans that only need the type never pull attribute bytes into cache. A chunk
+// only allocates the plane of an attribute once one of its tiles gets a non default value.
+typedef int TileAttribute; // Index into World.attributes, -1 when invalid
+
+typedef struct TileAttributeInfo
+{
+	char name[MAX_TILE_ATTRIBUTE_NAME];
+	int size;              // Bytes per tile: 1, 2 or 4
+	uint32_t defaultValue; // What tiles read before anything is set
+} TileAttributeInfo;
+
+struct World;
+
+// Returns the existing attribute if one with the same name and size is already registered.
+// Returns -1 if the size is not 1, 2 or 4, the name is taken with another size or all
+// MAX_TILE_ATTRIBUTES slots are in use
+TileAttribute RegisterTileAttribute(struct World *world, const char *name, int size, uint32_t defaultValue);
+// Returns -1 if no attribute with that name is registered
+TileAttribute FindTileAttribute(const struct World *world, const char *name);
+
+// Typed accessors, the type has to match the size the attribute was registered with.
+// Mismatched or invalid attributes read as 0 and ignore writes
+//----------------------------------------------------------------------------------
+uint8_t GetTileAttributeU8(const struct World *world, TileAttribute attribute, int x, int y);
+uint16_t GetTileAttributeU16(const struct World *world, TileAttribute attribute, int x, int y);
+uint32_t GetTileAttributeU32(const struct World *world, TileAttribute attribute, int x, int y);
+void SetTileAttributeU8(struct World *world, TileAttribute attribute, int x, int y, uint8_t value);
+void SetTileAttributeU16(struct World *world, TileAttribute attribute, int x, int y, uint16_t value);
+void SetTileAttributeU32(struct World *world, TileAttribute attribute, int x, int y, uint32_t value);
+//----------------------------------------------------------------------------------
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Index of the lowest set bit, value must not be zero
+static inline int CountTrailingZeros32(uint32_t value)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (int)index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
+// Number of set bits
+static inline int PopCount32(uint32_t value)
+{
+#if defined(_MSC_VER)
+	return (int)__popcnt(value);
+#else
+	return __builtin_popcount(value);
+#endif
+}
+
+// Bits from (inclusive) to to (exclusive) set, with 0 <= from < 32 and from <= to <= 32
+static inline uint32_t BitRange32(int from, int to)
+{
+	const uint32_t upper = to >= 32 ? 0xFFFFFFFFu : ((1u << to) - 1);
+	return upper & ~((1u << from) - 1);
+}
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,173 @@
+#include "chunk_directory.h"
+
+#include <stdlib.h>
+
+static void ReleasePage(const ChunkDirectory *directory, DirectoryPage *page)
+{
+	if (--page->refCount > 0)
+		return;
+	for (uint32_t i = 0; i < page->entries.capacity; i++)
+	{
+		if (page->entries.slots[i].value != NULL)
+			directory->release(page->entries.slots[i].value);
+	}
+	ChunkMapFree(&page->entries);
+	free(page);
+}
+
+// Returns the page under pageKey once only this directory references it, NULL if there is
+// no such page or the copy ran out of memory
+static DirectoryPage *GetPrivatePage(ChunkDirectory *directory, uint64_t pageKey)
+{
+	DirectoryPage *page = (DirectoryPage *)ChunkMapGet(&directory->pages, pageKey);
+	if (page == NULL || page->refCount == 1)
+		return page;
+
+	DirectoryPage *copy = (DirectoryPage *)calloc(1, sizeof(DirectoryPage));
+	if (copy == NULL)
+		return NULL;
+	ChunkMapCopy(&copy->entries, &page->entries);
+	if (copy->entries.count != page->entries.count)
+	{
+		free(copy);
+		return NULL;
+	}
+	copy->refCount = 1;
+	for (uint32_t i = 0; i < copy->entries.capacity; i++)
+	{
+		if (copy->entries.slots[i].value != NULL)
+			directory->retain(copy->entries.slots[i].value);
+	}
+
+	// Still referenced by whoever shared it, so this never frees it. Same key, so the
+	// slot is replaced in place
+	page->refCount--;
+	ChunkMapPut(&directory->pages, pageKey, copy);
+	return copy;
+}
+
+void InitChunkDirectory(ChunkDirectory *directory, DirectoryValueCallback retain, DirectoryValueCallback release)
+{
+	directory->pages = (ChunkMap){0};
+	directory->count = 0;
+	directory->retain = retain;
+	directory->release = release;
+}
+
+bool PutDirectoryEntry(ChunkDirectory *directory, uint64_t key, void *value)
+{
+	const uint64_t pageKey = DirectoryPageKey(key);
+	DirectoryPage *page = GetPrivatePage(directory, pageKey);
+	if (page == NULL)
+	{
+		if (ChunkMapGet(&directory->pages, pageKey) != NULL)
+			return false;
+		page = (DirectoryPage *)calloc(1, sizeof(DirectoryPage));
+		if (page == NULL)
+			return false;
+		page->refCount = 1;
+		if (!ChunkMapPut(&directory->pages, pageKey, page))
+		{
+			free(page);
+			return false;
+		}
+	}
+
+	const uint32_t before = page->entries.count;
+	if (!ChunkMapPut(&page->entries, key, value))
+	{
+		if (before == 0)
+		{
+			ChunkMapRemove(&directory->pages, pageKey);
+			ReleasePage(directory, page);
+		}
+		return false;
+	}
+	directory->count += page->entries.count - before;
+	return true;
+}
+
+void *RemoveDirectoryEntry(ChunkDirectory *directory, uint64_t key)
+{
+	const uint64_t pageKey = DirectoryPageKey(key);
+	DirectoryPage *page = (DirectoryPage *)ChunkMapGet(&directory->pages, pageKey);
+	// A missing key needs no copy of a shared page
+	if (page == NULL || ChunkMapGet(&page->entries, key) == NULL)
+		return NULL;
+	page = GetPrivatePage(directory, pageKey);
+	if (page == NULL)
+		return NULL;
+
+	void *value = ChunkMapRemove(&page->entries, key);
+	directory->count--;
+	if (page->entries.count == 0)
+	{
+		ChunkMapRemove(&directory->pages, pageKey);
+		ReleasePage(directory, page);
+	}
+	return value;
+}
+
+bool UnshareDirectoryPage(ChunkDirectory *directory, uint64_t key)
+{
+	const uint64_t pageKey = DirectoryPageKey(key);
+	return GetPrivatePage(directory, pageKey) != NULL || ChunkMapGet(&directory->pages, pageKey) == NULL;
+}
+
+bool IsDirectoryPageShared(const ChunkDirectory *directory, uint64_t key)
+{
+	const DirectoryPage *page = (const DirectoryPage *)ChunkMapGet(&directory->pages, DirectoryPageKey(key));
+	return page != NULL && page->refCount != 1;
+}
+
+bool ShareChunkDirectory(ChunkDirectory *destination, const ChunkDirectory *source)
+{
+	FreeChunkDirectory(destination);
+	destination->retain = source->retain;
+	destination->release = source->release;
+	ChunkMapCopy(&destination->pages, &source->pages);
+	if (destination->pages.count != source->pages.count)
+	{
+		ChunkMapFree(&destination->pages);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < destination->pages.capacity; i++)
+	{
+		if (destination->pages.slots[i].value != NULL)
+			((DirectoryPage *)destination->pages.slots[i].value)->refCount++;
+	}
+	destination->count = source->count;
+	return true;
+}
+
+void FreeChunkDirectory(ChunkDirectory *directory)
+{
+	for (uint32_t i = 0; i < directory->pages.capacity; i++)
+	{
+		if (directory->pages.slots[i].value != NULL)
+			ReleasePage(directory, (DirectoryPage *)directory->pages.slots[i].value);
+	}
+	ChunkMapFree(&directory->pages);
+	directory->count = 0;
+}
+
+bool NextDirectoryEntry(const ChunkDirectory *directory, DirectoryIterator *iterator, uint64_t *key, void **value)
+{
+	for (; iterator->page < directory->pages.capacity; iterator->page++, iterator->slot = 0)
+	{
+		const DirectoryPage *page = (const DirectoryPage *)directory->pages.slots[iterator->page].value;
+		if (page == NULL)
+			continue;
+		while (iterator->slot < page->entries.capacity)
+		{
+			const ChunkMapSlot *slot = &page->entries.slots[iterator->slot++];
+			if (slot->value == NULL)
+				continue;
+			*key = slot->key;
+			*value = slot->value;
+			return true;
+		}
+	}
+	return false;
+}
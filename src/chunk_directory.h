@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chunk_map.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// A page holds the entries of 2^DIRECTORY_PAGE_SHIFT x 2^DIRECTORY_PAGE_SHIFT chunks
+#define DIRECTORY_PAGE_SHIFT 4
+
+typedef struct DirectoryPage
+{
+	int refCount; // Directories sharing the page, it is copied before a write while above 1
+	ChunkMap entries; // ChunkKey -> value, each holding one reference for the page
+} DirectoryPage;
+
+typedef void (*DirectoryValueCallback)(const void *value);
+
+// ChunkKey -> pointer map that can be copied in O(pages) and shares what it copies.
+// Entries are kept in pages of nearby chunks, and a copy only takes a reference on each
+// page. The first write to a shared page gives the writer its own copy of that page alone,
+// which references every value in it once more through retain, so values can tell they
+// are shared the same way they would with a full copy.
+typedef struct ChunkDirectory
+{
+	ChunkMap pages; // Page key -> DirectoryPage
+	uint32_t count; // Entries over all pages
+	DirectoryValueCallback retain;  // Called for each value of a page that gets copied
+	DirectoryValueCallback release; // and of a page nothing references any more
+} ChunkDirectory;
+
+// Walks every entry once, see NextDirectoryEntry
+typedef struct DirectoryIterator
+{
+	uint32_t page;
+	uint32_t slot;
+} DirectoryIterator;
+
+static inline uint64_t DirectoryPageKey(uint64_t key)
+{
+	return ChunkKey(ChunkKeyX(key) >> DIRECTORY_PAGE_SHIFT, ChunkKeyY(key) >> DIRECTORY_PAGE_SHIFT);
+}
+
+static inline void *GetDirectoryEntry(const ChunkDirectory *directory, uint64_t key)
+{
+	const DirectoryPage *page = (const DirectoryPage *)ChunkMapGet(&directory->pages, DirectoryPageKey(key));
+	return page != NULL ? ChunkMapGet(&page->entries, key) : NULL;
+}
+
+void InitChunkDirectory(ChunkDirectory *directory, DirectoryValueCallback retain, DirectoryValueCallback release);
+// Inserts or replaces the value stored under key, value must not be NULL. The caller's
+// reference moves into the directory and a replaced value is not released. Returns false
+// when out of memory, the directory is left unchanged
+bool PutDirectoryEntry(ChunkDirectory *directory, uint64_t key, void *value);
+// Removes key and returns what was stored under it with its reference, or NULL if it was
+// missing or its shared page could not be copied
+void *RemoveDirectoryEntry(ChunkDirectory *directory, uint64_t key);
+// Makes sure the page holding key is only referenced by this directory, so the value under
+// key is referenced once fewer. Returns false when out of memory
+bool UnshareDirectoryPage(ChunkDirectory *directory, uint64_t key);
+// True when another directory shares the page holding key
+bool IsDirectoryPageShared(const ChunkDirectory *directory, uint64_t key);
+// Makes destination a copy of source that shares all of its pages, replacing whatever it
+// held. Returns false when out of memory, destination is left empty
+bool ShareChunkDirectory(ChunkDirectory *destination, const ChunkDirectory *source);
+// Drops every page, values go when their page does
+void FreeChunkDirectory(ChunkDirectory *directory);
+
+// Start with a zeroed iterator. Returns false once every entry was visited. Values may be
+// replaced while walking, but adding or removing keys invalidates the walk
+bool NextDirectoryEntry(const ChunkDirectory *directory, DirectoryIterator *iterator, uint64_t *key, void **value);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,120 @@
+#include "chunk_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_MAP_MIN_CAPACITY 64
+
+static void ChunkMapInsertSlot(ChunkMapSlot *slots, uint32_t capacity, uint64_t key, void *value)
+{
+	const uint32_t mask = capacity - 1;
+	uint32_t i = ChunkMapHash(key) & mask;
+	while (slots[i].value != NULL)
+		i = (i + 1) & mask;
+	slots[i].key = key;
+	slots[i].value = value;
+}
+
+// Returns false when out of memory, the old table is kept as it was
+static bool ChunkMapGrow(ChunkMap *map)
+{
+	uint32_t capacity = map->capacity ? map->capacity * 2 : CHUNK_MAP_MIN_CAPACITY;
+	ChunkMapSlot *slots = (ChunkMapSlot *)calloc(capacity, sizeof(ChunkMapSlot));
+	if (slots == NULL)
+		return false;
+
+	for (uint32_t i = 0; i < map->capacity; i++)
+	{
+		if (map->slots[i].value != NULL)
+			ChunkMapInsertSlot(slots, capacity, map->slots[i].key, map->slots[i].value);
+	}
+
+	free(map->slots);
+	map->slots = slots;
+	map->capacity = capacity;
+	return true;
+}
+
+bool ChunkMapPut(ChunkMap *map, uint64_t key, void *value)
+{
+	if (map->capacity != 0)
+	{
+		const uint32_t mask = map->capacity - 1;
+		for (uint32_t i = ChunkMapHash(key) & mask; map->slots[i].value != NULL; i = (i + 1) & mask)
+		{
+			if (map->slots[i].key == key)
+			{
+				map->slots[i].value = value;
+				return true;
+			}
+		}
+	}
+
+	// Keep the load factor under 3/4 so probe runs stay short. Failing that, a fuller table
+	// still works as long as one slot stays empty to end the probes
+	if ((map->count + 1) * 4 > map->capacity * 3 && !ChunkMapGrow(map) && map->count + 1 >= map->capacity)
+		return false;
+
+	ChunkMapInsertSlot(map->slots, map->capacity, key, value);
+	map->count++;
+	return true;
+}
+
+void *ChunkMapRemove(ChunkMap *map, uint64_t key)
+{
+	if (map->count == 0)
+		return NULL;
+
+	const uint32_t mask = map->capacity - 1;
+	uint32_t i = ChunkMapHash(key) & mask;
+	while (map->slots[i].key != key)
+	{
+		if (map->slots[i].value == NULL)
+			return NULL;
+		i = (i + 1) & mask;
+	}
+	if (map->slots[i].value == NULL)
+		return NULL;
+
+	void *value = map->slots[i].value;
+
+	// Shift the rest of the probe run back so lookups never stop early
+	uint32_t hole = i;
+	for (uint32_t j = (i + 1) & mask; map->slots[j].value != NULL; j = (j + 1) & mask)
+	{
+		uint32_t home = ChunkMapHash(map->slots[j].key) & mask;
+		// Move j into the hole unless its home lies cyclically in (hole, j]
+		if (((j - home) & mask) >= ((j - hole) & mask))
+		{
+			map->slots[hole] = map->slots[j];
+			hole = j;
+		}
+	}
+	map->slots[hole].value = NULL;
+	map->count--;
+
+	return value;
+}
+
+void ChunkMapCopy(ChunkMap *destination, const ChunkMap *source)
+{
+	ChunkMapFree(destination);
+	if (source->capacity == 0)
+		return;
+
+	// Same capacity and hash, so the slots can be taken over as they are
+	destination->slots = (ChunkMapSlot *)malloc(source->capacity * sizeof(ChunkMapSlot));
+	if (destination->slots == NULL)
+		return;
+	memcpy(destination->slots, source->slots, source->capacity * sizeof(ChunkMapSlot));
+	destination->capacity = source->capacity;
+	destination->count = source->count;
+}
+
+void ChunkMapFree(ChunkMap *map)
+{
+	free(map->slots);
+	map->slots = NULL;
+	map->capacity = 0;
+	map->count = 0;
+}
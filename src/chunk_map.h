@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Open addressing hash table from a packed pair of chunk coordinates to a pointer.
+// Linear probing with backward shift deletion, so there are no tombstones and a
+// miss stops at the first empty slot. A NULL value marks an empty slot.
+typedef struct ChunkMapSlot
+{
+	uint64_t key;
+	void *value;
+} ChunkMapSlot;
+
+typedef struct ChunkMap
+{
+	ChunkMapSlot *slots;
+	uint32_t capacity; // Always zero or a power of two
+	uint32_t count;
+} ChunkMap;
+
+static inline uint64_t ChunkKey(int cx, int cy)
+{
+	return ((uint64_t)(uint32_t)cy << 32) | (uint32_t)cx;
+}
+
+static inline int ChunkKeyX(uint64_t key)
+{
+	return (int)(uint32_t)key;
+}
+
+static inline int ChunkKeyY(uint64_t key)
+{
+	return (int)(uint32_t)(key >> 32);
+}
+
+static inline uint32_t ChunkMapHash(uint64_t key)
+{
+	// murmur3 finalizer, neighbouring chunks land far apart
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return (uint32_t)key;
+}
+
+static inline void *ChunkMapGet(const ChunkMap *map, uint64_t key)
+{
+	if (map->count == 0)
+		return NULL;
+
+	const uint32_t mask = map->capacity - 1;
+	for (uint32_t i = ChunkMapHash(key) & mask;; i = (i + 1) & mask)
+	{
+		const ChunkMapSlot *slot = &map->slots[i];
+		if (slot->value == NULL)
+			return NULL;
+		if (slot->key == key)
+			return slot->value;
+	}
+}
+
+// Inserts or replaces the value stored under key, value must not be NULL. Returns false
+// when the table cannot grow, the map is left unchanged
+bool ChunkMapPut(ChunkMap *map, uint64_t key, void *value);
+// Removes key and returns what was stored under it, or NULL if it was missing
+void *ChunkMapRemove(ChunkMap *map, uint64_t key);
+// Makes destination an identical copy of source, replacing whatever it held
+void ChunkMapCopy(ChunkMap *destination, const ChunkMap *source);
+// Frees the slot array, the values themselves belong to the caller
+void ChunkMapFree(ChunkMap *map);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,272 @@
+#include "chunk_textures.h"
+
+#include <stdlib.h>
+
+#include "bits.h"
+#include "world.h"
+
+typedef struct TextureCandidate
+{
+	uint64_t key;
+	uint32_t lastUsed;
+} TextureCandidate;
+
+// Colour plus the depth renderbuffer raylib attaches to every render texture
+static size_t TextureBytes(int tileSize)
+{
+	const size_t side = (size_t)CHUNK_SIZE * tileSize;
+	return side * side * 8;
+}
+
+static void FreeChunkTexture(ChunkTextureCache *cache, uint64_t key, ChunkTexture *texture)
+{
+	cache->bytes -= TextureBytes(texture->tileSize);
+	UnloadRenderTexture(texture->target);
+	ChunkMapRemove(&cache->textures, key);
+	free(texture);
+}
+
+static void MarkTexturesStale(void *userData, const DirtyRect *rects, int count)
+{
+	ChunkTextureCache *cache = (ChunkTextureCache *)userData;
+	for (int r = 0; r < count; r++)
+	{
+		const DirtyRect *rect = &rects[r];
+		for (int cy = rect->y >> CHUNK_SHIFT; cy <= (rect->y + rect->height - 1) >> CHUNK_SHIFT; cy++)
+		{
+			for (int cx = rect->x >> CHUNK_SHIFT; cx <= (rect->x + rect->width - 1) >> CHUNK_SHIFT; cx++)
+			{
+				ChunkTexture *texture = (ChunkTexture *)ChunkMapGet(&cache->textures, ChunkKey(cx, cy));
+				if (texture != NULL)
+					texture->stale = true;
+			}
+		}
+	}
+}
+
+bool InitChunkTextureCache(ChunkTextureCache *cache, World *world, const TileArt *art, size_t budget)
+{
+	*cache = (ChunkTextureCache){0};
+	cache->world = world;
+	cache->art = art;
+	cache->budget = budget != 0 ? budget : DEFAULT_CHUNK_TEXTURE_BUDGET;
+	cache->frame = 1;
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if (SubscribeDirtyRegions(&world->dirty[layer], MarkTexturesStale, cache))
+			continue;
+		for (int subscribed = 0; subscribed < layer; subscribed++)
+			UnsubscribeDirtyRegions(&world->dirty[subscribed], MarkTexturesStale, cache);
+		return false;
+	}
+	return true;
+}
+
+void UnloadChunkTextureCache(ChunkTextureCache *cache)
+{
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		UnsubscribeDirtyRegions(&cache->world->dirty[layer], MarkTexturesStale, cache);
+	for (uint32_t i = 0; i < cache->textures.capacity; i++)
+	{
+		ChunkTexture *texture = (ChunkTexture *)cache->textures.slots[i].value;
+		if (texture == NULL)
+			continue;
+		UnloadRenderTexture(texture->target);
+		free(texture);
+	}
+	ChunkMapFree(&cache->textures);
+	cache->bytes = 0;
+}
+
+void DrawChunkTiles(const TileArt *art, const Chunk *chunk, Vector2 origin, float tileSize, int fromX, int fromY, int toX, int toY)
+{
+	// Layers the chunk has nothing on are skipped for all of its tiles
+	const TileLayer *layers[LAYER_COUNT];
+	int layerIds[LAYER_COUNT];
+	int layerCount = 0;
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if (chunk->layers[layer] == NULL)
+			continue;
+		layers[layerCount] = chunk->layers[layer];
+		layerIds[layerCount++] = layer;
+	}
+
+	const uint32_t visibleColumns = BitRange32(fromX, toX);
+	for (int y = fromY; y < toY; y++)
+	{
+		// Jump straight from one painted tile to the next
+		uint32_t bits = chunk->occupancy[y] & visibleColumns;
+		while (bits != 0)
+		{
+			const int x = CountTrailingZeros32(bits);
+			bits &= bits - 1;
+			const int index = y * CHUNK_SIZE + x;
+			const Rectangle dest = {origin.x + x * tileSize, origin.y + y * tileSize, tileSize, tileSize};
+			// Bottom layer first, so everything stacked on a tile is composited in this one pass
+			for (int l = 0; l < layerCount; l++)
+			{
+				const TileId tile = ReadTileLayer(layers[l], index);
+				if (tile == BLANK_SPACE)
+					continue;
+				if (layerIds[l] == LAYER_TERRAIN)
+				{
+					DrawRectangleRec(dest, art->terrainColors[tile]);
+					continue;
+				}
+				const Rectangle source = tile == RAIL ? art->railRects[GetChunkRailMask(chunk, index)] : art->tileRects[tile];
+				DrawTexturePro(art->atlas, source, dest, (Vector2){0, 0}, 0.f, WHITE);
+			}
+		}
+	}
+}
+
+// Smallest power of two pixels per tile that is at least as sharp as the screen, up to the atlas
+static int BakeTileSize(const TileArt *art, float screenTileSize)
+{
+	int tileSize = art->gridSize;
+	while (tileSize > 1 && tileSize / 2 >= screenTileSize)
+		tileSize /= 2;
+	return tileSize;
+}
+
+static bool BakeChunkTexture(ChunkTextureCache *cache, uint64_t key, const Chunk *chunk, int tileSize)
+{
+	ChunkTexture *texture = (ChunkTexture *)ChunkMapGet(&cache->textures, key);
+	if (texture == NULL || texture->tileSize != tileSize)
+	{
+		const size_t freed = texture != NULL ? TextureBytes(texture->tileSize) : 0;
+		// Over the budget the chunk is drawn tile by tile until textures are freed at the end of the frame
+		if (cache->bytes - freed + TextureBytes(tileSize) > cache->budget)
+		{
+			cache->needsRoom = true;
+			return false;
+		}
+		const RenderTexture2D target = LoadRenderTexture(CHUNK_SIZE * tileSize, CHUNK_SIZE * tileSize);
+		if (!IsRenderTextureValid(target))
+			return false;
+
+		if (texture == NULL)
+		{
+			texture = (ChunkTexture *)calloc(1, sizeof(ChunkTexture));
+			if (texture == NULL || !ChunkMapPut(&cache->textures, key, texture))
+			{
+				UnloadRenderTexture(target);
+				free(texture);
+				return false;
+			}
+		}
+		else
+		{
+			UnloadRenderTexture(texture->target);
+		}
+		cache->bytes += TextureBytes(tileSize) - freed;
+		texture->target = target;
+		texture->tileSize = tileSize;
+	}
+
+	BeginTextureMode(texture->target);
+	ClearBackground(BLANK);
+	DrawChunkTiles(cache->art, chunk, (Vector2){0, 0}, (float)tileSize, 0, 0, CHUNK_SIZE, CHUNK_SIZE);
+	EndTextureMode();
+	texture->stale = false;
+	cache->bakes++;
+	cache->bakesThisFrame++;
+	return true;
+}
+
+void BakeChunkTextures(ChunkTextureCache *cache, int x, int y, int width, int height, float screenTileSize)
+{
+	const World *world = cache->world;
+	const int x0 = x > 0 ? x : 0;
+	const int y0 = y > 0 ? y : 0;
+	const int x1 = x + width < world->width ? x + width : world->width;
+	const int y1 = y + height < world->height ? y + height : world->height;
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	const int tileSize = BakeTileSize(cache->art, screenTileSize);
+	for (int cy = y0 >> CHUNK_SHIFT; cy <= (y1 - 1) >> CHUNK_SHIFT; cy++)
+	{
+		for (int cx = x0 >> CHUNK_SHIFT; cx <= (x1 - 1) >> CHUNK_SHIFT && cache->bakesThisFrame < MAX_BAKES_PER_FRAME; cx++)
+		{
+			const Chunk *chunk = GetChunk(world, cx, cy);
+			if (chunk == NULL || chunk->nonEmpty == 0)
+				continue;
+			const uint64_t key = ChunkKey(cx, cy);
+			const ChunkTexture *texture = (const ChunkTexture *)ChunkMapGet(&cache->textures, key);
+			if (texture == NULL || texture->stale || texture->tileSize != tileSize)
+				BakeChunkTexture(cache, key, chunk, tileSize);
+		}
+	}
+}
+
+void DrawCachedChunk(ChunkTextureCache *cache, const Chunk *chunk, int cx, int cy, int fromX, int fromY, int toX, int toY)
+{
+	if (chunk->nonEmpty == 0)
+		return;
+
+	const float gridSize = (float)cache->art->gridSize;
+	const Vector2 origin = {(float)(cx << CHUNK_SHIFT) * gridSize, (float)(cy << CHUNK_SHIFT) * gridSize};
+	ChunkTexture *texture = (ChunkTexture *)ChunkMapGet(&cache->textures, ChunkKey(cx, cy));
+	if (texture == NULL || texture->stale)
+	{
+		DrawChunkTiles(cache->art, chunk, origin, gridSize, fromX, fromY, toX, toY);
+		cache->drawingDirect++;
+		return;
+	}
+
+	// Render textures come out upside down
+	const float side = (float)(CHUNK_SIZE * texture->tileSize);
+	const Rectangle source = {0, 0, side, -side};
+	const Rectangle dest = {origin.x, origin.y, CHUNK_SIZE * gridSize, CHUNK_SIZE * gridSize};
+	DrawTexturePro(texture->target.texture, source, dest, (Vector2){0, 0}, 0.f, WHITE);
+	texture->lastUsed = cache->frame;
+	cache->drawingBaked++;
+}
+
+static int CompareCandidates(const void *a, const void *b)
+{
+	const uint32_t lastUsedA = ((const TextureCandidate *)a)->lastUsed;
+	const uint32_t lastUsedB = ((const TextureCandidate *)b)->lastUsed;
+	return (lastUsedA > lastUsedB) - (lastUsedA < lastUsedB);
+}
+
+// Frees textures not drawn this frame, least recently drawn first
+static void EvictChunkTextures(ChunkTextureCache *cache)
+{
+	// Going an eighth below the budget leaves room for the next frame's bakes
+	const size_t target = cache->budget - cache->budget / 8;
+	TextureCandidate *candidates = (TextureCandidate *)malloc(cache->textures.count * sizeof(TextureCandidate));
+	if (candidates == NULL)
+		return;
+
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < cache->textures.capacity; i++)
+	{
+		const ChunkTexture *texture = (const ChunkTexture *)cache->textures.slots[i].value;
+		if (texture != NULL && texture->lastUsed != cache->frame)
+			candidates[count++] = (TextureCandidate){cache->textures.slots[i].key, texture->lastUsed};
+	}
+
+	qsort(candidates, count, sizeof(TextureCandidate), CompareCandidates);
+	for (uint32_t i = 0; i < count && cache->bytes > target; i++)
+	{
+		FreeChunkTexture(cache, candidates[i].key, (ChunkTexture *)ChunkMapGet(&cache->textures, candidates[i].key));
+		cache->evictions++;
+	}
+	free(candidates);
+}
+
+void UpdateChunkTextureCache(ChunkTextureCache *cache)
+{
+	if (cache->needsRoom)
+		EvictChunkTextures(cache);
+	cache->needsRoom = false;
+	cache->drawnBaked = cache->drawingBaked;
+	cache->drawnDirect = cache->drawingDirect;
+	cache->drawingBaked = 0;
+	cache->drawingDirect = 0;
+	cache->bakesThisFrame = 0;
+	cache->frame++;
+}
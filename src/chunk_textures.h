@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "raylib.h"
+
+#include "chunk_map.h"
+#include "tiles.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Used by InitChunkTextureCache when no budget is given
+#define DEFAULT_CHUNK_TEXTURE_BUDGET (128 * 1024 * 1024)
+// Chunks baked per frame at most, the rest are drawn tile by tile until their turn
+#define MAX_BAKES_PER_FRAME 32
+
+// What every tile is drawn with
+typedef struct TileArt
+{
+	Texture2D atlas;
+	int gridSize; // World units per tile, and atlas pixels per cell
+	Rectangle tileRects[TILE_TYPE_COUNT];
+	Rectangle railRects[RAIL_MASK_COUNT];
+	Color terrainColors[TILE_TYPE_COUNT]; // Terrain has no art in the atlas and is drawn flat
+} TileArt;
+
+typedef struct ChunkTexture
+{
+	RenderTexture2D target;
+	int tileSize; // Pixels per tile it was baked at
+	uint32_t lastUsed;
+	bool stale; // A tile changed since the bake
+} ChunkTexture;
+
+struct World;
+struct Chunk;
+
+// Every painted chunk on screen is drawn as one quad from a texture it was baked into, so
+// a frame costs the same however many tiles are visible. Chunks are re-baked only when the
+// dirty trackers report a change in them, or at a sharper or coarser resolution when the
+// zoom moves past a power of two. Textures of chunks that went off screen are freed least
+// recently used first once their colour and depth buffers pass the budget.
+typedef struct ChunkTextureCache
+{
+	struct World *world;
+	const TileArt *art;
+	ChunkMap textures; // ChunkKey -> ChunkTexture
+	size_t budget;
+	size_t bytes;
+	uint32_t frame; // Stamp of the current frame, starts at 1
+	int bakesThisFrame;
+	bool needsRoom; // A bake was turned down for the budget this frame
+	// For the debug overlay: totals, and chunks drawn each way last frame
+	int bakes;
+	int evictions;
+	int drawnBaked;
+	int drawnDirect;
+	int drawingBaked;
+	int drawingDirect;
+} ChunkTextureCache;
+
+// Subscribes to the world's dirty trackers. A budget of 0 uses DEFAULT_CHUNK_TEXTURE_BUDGET.
+// art has to outlive the cache. Returns false when the trackers have no subscriber slot left
+bool InitChunkTextureCache(ChunkTextureCache *cache, struct World *world, const TileArt *art, size_t budget);
+void UnloadChunkTextureCache(ChunkTextureCache *cache);
+
+// Draws the tiles of chunk in columns [fromX, toX) and rows [fromY, toY) (chunk local) with
+// its top left corner at origin and tileSize units per tile
+void DrawChunkTiles(const TileArt *art, const struct Chunk *chunk, Vector2 origin, float tileSize, int fromX, int fromY, int toX, int toY);
+
+// Bakes the chunks under the rectangle (in tiles) whose texture is missing, stale or at
+// the wrong resolution for screenTileSize pixels per tile. Has to run outside BeginMode2D,
+// texture mode resets the camera transform
+void BakeChunkTextures(ChunkTextureCache *cache, int x, int y, int width, int height, float screenTileSize);
+// Inside BeginMode2D: draws chunk (cx, cy) from its texture, or tile by tile for the
+// columns [fromX, toX) and rows [fromY, toY) when there is no up to date texture
+void DrawCachedChunk(ChunkTextureCache *cache, const struct Chunk *chunk, int cx, int cy, int fromX, int fromY, int toX, int toY);
+// Once per frame after drawing: frees textures over the budget and starts the next frame
+void UpdateChunkTextureCache(ChunkTextureCache *cache);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,154 @@
+#include "compress.h"
+
+#include <string.h>
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+#define HASH_BITS 12
+#define LENGTH_NIBBLE 15
+
+static uint32_t Read32(const uint8_t *data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static uint32_t HashSequence(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static size_t ExtraLengthBytes(size_t length)
+{
+	return length >= LENGTH_NIBBLE ? (length - LENGTH_NIBBLE) / 255 + 1 : 0;
+}
+
+static uint8_t *WriteExtraLength(uint8_t *write, size_t length)
+{
+	if (length < LENGTH_NIBBLE)
+		return write;
+	size_t rest = length - LENGTH_NIBBLE;
+	for (; rest >= 255; rest -= 255)
+		*write++ = 255;
+	*write++ = (uint8_t)rest;
+	return write;
+}
+
+// matchLength 0 writes the last sequence. Returns NULL when it does not fit before end
+static uint8_t *WriteSequence(uint8_t *write, const uint8_t *end, const uint8_t *literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+	const size_t matchCode = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+	size_t needed = 1 + ExtraLengthBytes(literalCount) + literalCount;
+	if (matchLength > 0)
+		needed += 2 + ExtraLengthBytes(matchCode);
+	if ((size_t)(end - write) < needed)
+		return NULL;
+
+	const size_t literalNibble = literalCount < LENGTH_NIBBLE ? literalCount : LENGTH_NIBBLE;
+	const size_t matchNibble = matchCode < LENGTH_NIBBLE ? matchCode : LENGTH_NIBBLE;
+	*write++ = (uint8_t)((literalNibble << 4) | matchNibble);
+	write = WriteExtraLength(write, literalCount);
+	memcpy(write, literals, literalCount);
+	write += literalCount;
+	if (matchLength == 0)
+		return write;
+
+	*write++ = (uint8_t)offset;
+	*write++ = (uint8_t)(offset >> 8);
+	return WriteExtraLength(write, matchCode);
+}
+
+size_t CompressBytes(const uint8_t *source, size_t size, uint8_t *destination, size_t capacity)
+{
+	// Last position each hashed 4 byte sequence was seen at, plus one so 0 means never
+	uint32_t seen[1 << HASH_BITS];
+	memset(seen, 0, sizeof(seen));
+
+	const uint8_t *end = destination + capacity;
+	uint8_t *write = destination;
+	size_t anchor = 0;
+	size_t position = 0;
+	while (position + MIN_MATCH <= size)
+	{
+		const uint32_t sequence = Read32(source + position);
+		const uint32_t hash = HashSequence(sequence);
+		const size_t candidate = seen[hash];
+		seen[hash] = (uint32_t)(position + 1);
+		if (candidate == 0 || position + 1 - candidate > MAX_OFFSET || Read32(source + candidate - 1) != sequence)
+		{
+			position++;
+			continue;
+		}
+
+		const size_t match = candidate - 1;
+		size_t length = MIN_MATCH;
+		while (position + length < size && source[match + length] == source[position + length])
+			length++;
+		write = WriteSequence(write, end, source + anchor, position - anchor, position - match, length);
+		if (write == NULL)
+			return 0;
+		position += length;
+		anchor = position;
+	}
+
+	write = WriteSequence(write, end, source + anchor, size - anchor, 0, 0);
+	return write != NULL ? (size_t)(write - destination) : 0;
+}
+
+// Adds the bytes after a full nibble onto length, false when the data runs out first
+static bool ReadExtraLength(const uint8_t **read, const uint8_t *end, size_t *length)
+{
+	uint8_t next;
+	do
+	{
+		if (*read >= end)
+			return false;
+		next = *(*read)++;
+		*length += next;
+	} while (next == 255);
+	return true;
+}
+
+bool DecompressBytes(const uint8_t *source, size_t compressedSize, uint8_t *destination, size_t size)
+{
+	const uint8_t *read = source;
+	const uint8_t *readEnd = source + compressedSize;
+	uint8_t *write = destination;
+	const uint8_t *writeEnd = destination + size;
+	for (;;)
+	{
+		if (read >= readEnd)
+			return false;
+		const uint8_t token = *read++;
+
+		size_t literals = token >> 4;
+		if (literals == LENGTH_NIBBLE && !ReadExtraLength(&read, readEnd, &literals))
+			return false;
+		if (literals > (size_t)(readEnd - read) || literals > (size_t)(writeEnd - write))
+			return false;
+		memcpy(write, read, literals);
+		read += literals;
+		write += literals;
+		if (read == readEnd)
+			return write == writeEnd;
+
+		if (readEnd - read < 2)
+			return false;
+		const size_t offset = read[0] | ((size_t)read[1] << 8);
+		read += 2;
+		if (offset == 0 || offset > (size_t)(write - destination))
+			return false;
+		size_t length = token & LENGTH_NIBBLE;
+		if (length == LENGTH_NIBBLE && !ReadExtraLength(&read, readEnd, &length))
+			return false;
+		length += MIN_MATCH;
+		if (length > (size_t)(writeEnd - write))
+			return false;
+		// Byte by byte, a match may overlap what it is copying (offset 1 is a run)
+		const uint8_t *match = write - offset;
+		for (size_t i = 0; i < length; i++)
+			write[i] = match[i];
+		write += length;
+	}
+}
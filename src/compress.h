@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Byte oriented LZ77 in the style of LZ4, with no dependency and no state between calls.
+// Chunk records are mostly runs (blank rail masks, attributes at their default) and rows
+// that repeat, which this takes down to a small fraction for a few microseconds.
+//
+// The data is a list of sequences: a token byte whose high nibble is the literal count and
+// low nibble the match length - 4, the literals, a little endian u16 offset back to the
+// match and its length. A nibble of 15 is followed by bytes added onto it, up to the first
+// one below 255. The last sequence stops after its literals.
+
+// Returns the compressed size, 0 when it does not fit capacity
+size_t CompressBytes(const uint8_t *source, size_t size, uint8_t *destination, size_t capacity);
+// Returns false unless source is intact and decodes to exactly size bytes
+bool DecompressBytes(const uint8_t *source, size_t compressedSize, uint8_t *destination, size_t size);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,249 @@
+#include "dirty.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "world.h"
+
+typedef struct DirtyChunk
+{
+	uint64_t key;
+	uint32_t rows[CHUNK_SIZE]; // Bit x of rows[y] is set when tile (x, y) of the chunk changed
+} DirtyChunk;
+
+void InitDirtyTracker(DirtyTracker *tracker, int width, int height)
+{
+	UnloadDirtyTracker(tracker);
+	tracker->width = width;
+	tracker->height = height;
+	tracker->lastChunk = -1;
+}
+
+void UnloadDirtyTracker(DirtyTracker *tracker)
+{
+	ChunkMapFree(&tracker->lookup);
+	free(tracker->chunks);
+	free(tracker->rects);
+	memset(tracker, 0, sizeof(DirtyTracker));
+	tracker->lastChunk = -1;
+}
+
+static DirtyChunk *GetDirtyChunk(DirtyTracker *tracker, int cx, int cy)
+{
+	const uint64_t key = ChunkKey(cx, cy);
+	if (tracker->lastChunk >= 0 && tracker->chunks[tracker->lastChunk].key == key)
+		return &tracker->chunks[tracker->lastChunk];
+
+	int index = (int)(uintptr_t)ChunkMapGet(&tracker->lookup, key) - 1;
+	if (index < 0)
+	{
+		if (tracker->chunkCount == tracker->chunkCapacity)
+		{
+			const int capacity = tracker->chunkCapacity ? tracker->chunkCapacity * 2 : 16;
+			DirtyChunk *chunks = (DirtyChunk *)realloc(tracker->chunks, capacity * sizeof(DirtyChunk));
+			if (chunks == NULL)
+				return NULL;
+			tracker->chunks = chunks;
+			tracker->chunkCapacity = capacity;
+		}
+
+		index = tracker->chunkCount++;
+		tracker->chunks[index].key = key;
+		memset(tracker->chunks[index].rows, 0, sizeof(tracker->chunks[index].rows));
+		ChunkMapPut(&tracker->lookup, key, (void *)(uintptr_t)(index + 1));
+	}
+
+	tracker->lastChunk = index;
+	return &tracker->chunks[index];
+}
+
+void MarkTileDirty(DirtyTracker *tracker, int x, int y)
+{
+	DirtyChunk *chunk = GetDirtyChunk(tracker, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+	if (chunk != NULL)
+		chunk->rows[y & CHUNK_MASK] |= 1u << (x & CHUNK_MASK);
+}
+
+void MarkChunkDirty(DirtyTracker *tracker, int cx, int cy)
+{
+	const int chunkX = cx << CHUNK_SHIFT;
+	const int chunkY = cy << CHUNK_SHIFT;
+	if (cx < 0 || cy < 0 || chunkX >= tracker->width || chunkY >= tracker->height)
+		return;
+
+	DirtyChunk *chunk = GetDirtyChunk(tracker, cx, cy);
+	if (chunk == NULL)
+		return;
+
+	const int columns = tracker->width - chunkX < CHUNK_SIZE ? tracker->width - chunkX : CHUNK_SIZE;
+	const int rows = tracker->height - chunkY < CHUNK_SIZE ? tracker->height - chunkY : CHUNK_SIZE;
+	for (int y = 0; y < rows; y++)
+		chunk->rows[y] |= BitRange32(0, columns);
+}
+
+bool SubscribeDirtyRegions(DirtyTracker *tracker, DirtyRegionCallback callback, void *userData)
+{
+	if (tracker->subscriberCount == MAX_DIRTY_SUBSCRIBERS)
+		return false;
+
+	tracker->subscribers[tracker->subscriberCount].callback = callback;
+	tracker->subscribers[tracker->subscriberCount].userData = userData;
+	tracker->subscriberCount++;
+	return true;
+}
+
+void UnsubscribeDirtyRegions(DirtyTracker *tracker, DirtyRegionCallback callback, void *userData)
+{
+	for (int i = 0; i < tracker->subscriberCount; i++)
+	{
+		if (tracker->subscribers[i].callback == callback && tracker->subscribers[i].userData == userData)
+		{
+			memmove(&tracker->subscribers[i], &tracker->subscribers[i + 1], (tracker->subscriberCount - i - 1) * sizeof(DirtySubscriber));
+			tracker->subscriberCount--;
+			return;
+		}
+	}
+}
+
+// Coalescing
+//----------------------------------------------------------------------------------
+static bool AppendRect(DirtyTracker *tracker, int *count, int x, int y, int width, int height)
+{
+	if (*count == tracker->rectCapacity)
+	{
+		const int capacity = tracker->rectCapacity ? tracker->rectCapacity * 2 : 64;
+		DirtyRect *rects = (DirtyRect *)realloc(tracker->rects, capacity * sizeof(DirtyRect));
+		if (rects == NULL)
+			return false;
+		tracker->rects = rects;
+		tracker->rectCapacity = capacity;
+	}
+
+	tracker->rects[(*count)++] = (DirtyRect){x, y, width, height};
+	return true;
+}
+
+// Runs of set bits are extended downwards while the next row has a run with exactly the
+// same columns, so a painted block comes out as one rectangle and a stroke as a few
+static void CoalesceChunk(DirtyTracker *tracker, const DirtyChunk *chunk, int *count)
+{
+	const int chunkX = ChunkKeyX(chunk->key) << CHUNK_SHIFT;
+	const int chunkY = ChunkKeyY(chunk->key) << CHUNK_SHIFT;
+
+	// A row holds at most 16 separate runs
+	DirtyRect open[CHUNK_SIZE / 2];
+	int openCount = 0;
+
+	for (int y = 0; y <= CHUNK_SIZE; y++)
+	{
+		DirtyRect next[CHUNK_SIZE / 2];
+		int nextCount = 0;
+
+		uint32_t bits = y < CHUNK_SIZE ? chunk->rows[y] : 0;
+		while (bits != 0)
+		{
+			const int from = CountTrailingZeros32(bits);
+			const uint32_t rest = ~(bits >> from);
+			const int to = rest == 0 ? CHUNK_SIZE : from + CountTrailingZeros32(rest);
+			bits &= ~BitRange32(from, to);
+
+			DirtyRect run = {chunkX + from, chunkY + y, to - from, 1};
+			for (int i = 0; i < openCount; i++)
+			{
+				if (open[i].x == run.x && open[i].width == run.width)
+				{
+					run = open[i];
+					run.height++;
+					open[i].width = 0; // Continued, not closed
+					break;
+				}
+			}
+			next[nextCount++] = run;
+		}
+
+		for (int i = 0; i < openCount; i++)
+		{
+			if (open[i].width != 0)
+				AppendRect(tracker, count, open[i].x, open[i].y, open[i].width, open[i].height);
+		}
+		memcpy(open, next, nextCount * sizeof(DirtyRect));
+		openCount = nextCount;
+	}
+}
+
+static int CompareRows(const void *a, const void *b)
+{
+	const DirtyRect *ra = (const DirtyRect *)a;
+	const DirtyRect *rb = (const DirtyRect *)b;
+	if (ra->y != rb->y)
+		return ra->y < rb->y ? -1 : 1;
+	if (ra->height != rb->height)
+		return ra->height < rb->height ? -1 : 1;
+	return (ra->x > rb->x) - (ra->x < rb->x);
+}
+
+static int CompareColumns(const void *a, const void *b)
+{
+	const DirtyRect *ra = (const DirtyRect *)a;
+	const DirtyRect *rb = (const DirtyRect *)b;
+	if (ra->x != rb->x)
+		return ra->x < rb->x ? -1 : 1;
+	if (ra->width != rb->width)
+		return ra->width < rb->width ? -1 : 1;
+	return (ra->y > rb->y) - (ra->y < rb->y);
+}
+
+// Joins rectangles from neighbouring chunks that line up, first along rows then along columns
+static int MergeAcrossChunks(DirtyRect *rects, int count)
+{
+	if (count < 2)
+		return count;
+
+	qsort(rects, count, sizeof(DirtyRect), CompareRows);
+	int merged = 0;
+	for (int i = 1; i < count; i++)
+	{
+		DirtyRect *last = &rects[merged];
+		if (rects[i].y == last->y && rects[i].height == last->height && rects[i].x == last->x + last->width)
+			last->width += rects[i].width;
+		else
+			rects[++merged] = rects[i];
+	}
+	count = merged + 1;
+
+	qsort(rects, count, sizeof(DirtyRect), CompareColumns);
+	merged = 0;
+	for (int i = 1; i < count; i++)
+	{
+		DirtyRect *last = &rects[merged];
+		if (rects[i].x == last->x && rects[i].width == last->width && rects[i].y == last->y + last->height)
+			last->height += rects[i].height;
+		else
+			rects[++merged] = rects[i];
+	}
+	return merged + 1;
+}
+//----------------------------------------------------------------------------------
+
+int FlushDirtyRegions(DirtyTracker *tracker)
+{
+	if (tracker->chunkCount == 0)
+		return 0;
+
+	int count = 0;
+	for (int i = 0; i < tracker->chunkCount; i++)
+	{
+		CoalesceChunk(tracker, &tracker->chunks[i], &count);
+		ChunkMapRemove(&tracker->lookup, tracker->chunks[i].key);
+	}
+	tracker->chunkCount = 0;
+	tracker->lastChunk = -1;
+
+	count = MergeAcrossChunks(tracker->rects, count);
+	if (count == 0)
+		return 0;
+
+	for (int i = 0; i < tracker->subscriberCount; i++)
+		tracker->subscribers[i].callback(tracker->subscribers[i].userData, tracker->rects, count);
+	return count;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chunk_map.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+#define MAX_DIRTY_SUBSCRIBERS 8
+
+// Block of tiles that changed, in tiles
+typedef struct DirtyRect
+{
+	int x;
+	int y;
+	int width;
+	int height;
+} DirtyRect;
+
+// rects only lives until the callback returns
+typedef void (*DirtyRegionCallback)(void *userData, const DirtyRect *rects, int count);
+
+typedef struct DirtySubscriber
+{
+	DirtyRegionCallback callback;
+	void *userData;
+} DirtySubscriber;
+
+// Collects which tiles changed how they look (type or rail links) since the last flush,
+// as one bit per tile in a 32 x 32 bitmap per touched chunk. Flushing turns the bitmaps
+// into a short list of rectangles and hands it to every subscriber, so caches built on
+// top of the world only rebuild what actually changed. Writes that leave a tile as it
+// was never get here.
+typedef struct DirtyTracker
+{
+	int width;  // World size in tiles, rectangles never reach past it
+	int height;
+	ChunkMap lookup; // ChunkKey(cx, cy) -> index + 1 into chunks
+	struct DirtyChunk *chunks;
+	int chunkCount;
+	int chunkCapacity;
+	int lastChunk; // Index of the chunk marked last, strokes mostly stay inside one chunk
+
+	DirtyRect *rects; // Scratch of the flush in progress
+	int rectCapacity;
+
+	DirtySubscriber subscribers[MAX_DIRTY_SUBSCRIBERS];
+	int subscriberCount;
+} DirtyTracker;
+
+void InitDirtyTracker(DirtyTracker *tracker, int width, int height);
+void UnloadDirtyTracker(DirtyTracker *tracker);
+
+// Called by the world for every change, coordinates must be inside it
+void MarkTileDirty(DirtyTracker *tracker, int x, int y);
+// Marks the part of chunk (cx, cy) that lies inside the world
+void MarkChunkDirty(DirtyTracker *tracker, int cx, int cy);
+
+// Returns false when all MAX_DIRTY_SUBSCRIBERS slots are taken
+bool SubscribeDirtyRegions(DirtyTracker *tracker, DirtyRegionCallback callback, void *userData);
+void UnsubscribeDirtyRegions(DirtyTracker *tracker, DirtyRegionCallback callback, void *userData);
+
+// Meant to run once per frame. Coalesces everything marked since the last flush into
+// rectangles, passes them to the subscribers and starts over. Nothing is called when
+// nothing changed. Returns the number of rectangles
+int FlushDirtyRegions(DirtyTracker *tracker);
+
+#if defined(__cplusplus)
+}
+#endif
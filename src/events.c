@@ -0,0 +1,124 @@
+#include "events.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "world.h"
+
+// Sort keys are chunk row, chunk column, then position in the buffer, which keeps the write
+// order inside a chunk. Chunk coordinates of a MAX_WORLD_SIZE world fit 15 bits each
+#define ORDER_COLUMN_SHIFT 34
+#define ORDER_ROW_SHIFT 49
+#define ORDER_INDEX_MASK ((1ull << ORDER_COLUMN_SHIFT) - 1)
+
+void InitTileEventBus(TileEventBus *bus)
+{
+	UnloadTileEventBus(bus);
+}
+
+void UnloadTileEventBus(TileEventBus *bus)
+{
+	free(bus->changes);
+	free(bus->order);
+	free(bus->sorted);
+	memset(bus, 0, sizeof(TileEventBus));
+}
+
+bool GrowTileEventBus(TileEventBus *bus)
+{
+	const int capacity = bus->capacity ? bus->capacity * 2 : 256;
+	TileChange *changes = (TileChange *)realloc(bus->changes, capacity * sizeof(TileChange));
+	if (changes == NULL)
+		return false;
+	bus->changes = changes;
+	bus->capacity = capacity;
+	return true;
+}
+
+bool SubscribeTileEvents(TileEventBus *bus, TileChangeCallback callback, void *userData)
+{
+	if (bus->subscriberCount == MAX_TILE_EVENT_SUBSCRIBERS)
+		return false;
+
+	bus->subscribers[bus->subscriberCount].callback = callback;
+	bus->subscribers[bus->subscriberCount].userData = userData;
+	bus->subscriberCount++;
+	return true;
+}
+
+void UnsubscribeTileEvents(TileEventBus *bus, TileChangeCallback callback, void *userData)
+{
+	for (int i = 0; i < bus->subscriberCount; i++)
+	{
+		if (bus->subscribers[i].callback == callback && bus->subscribers[i].userData == userData)
+		{
+			memmove(&bus->subscribers[i], &bus->subscribers[i + 1], (bus->subscriberCount - i - 1) * sizeof(TileEventSubscriber));
+			bus->subscriberCount--;
+			return;
+		}
+	}
+}
+
+static int CompareOrder(const void *a, const void *b)
+{
+	const uint64_t orderA = *(const uint64_t *)a;
+	const uint64_t orderB = *(const uint64_t *)b;
+	return (orderA > orderB) - (orderA < orderB);
+}
+
+// Fills bus->sorted, returns false when out of memory
+static bool SortByChunk(TileEventBus *bus)
+{
+	if (bus->count > bus->sortedCapacity)
+	{
+		uint64_t *order = (uint64_t *)malloc(bus->count * sizeof(uint64_t));
+		TileChange *sorted = (TileChange *)malloc(bus->count * sizeof(TileChange));
+		if (order == NULL || sorted == NULL)
+		{
+			free(order);
+			free(sorted);
+			return false;
+		}
+		free(bus->order);
+		free(bus->sorted);
+		bus->order = order;
+		bus->sorted = sorted;
+		bus->sortedCapacity = bus->count;
+	}
+
+	bool inOrder = true;
+	for (int i = 0; i < bus->count; i++)
+	{
+		const TileChange *change = &bus->changes[i];
+		bus->order[i] = ((uint64_t)(change->y >> CHUNK_SHIFT) << ORDER_ROW_SHIFT) | ((uint64_t)(change->x >> CHUNK_SHIFT) << ORDER_COLUMN_SHIFT) | (uint64_t)i;
+		inOrder = inOrder && (i == 0 || bus->order[i - 1] < bus->order[i]);
+	}
+
+	// A frame of painting usually stays inside one chunk and is already sorted
+	if (inOrder)
+	{
+		memcpy(bus->sorted, bus->changes, bus->count * sizeof(TileChange));
+		return true;
+	}
+	qsort(bus->order, bus->count, sizeof(uint64_t), CompareOrder);
+	for (int i = 0; i < bus->count; i++)
+		bus->sorted[i] = bus->changes[bus->order[i] & ORDER_INDEX_MASK];
+	return true;
+}
+
+int FlushTileEvents(TileEventBus *bus)
+{
+	const int count = bus->count;
+	if (count == 0)
+		return 0;
+
+	const bool sorted = SortByChunk(bus);
+	// Subscribers may write tiles, those changes go into the emptied buffer for the next flush
+	bus->count = 0;
+	if (!sorted)
+		return 0;
+
+	for (int i = 0; i < bus->subscriberCount; i++)
+		bus->subscribers[i].callback(bus->subscribers[i].userData, bus->sorted, count);
+	return count;
+}
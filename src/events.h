@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tiles.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+#define MAX_TILE_EVENT_SUBSCRIBERS 8
+
+// One layer of one tile, prev and next are on the same layer and at most one of them is blank
+typedef struct TileChange
+{
+	int x;
+	int y;
+	TileId prev;
+	TileId next;
+} TileChange;
+
+// changes only lives until the callback returns
+typedef void (*TileChangeCallback)(void *userData, const TileChange *changes, int count);
+
+typedef struct TileEventSubscriber
+{
+	TileChangeCallback callback;
+	void *userData;
+} TileEventSubscriber;
+
+// Every tile write that changes a tile appends one TileChange to a buffer, which is handed
+// to all subscribers at once per frame, grouped chunk by chunk (rows of chunks top to
+// bottom) and in write order inside a chunk. Nothing is recorded while nobody listens.
+typedef struct TileEventBus
+{
+	TileChange *changes; // In write order
+	int count;
+	int capacity;
+
+	uint64_t *order; // Sort keys, scratch of the flush in progress
+	TileChange *sorted;
+	int sortedCapacity;
+
+	TileEventSubscriber subscribers[MAX_TILE_EVENT_SUBSCRIBERS];
+	int subscriberCount;
+} TileEventBus;
+
+void InitTileEventBus(TileEventBus *bus);
+void UnloadTileEventBus(TileEventBus *bus);
+// Returns false when out of memory, the change is dropped then
+bool GrowTileEventBus(TileEventBus *bus);
+
+// Called by SetTile, on the painting path, so it stays an append
+static inline void PublishTileChange(TileEventBus *bus, int x, int y, TileId prev, TileId next)
+{
+	if (bus->subscriberCount == 0)
+		return;
+	if (bus->count == bus->capacity && !GrowTileEventBus(bus))
+		return;
+	TileChange *change = &bus->changes[bus->count++];
+	change->x = x;
+	change->y = y;
+	change->prev = prev;
+	change->next = next;
+}
+
+// Returns false when all MAX_TILE_EVENT_SUBSCRIBERS slots are taken
+bool SubscribeTileEvents(TileEventBus *bus, TileChangeCallback callback, void *userData);
+void UnsubscribeTileEvents(TileEventBus *bus, TileChangeCallback callback, void *userData);
+
+// Meant to run once per frame. Sorts what was published since the last flush by chunk and
+// passes it to every subscriber. Nothing is called without changes. Returns their number,
+// 0 if the batch had to be dropped for lack of memory
+int FlushTileEvents(TileEventBus *bus);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,456 @@
+#include "generator.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "threads.h"
+#include "world.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GENERATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+// A chunk row spans at most CHUNK_SIZE + 1 lattice columns, padded to whole vectors
+#define LATTICE_STRIDE 40
+#define LATTICE_ROWS (CHUNK_SIZE + 1)
+
+typedef struct GeneratedRow
+{
+	Chunk **chunks; // NULL where nothing got built
+	bool ready;
+} GeneratedRow;
+
+typedef struct GeneratorJob
+{
+	const WorldGenSettings *settings;
+	int width;
+	int height;
+	int chunksWide;
+	int chunksHigh;
+
+	WorkerMutex *mutex; // Guards everything below
+	WorkerCondition *rowReady;
+	int nextRow;
+	GeneratedRow *rows;
+	bool failed;
+} GeneratorJob;
+
+WorldGenSettings DefaultWorldGenSettings(uint32_t seed)
+{
+	WorldGenSettings settings = {0};
+	settings.seed = seed;
+	settings.featureShift = 7;
+	settings.octaves = 5;
+	settings.buildingThreshold = 42000;
+	settings.waterThreshold = 22000;
+	settings.forestLow = 24000;
+	settings.forestHigh = 28000;
+	return settings;
+}
+
+// Noise in 16 bit fixed point. The SIMD kernels below do exactly the same integer
+// operations, lane by lane, so they agree with these to the bit
+//----------------------------------------------------------------------------------
+static inline uint16_t MulHi16(uint16_t a, uint16_t b)
+{
+	return (uint16_t)(((uint32_t)a * b) >> 16);
+}
+
+// 3t^2 - 2t^3, written as t^2 + 2t^2(1 - t) so every step stays inside 16 bits
+static inline uint16_t Smooth16(uint16_t t)
+{
+	const uint16_t t2 = MulHi16(t, t);
+	const uint32_t s = t2 + 2u * MulHi16(t2, (uint16_t)~t);
+	return (uint16_t)(s > 0xFFFF ? 0xFFFF : s);
+}
+
+static inline uint16_t Lerp16(uint16_t a, uint16_t b, uint16_t s)
+{
+	return (uint16_t)(MulHi16(a, (uint16_t)~s) + MulHi16(b, s));
+}
+
+// Position inside a 2^shift cell as a 16 bit fraction
+static inline uint16_t CellFraction16(int offset, int shift)
+{
+	return shift == 0 ? 0 : (uint16_t)(offset << (16 - shift));
+}
+
+static uint16_t LatticeValue(uint32_t seed, int ix, int iy)
+{
+	uint32_t hash = seed ^ ((uint32_t)ix * 0x8DA6B343u) ^ ((uint32_t)iy * 0xD8163841u);
+	hash ^= hash >> 16;
+	hash *= 0x7FEB352Du;
+	hash ^= hash >> 15;
+	hash *= 0x846CA68Bu;
+	hash ^= hash >> 16;
+	return (uint16_t)(hash >> 16);
+}
+
+static void LerpLatticeRows(const uint16_t *top, const uint16_t *bottom, uint16_t s, uint16_t *out, int count)
+{
+#if defined(GENERATOR_SSE2)
+	const __m128i weight = _mm_set1_epi16((short)s);
+	const __m128i inverse = _mm_set1_epi16((short)(uint16_t)~s);
+	for (int i = 0; i < count; i += 8)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i *)(top + i));
+		const __m128i b = _mm_loadu_si128((const __m128i *)(bottom + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_add_epi16(_mm_mulhi_epu16(a, inverse), _mm_mulhi_epu16(b, weight)));
+	}
+#else
+	for (int i = 0; i < count; i++)
+		out[i] = Lerp16(top[i], bottom[i], s);
+#endif
+}
+
+static void AccumulateRow(uint16_t *noise, const uint16_t *left, const uint16_t *right, const uint16_t *weights, int amplitudeShift)
+{
+#if defined(GENERATOR_SSE2)
+	for (int i = 0; i < CHUNK_SIZE; i += 8)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i *)(left + i));
+		const __m128i b = _mm_loadu_si128((const __m128i *)(right + i));
+		const __m128i s = _mm_loadu_si128((const __m128i *)(weights + i));
+		const __m128i inverse = _mm_xor_si128(s, _mm_set1_epi16(-1));
+		const __m128i value = _mm_add_epi16(_mm_mulhi_epu16(a, inverse), _mm_mulhi_epu16(b, s));
+		const __m128i sum = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(noise + i)), _mm_srli_epi16(value, amplitudeShift));
+		_mm_storeu_si128((__m128i *)(noise + i), sum);
+	}
+#else
+	for (int i = 0; i < CHUNK_SIZE; i++)
+		noise[i] = (uint16_t)(noise[i] + (Lerp16(left[i], right[i], weights[i]) >> amplitudeShift));
+#endif
+}
+
+// Sets tiles above the threshold to BUILDING and returns their occupancy bits
+static uint32_t ThresholdRow(const uint16_t *noise, uint16_t threshold, TileId *tiles)
+{
+#if defined(GENERATOR_SSE2)
+	// No unsigned 16 bit compare in SSE2, flipping the sign bit makes the signed one do
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	const __m128i limit = _mm_set1_epi16((short)(threshold ^ 0x8000));
+	const __m128i building = _mm_set1_epi8((char)BUILDING);
+	uint32_t bits = 0;
+	for (int i = 0; i < CHUNK_SIZE; i += 16)
+	{
+		const __m128i low = _mm_cmpgt_epi16(_mm_xor_si128(_mm_loadu_si128((const __m128i *)(noise + i)), bias), limit);
+		const __m128i high = _mm_cmpgt_epi16(_mm_xor_si128(_mm_loadu_si128((const __m128i *)(noise + i + 8)), bias), limit);
+		const __m128i mask = _mm_packs_epi16(low, high);
+		_mm_storeu_si128((__m128i *)(tiles + i), _mm_and_si128(mask, building));
+		bits |= (uint32_t)_mm_movemask_epi8(mask) << i;
+	}
+	return bits;
+#else
+	uint32_t bits = 0;
+	for (int i = 0; i < CHUNK_SIZE; i++)
+	{
+		const bool built = noise[i] > threshold;
+		tiles[i] = built ? BUILDING : BLANK_SPACE;
+		bits |= (uint32_t)built << i;
+	}
+	return bits;
+#endif
+}
+
+// Sets tiles below the water threshold to WATER and the other ones inside the forest band
+// to FOREST, returns the bits of each through water and forest
+static void ThresholdTerrainRow(const uint16_t *noise, const WorldGenSettings *settings, TileId *tiles, uint32_t *water, uint32_t *forest)
+{
+#if defined(GENERATOR_SSE2)
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	const __m128i waterLimit = _mm_set1_epi16((short)(settings->waterThreshold ^ 0x8000));
+	const __m128i forestLow = _mm_set1_epi16((short)(settings->forestLow ^ 0x8000));
+	const __m128i forestHigh = _mm_set1_epi16((short)(settings->forestHigh ^ 0x8000));
+	const __m128i waterTile = _mm_set1_epi8((char)WATER);
+	const __m128i forestTile = _mm_set1_epi8((char)FOREST);
+	*water = 0;
+	*forest = 0;
+	for (int i = 0; i < CHUNK_SIZE; i += 16)
+	{
+		const __m128i low = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(noise + i)), bias);
+		const __m128i high = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(noise + i + 8)), bias);
+		const __m128i wet = _mm_packs_epi16(_mm_cmpgt_epi16(waterLimit, low), _mm_cmpgt_epi16(waterLimit, high));
+		const __m128i belowLow = _mm_packs_epi16(_mm_cmpgt_epi16(forestLow, low), _mm_cmpgt_epi16(forestLow, high));
+		const __m128i belowHigh = _mm_packs_epi16(_mm_cmpgt_epi16(forestHigh, low), _mm_cmpgt_epi16(forestHigh, high));
+		const __m128i wooded = _mm_andnot_si128(_mm_or_si128(wet, belowLow), belowHigh);
+		_mm_storeu_si128((__m128i *)(tiles + i), _mm_or_si128(_mm_and_si128(wet, waterTile), _mm_and_si128(wooded, forestTile)));
+		*water |= (uint32_t)_mm_movemask_epi8(wet) << i;
+		*forest |= (uint32_t)_mm_movemask_epi8(wooded) << i;
+	}
+#else
+	*water = 0;
+	*forest = 0;
+	for (int i = 0; i < CHUNK_SIZE; i++)
+	{
+		const bool wet = noise[i] < settings->waterThreshold;
+		const bool wooded = !wet && noise[i] >= settings->forestLow && noise[i] < settings->forestHigh;
+		tiles[i] = wet ? WATER : wooded ? FOREST : BLANK_SPACE;
+		*water |= (uint32_t)wet << i;
+		*forest |= (uint32_t)wooded << i;
+	}
+#endif
+}
+
+static void AddOctave(uint16_t noise[CHUNK_AREA], uint32_t seed, int shift, int amplitudeShift, int chunkX, int chunkY)
+{
+	const int cellMask = (1 << shift) - 1;
+
+	// Corners around the chunk are hashed once and shared by all of its rows
+	const int ix0 = chunkX >> shift;
+	const int iy0 = chunkY >> shift;
+	const int latticeColumns = ((chunkX + CHUNK_MASK) >> shift) - ix0 + 2;
+	const int latticeRows = ((chunkY + CHUNK_MASK) >> shift) - iy0 + 2;
+	uint16_t lattice[LATTICE_ROWS + 1][LATTICE_STRIDE] = {{0}};
+	for (int ly = 0; ly < latticeRows; ly++)
+	{
+		for (int lx = 0; lx < latticeColumns; lx++)
+			lattice[ly][lx] = LatticeValue(seed, ix0 + lx, iy0 + ly);
+	}
+
+	// The horizontal position inside a cell is the same on every row
+	int cells[CHUNK_SIZE];
+	uint16_t weights[CHUNK_SIZE];
+	for (int i = 0; i < CHUNK_SIZE; i++)
+	{
+		cells[i] = ((chunkX + i) >> shift) - ix0;
+		weights[i] = Smooth16(CellFraction16((chunkX + i) & cellMask, shift));
+	}
+
+	for (int row = 0; row < CHUNK_SIZE; row++)
+	{
+		const int y = chunkY + row;
+		const int ly = (y >> shift) - iy0;
+		uint16_t column[LATTICE_STRIDE];
+		LerpLatticeRows(lattice[ly], lattice[ly + 1], Smooth16(CellFraction16(y & cellMask, shift)), column, latticeColumns);
+
+		uint16_t left[CHUNK_SIZE];
+		uint16_t right[CHUNK_SIZE];
+		for (int i = 0; i < CHUNK_SIZE; i++)
+		{
+			left[i] = column[cells[i]];
+			right[i] = column[cells[i] + 1];
+		}
+		AccumulateRow(noise + row * CHUNK_SIZE, left, right, weights, amplitudeShift);
+	}
+}
+//----------------------------------------------------------------------------------
+
+// Returns false when out of memory
+static bool GenerateChunk(const GeneratorJob *job, int cx, int cy, Chunk *chunk)
+{
+	const WorldGenSettings *settings = job->settings;
+	const int chunkX = cx << CHUNK_SHIFT;
+	const int chunkY = cy << CHUNK_SHIFT;
+
+	uint16_t noise[CHUNK_AREA];
+	memset(noise, 0, sizeof(noise));
+	for (int octave = 0; octave < settings->octaves && settings->featureShift - octave >= 0; octave++)
+		AddOctave(noise, settings->seed + (uint32_t)octave * 0x9E3779B9u, settings->featureShift - octave, octave + 1, chunkX, chunkY);
+
+	// Parts of edge chunks past the world stay blank
+	const int columns = job->width - chunkX < CHUNK_SIZE ? job->width - chunkX : CHUNK_SIZE;
+	const int rows = job->height - chunkY < CHUNK_SIZE ? job->height - chunkY : CHUNK_SIZE;
+	const uint32_t visible = BitRange32(0, columns);
+	TileId structures[CHUNK_AREA];
+	TileId terrain[CHUNK_AREA];
+	memset(structures, BLANK_SPACE, sizeof(structures));
+	memset(terrain, BLANK_SPACE, sizeof(terrain));
+	for (int row = 0; row < rows; row++)
+	{
+		TileId *built = structures + row * CHUNK_SIZE;
+		TileId *ground = terrain + row * CHUNK_SIZE;
+		const uint32_t buildings = ThresholdRow(noise + row * CHUNK_SIZE, settings->buildingThreshold, built) & visible;
+		uint32_t water;
+		uint32_t forest;
+		ThresholdTerrainRow(noise + row * CHUNK_SIZE, settings, ground, &water, &forest);
+		water &= visible;
+		forest &= visible;
+		if (columns < CHUNK_SIZE)
+		{
+			memset(built + columns, BLANK_SPACE, CHUNK_SIZE - columns);
+			memset(ground + columns, BLANK_SPACE, CHUNK_SIZE - columns);
+		}
+		chunk->planes[BUILDING - 1][row] = buildings;
+		chunk->planes[WATER - 1][row] = water;
+		chunk->planes[FOREST - 1][row] = forest;
+		chunk->occupancy[row] = buildings | water | forest;
+		chunk->typeCounts[BUILDING] += PopCount32(buildings);
+		chunk->typeCounts[WATER] += PopCount32(water);
+		chunk->typeCounts[FOREST] += PopCount32(forest);
+		chunk->nonEmpty += PopCount32(chunk->occupancy[row]);
+	}
+	chunk->typeCounts[BLANK_SPACE] = CHUNK_AREA - chunk->nonEmpty;
+
+	// Layers that got nothing stay NULL
+	if (chunk->typeCounts[BUILDING] != 0)
+	{
+		chunk->layers[LAYER_STRUCTURE] = PackTileLayer(structures);
+		if (chunk->layers[LAYER_STRUCTURE] == NULL)
+			return false;
+	}
+	if (chunk->typeCounts[WATER] + chunk->typeCounts[FOREST] != 0)
+	{
+		chunk->layers[LAYER_TERRAIN] = PackTileLayer(terrain);
+		if (chunk->layers[LAYER_TERRAIN] == NULL)
+			return false;
+	}
+	return true;
+}
+
+static void RunGeneratorWorker(void *userData)
+{
+	GeneratorJob *job = (GeneratorJob *)userData;
+	for (;;)
+	{
+		LockWorkerMutex(job->mutex);
+		const int cy = job->nextRow++;
+		UnlockWorkerMutex(job->mutex);
+		if (cy >= job->chunksHigh)
+			return;
+
+		bool failed = false;
+		Chunk **chunks = (Chunk **)calloc(job->chunksWide, sizeof(Chunk *));
+		for (int cx = 0; chunks != NULL && cx < job->chunksWide; cx++)
+		{
+			Chunk *chunk = CreateChunk();
+			if (chunk == NULL || !GenerateChunk(job, cx, cy, chunk))
+			{
+				if (chunk != NULL)
+					ReleaseChunk(chunk);
+				failed = true;
+				break;
+			}
+			if (chunk->nonEmpty == 0)
+				ReleaseChunk(chunk);
+			else
+				chunks[cx] = chunk;
+		}
+
+		LockWorkerMutex(job->mutex);
+		job->rows[cy].chunks = chunks;
+		job->rows[cy].ready = true;
+		job->failed = job->failed || failed || chunks == NULL;
+		BroadcastWorkerCondition(job->rowReady);
+		UnlockWorkerMutex(job->mutex);
+	}
+}
+
+World *GenerateWorld(int width, int height, const WorldGenSettings *settings)
+{
+	if (settings->featureShift < 0 || settings->featureShift > MAX_FEATURE_SHIFT || settings->octaves < 1)
+		return NULL;
+	World *world = CreateWorld(width, height);
+	if (world == NULL)
+		return NULL;
+
+	GeneratorJob job = {0};
+	job.settings = settings;
+	job.width = width;
+	job.height = height;
+	job.chunksWide = (width + CHUNK_MASK) >> CHUNK_SHIFT;
+	job.chunksHigh = (height + CHUNK_MASK) >> CHUNK_SHIFT;
+	job.mutex = CreateWorkerMutex();
+	job.rowReady = CreateWorkerCondition();
+	job.rows = (GeneratedRow *)calloc(job.chunksHigh, sizeof(GeneratedRow));
+	if (job.mutex == NULL || job.rowReady == NULL || job.rows == NULL)
+	{
+		DestroyWorkerMutex(job.mutex);
+		DestroyWorkerCondition(job.rowReady);
+		free(job.rows);
+		UnloadWorld(world);
+		return NULL;
+	}
+
+	int threadCount = settings->threads > 0 ? settings->threads : GetProcessorCount();
+	if (threadCount > job.chunksHigh)
+		threadCount = job.chunksHigh;
+	WorkerThread **threads = (WorkerThread **)calloc(threadCount, sizeof(WorkerThread *));
+	int started = 0;
+	for (int i = 0; threads != NULL && i < threadCount; i++)
+	{
+		threads[started] = StartWorkerThread(RunGeneratorWorker, &job);
+		if (threads[started] != NULL)
+			started++;
+	}
+	if (started == 0)
+		RunGeneratorWorker(&job);
+
+	// Rows go into the world in order, whichever thread finished them first
+	bool outOfMemory = false;
+	for (int cy = 0; cy < job.chunksHigh; cy++)
+	{
+		LockWorkerMutex(job.mutex);
+		while (!job.rows[cy].ready)
+			WaitWorkerCondition(job.rowReady, job.mutex);
+		UnlockWorkerMutex(job.mutex);
+
+		Chunk **chunks = job.rows[cy].chunks;
+		for (int cx = 0; chunks != NULL && cx < job.chunksWide; cx++)
+		{
+			if (chunks[cx] == NULL)
+				continue;
+			if (!PutDirectoryEntry(&world->chunks, ChunkKey(cx, cy), chunks[cx]))
+			{
+				ReleaseChunk(chunks[cx]);
+				outOfMemory = true;
+				continue;
+			}
+			if (!AddChunkToWorldSummary(&world->summary, cx, cy, chunks[cx]->typeCounts))
+				outOfMemory = true;
+		}
+		free(chunks);
+	}
+
+	for (int i = 0; i < started; i++)
+		JoinWorkerThread(threads[i]);
+	free(threads);
+	DestroyWorkerMutex(job.mutex);
+	DestroyWorkerCondition(job.rowReady);
+	free(job.rows);
+
+	if (job.failed || outOfMemory)
+	{
+		UnloadWorld(world);
+		return NULL;
+	}
+	// Noise plateaus give whole chunks of buildings, those all end up as one
+	InternWorldChunks(world);
+	return world;
+}
+
+static int CompareSlotKeys(const void *a, const void *b)
+{
+	const uint64_t keyA = ((const ChunkMapSlot *)a)->key;
+	const uint64_t keyB = ((const ChunkMapSlot *)b)->key;
+	return (keyA > keyB) - (keyA < keyB);
+}
+
+uint64_t ChecksumWorldTiles(const World *world)
+{
+	// FNV-1a over the chunks in key order, the directory layout depends on insertion history
+	ChunkMapSlot *slots = (ChunkMapSlot *)malloc((world->chunks.count + 1) * sizeof(ChunkMapSlot));
+	if (slots == NULL)
+		return 0;
+	uint32_t count = 0;
+	DirectoryIterator iterator = {0};
+	while (NextDirectoryEntry(&world->chunks, &iterator, &slots[count].key, &slots[count].value))
+		count++;
+	qsort(slots, count, sizeof(ChunkMapSlot), CompareSlotKeys);
+
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const Chunk *chunk = (const Chunk *)slots[i].value;
+		for (int b = 0; b < 8; b++)
+			hash = (hash ^ (uint8_t)(slots[i].key >> (8 * b))) * 0x100000001B3ull;
+		for (int layer = 0; layer < LAYER_COUNT; layer++)
+		{
+			for (int index = 0; index < CHUNK_AREA; index++)
+				hash = (hash ^ GetChunkTile(chunk, layer, index)) * 0x100000001B3ull;
+		}
+	}
+	free(slots);
+	return hash;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Noise cells are at most 2^MAX_FEATURE_SHIFT tiles across so fractions fit 16 bits
+#define MAX_FEATURE_SHIFT 15
+
+typedef struct WorldGenSettings
+{
+	uint32_t seed;
+	int threads;      // Worker threads, 0 uses one per processor
+	int featureShift; // Largest noise cell is 2^featureShift tiles, sets how far apart towns are
+	int octaves;      // Each one halves the cell size and the amplitude
+	uint16_t buildingThreshold; // Tiles whose noise (0..65535) is above this become BUILDING
+	uint16_t waterThreshold;    // Terrain whose noise is below this becomes WATER
+	uint16_t forestLow;         // Terrain whose noise is in [forestLow, forestHigh) becomes FOREST
+	uint16_t forestHigh;
+} WorldGenSettings;
+
+// Towns of a few dozen tiles, roughly one tile in six built up, lakes on about a tenth of
+// the map with a band of forest a little way off their shores
+WorldGenSettings DefaultWorldGenSettings(uint32_t seed);
+
+struct World;
+
+// Creates a world and fills it with clusters of buildings from fractal value noise, with
+// water and forest on the terrain layer where the same noise is low.
+// Every tile only depends on the seed, the settings and its position, and the noise
+// is integer arithmetic throughout, so a seed gives byte identical worlds with any
+// number of threads and with or without SIMD. Chunks are generated by worker threads
+// and put into the world in order on the calling thread, then repeated chunks are interned.
+// Returns NULL if the size is invalid or out of memory
+struct World *GenerateWorld(int width, int height, const WorldGenSettings *settings);
+
+// Hash of every tile on every layer, for checking that two worlds are identical
+uint64_t ChecksumWorldTiles(const struct World *world);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,102 @@
+#include "grid_overlay.h"
+
+#include <string.h>
+
+#include "rlgl.h"
+
+#include "world.h"
+
+#define STRINGIFY_VALUE(value) #value
+#define STRINGIFY(value) STRINGIFY_VALUE(value)
+
+// Runs with raylib's default vertex shader over a quad whose texture coordinates go from 0
+// to 1 across the rectangle. The origin is taken modulo a chunk, so coordinates stay small
+// and lines stay sharp however far the camera is from the world origin
+static const char *GridShaderCode =
+	"#version 330\n"
+	"in vec2 fragTexCoord;\n"
+	"in vec4 fragColor;\n"
+	"out vec4 finalColor;\n"
+	"uniform vec2 origin;\n"      // Top left tile, modulo the chunk size
+	"uniform vec2 span;\n"        // Size of the rectangle in tiles
+	"uniform float tilePixels;\n" // Screen pixels per tile
+	// Coverage of a one pixel wide line every spacing tiles, by the distance in pixels to the nearest
+	"float Lines(vec2 local, vec2 pixel, float spacing)\n"
+	"{\n"
+	"    vec2 away = abs(fract(local / spacing + 0.5) - 0.5) * spacing / pixel;\n"
+	"    return 1.0 - clamp(min(away.x, away.y), 0.0, 1.0);\n"
+	"}\n"
+	"float Fade(float pixels)\n"
+	"{\n"
+	"    return clamp((pixels - " STRINGIFY(GRID_HIDE_PIXELS) ") / (" STRINGIFY(GRID_FADE_PIXELS) " - " STRINGIFY(GRID_HIDE_PIXELS) "), 0.0, 1.0);\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"    vec2 local = origin + fragTexCoord * span;\n"
+	"    vec2 pixel = max(fwidth(local), vec2(1e-6));\n"
+	"    const float chunkSize = float(" STRINGIFY(CHUNK_SIZE) ");\n"
+	"    float alpha = Fade(tilePixels * chunkSize) * Lines(local, pixel, chunkSize);\n"
+	"    float minor = Fade(tilePixels);\n"
+	"    if (minor > 0.0) alpha = max(alpha, minor * Lines(local, pixel, 1.0));\n"
+	"    finalColor = vec4(fragColor.rgb, fragColor.a * alpha);\n"
+	"}\n";
+
+void InitGridOverlay(GridOverlay *grid, float gridSize)
+{
+	memset(grid, 0, sizeof(GridOverlay));
+	grid->gridSize = gridSize;
+	// Older GL versions fall back to the default shader, which cannot draw this
+	const Shader shader = LoadShaderFromMemory(NULL, GridShaderCode);
+	if (shader.id == rlGetShaderIdDefault())
+		return;
+	grid->shader = shader;
+	grid->originLoc = GetShaderLocation(shader, "origin");
+	grid->spanLoc = GetShaderLocation(shader, "span");
+	grid->tilePixelsLoc = GetShaderLocation(shader, "tilePixels");
+}
+
+void UnloadGridOverlay(GridOverlay *grid)
+{
+	if (grid->shader.id != 0)
+		UnloadShader(grid->shader);
+	grid->shader = (Shader){0};
+}
+
+// Every line as its own segment, only as long as the rectangle and only between chunks at low zoom
+static void DrawGridLines(const GridOverlay *grid, int x, int y, int width, int height, float zoom, Color color)
+{
+	const int step = grid->gridSize * zoom < GRID_HIDE_PIXELS ? CHUNK_SIZE : 1;
+	const float top = y * grid->gridSize;
+	const float bottom = (y + height) * grid->gridSize;
+	const float left = x * grid->gridSize;
+	const float right = (x + width) * grid->gridSize;
+	for (int i = (x + step - 1) / step * step; i < x + width; i += step)
+		DrawLineV((Vector2){i * grid->gridSize, top}, (Vector2){i * grid->gridSize, bottom}, color);
+	for (int j = (y + step - 1) / step * step; j < y + height; j += step)
+		DrawLineV((Vector2){left, j * grid->gridSize}, (Vector2){right, j * grid->gridSize}, color);
+}
+
+void DrawGridOverlay(const GridOverlay *grid, int x, int y, int width, int height, float zoom, Color color)
+{
+	if (width <= 0 || height <= 0)
+		return;
+	if (grid->shader.id == 0)
+	{
+		DrawGridLines(grid, x, y, width, height, zoom, color);
+		return;
+	}
+
+	const Vector2 origin = {(float)(((x % CHUNK_SIZE) + CHUNK_SIZE) % CHUNK_SIZE), (float)(((y % CHUNK_SIZE) + CHUNK_SIZE) % CHUNK_SIZE)};
+	const Vector2 span = {(float)width, (float)height};
+	const float tilePixels = grid->gridSize * zoom;
+	// A one texel white texture, only there to carry texture coordinates to the shader
+	const Texture2D white = {rlGetTextureIdDefault(), 1, 1, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+
+	BeginShaderMode(grid->shader);
+	SetShaderValue(grid->shader, grid->originLoc, &origin, SHADER_UNIFORM_VEC2);
+	SetShaderValue(grid->shader, grid->spanLoc, &span, SHADER_UNIFORM_VEC2);
+	SetShaderValue(grid->shader, grid->tilePixelsLoc, &tilePixels, SHADER_UNIFORM_FLOAT);
+	const Rectangle dest = {x * grid->gridSize, y * grid->gridSize, width * grid->gridSize, height * grid->gridSize};
+	DrawTexturePro(white, (Rectangle){0, 0, 1, 1}, dest, (Vector2){0, 0}, 0.f, color);
+	EndShaderMode();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "raylib.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Screen pixels per tile below which the lines between tiles start to fade, and where they are gone
+#define GRID_FADE_PIXELS 8.f
+#define GRID_HIDE_PIXELS 4.f
+
+// Draws the lines between tiles as one quad over the view. A fragment shader works out
+// how far each pixel is from the nearest line, so the cost does not grow with the number
+// of cells on screen. Lines between chunks stay when the tile lines fade out at low zoom.
+typedef struct GridOverlay
+{
+	Shader shader;
+	int originLoc;
+	int spanLoc;
+	int tilePixelsLoc;
+	float gridSize; // World units per tile
+} GridOverlay;
+
+// Compiles the shader. Without it, which older GL versions cannot build, the overlay falls
+// back to drawing each visible line
+void InitGridOverlay(GridOverlay *grid, float gridSize);
+void UnloadGridOverlay(GridOverlay *grid);
+
+// Inside BeginMode2D: draws the grid over the rectangle (in tiles) at the camera's zoom
+void DrawGridOverlay(const GridOverlay *grid, int x, int y, int width, int height, float zoom, Color color);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,204 @@
+#include "intern.h"
+
+#include <string.h>
+
+#include "world.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INTERN_SSE2
+#include <emmintrin.h>
+#endif
+
+// Hashed in steps of four 64 bit lanes, every buffer is a whole number of them
+#define HASH_STEP 32
+typedef char ChunkPlanesFillHashSteps[(sizeof(((Chunk *)0)->planes) % HASH_STEP == 0 && CHUNK_AREA % HASH_STEP == 0) ? 1 : -1];
+
+static const uint64_t HashKeys[4] = {0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL};
+// Added to the keys every step so swapped blocks do not hash alike
+#define HASH_KEY_STEP 0x9E3779B97F4A7C15ULL
+
+// Four accumulators in the style of XXH3: each lane adds the 32x32 bit product of its
+// keyed halves and its neighbour's raw data
+typedef struct ContentHash
+{
+	uint64_t lanes[4];
+	uint64_t step;
+} ContentHash;
+
+static void HashBuffer(ContentHash *hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+#if defined(INTERN_SSE2)
+	__m128i low = _mm_loadu_si128((const __m128i *)hash->lanes);
+	__m128i high = _mm_loadu_si128((const __m128i *)(hash->lanes + 2));
+	const __m128i keyStep = _mm_set1_epi64x((long long)HASH_KEY_STEP);
+	__m128i keyLow = _mm_add_epi64(_mm_loadu_si128((const __m128i *)HashKeys), _mm_set1_epi64x((long long)(hash->step * HASH_KEY_STEP)));
+	__m128i keyHigh = _mm_add_epi64(_mm_loadu_si128((const __m128i *)(HashKeys + 2)), _mm_set1_epi64x((long long)(hash->step * HASH_KEY_STEP)));
+	for (size_t offset = 0; offset < size; offset += HASH_STEP)
+	{
+		const __m128i dataLow = _mm_loadu_si128((const __m128i *)(bytes + offset));
+		const __m128i dataHigh = _mm_loadu_si128((const __m128i *)(bytes + offset + 16));
+		const __m128i keyedLow = _mm_xor_si128(dataLow, keyLow);
+		const __m128i keyedHigh = _mm_xor_si128(dataHigh, keyHigh);
+		const __m128i productLow = _mm_mul_epu32(keyedLow, _mm_shuffle_epi32(keyedLow, _MM_SHUFFLE(0, 3, 0, 1)));
+		const __m128i productHigh = _mm_mul_epu32(keyedHigh, _mm_shuffle_epi32(keyedHigh, _MM_SHUFFLE(0, 3, 0, 1)));
+		low = _mm_add_epi64(low, _mm_add_epi64(productLow, _mm_shuffle_epi32(dataLow, _MM_SHUFFLE(1, 0, 3, 2))));
+		high = _mm_add_epi64(high, _mm_add_epi64(productHigh, _mm_shuffle_epi32(dataHigh, _MM_SHUFFLE(1, 0, 3, 2))));
+		keyLow = _mm_add_epi64(keyLow, keyStep);
+		keyHigh = _mm_add_epi64(keyHigh, keyStep);
+	}
+	_mm_storeu_si128((__m128i *)hash->lanes, low);
+	_mm_storeu_si128((__m128i *)(hash->lanes + 2), high);
+	hash->step += size / HASH_STEP;
+#else
+	for (size_t offset = 0; offset < size; offset += HASH_STEP)
+	{
+		const uint64_t key = hash->step++ * HASH_KEY_STEP;
+		uint64_t words[4];
+		memcpy(words, bytes + offset, sizeof(words));
+		for (int lane = 0; lane < 4; lane++)
+		{
+			const uint64_t keyed = words[lane] ^ (HashKeys[lane] + key);
+			hash->lanes[lane] += (keyed & 0xFFFFFFFFu) * (keyed >> 32);
+			hash->lanes[lane ^ 1] += words[lane];
+		}
+	}
+#endif
+}
+
+static uint64_t MixHash(uint64_t value)
+{
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdULL;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ULL;
+	value ^= value >> 33;
+	return value;
+}
+
+uint64_t HashChunkContents(const World *world, const Chunk *chunk)
+{
+	ContentHash hash = {{0}, 0};
+	// Which optional planes are there, so a missing plane never hashes like a blank one
+	uint64_t present = 0;
+	HashBuffer(&hash, chunk->planes, sizeof(chunk->planes));
+	if (chunk->railMasks != NULL)
+	{
+		present |= 1;
+		HashBuffer(&hash, chunk->railMasks, CHUNK_AREA);
+	}
+	for (int i = 0; i < world->attributeCount; i++)
+	{
+		if (chunk->attributes[i] == NULL)
+			continue;
+		present |= 2u << i;
+		HashBuffer(&hash, chunk->attributes[i], (size_t)CHUNK_AREA * world->attributes[i].size);
+	}
+
+	uint64_t result = MixHash(present + hash.step);
+	for (int lane = 0; lane < 4; lane++)
+		result = MixHash(result ^ hash.lanes[lane]);
+	return result;
+}
+
+static bool SamePlane(const void *a, const void *b, size_t size)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+	return memcmp(a, b, size) == 0;
+}
+
+bool ChunkContentsEqual(const World *world, const Chunk *a, const Chunk *b)
+{
+	// The type planes pin down every layer, a position holds at most one type per layer
+	if (memcmp(a->planes, b->planes, sizeof(a->planes)) != 0)
+		return false;
+	if (!SamePlane(a->railMasks, b->railMasks, CHUNK_AREA))
+		return false;
+	for (int i = 0; i < world->attributeCount; i++)
+	{
+		if (!SamePlane(a->attributes[i], b->attributes[i], (size_t)CHUNK_AREA * world->attributes[i].size))
+			return false;
+	}
+	return true;
+}
+
+// Counts each distinct chunk once per pass
+static void CountBuffer(ChunkInterner *interner, Chunk *chunk)
+{
+	if (chunk->internPass == interner->pass)
+		return;
+	chunk->internPass = interner->pass;
+	interner->buffers++;
+}
+
+void InternWorldChunks(World *world)
+{
+	ChunkInterner *interner = &world->interner;
+	interner->pass++;
+	interner->positions = world->chunks.count;
+	interner->buffers = 0;
+
+	// Entries only the table still references were written over or erased everywhere else.
+	// Removal shifts later entries back into the freed slot, so that slot is looked at again
+	for (uint32_t i = 0; i < interner->table.capacity; i++)
+	{
+		Chunk *chunk = (Chunk *)interner->table.slots[i].value;
+		if (chunk == NULL || chunk->refCount != 1)
+			continue;
+		ChunkMapRemove(&interner->table, interner->table.slots[i].key);
+		ReleaseChunk(chunk);
+		i--;
+	}
+
+	DirectoryIterator iterator = {0};
+	uint64_t key;
+	void *entry;
+	while (NextDirectoryEntry(&world->chunks, &iterator, &key, &entry))
+	{
+		Chunk *chunk = (Chunk *)entry;
+		if (chunk->interned)
+		{
+			CountBuffer(interner, chunk);
+			continue;
+		}
+
+		const uint64_t hash = HashChunkContents(world, chunk);
+		Chunk *canonical = (Chunk *)ChunkMapGet(&interner->table, hash);
+		if (canonical == NULL)
+		{
+			RetainChunk(chunk);
+			chunk->interned = true;
+			ChunkMapPut(&interner->table, hash, chunk);
+			CountBuffer(interner, chunk);
+		}
+		else if (ChunkContentsEqual(world, canonical, chunk))
+		{
+			// Same key, so the entry stays where it is. A page a snapshot shares is copied
+			// first, which leaves chunk referenced
+			RetainChunk(canonical);
+			if (!PutDirectoryEntry(&world->chunks, key, canonical))
+			{
+				ReleaseChunk(canonical);
+				continue;
+			}
+			ReleaseChunk(chunk);
+			CountBuffer(interner, canonical);
+		}
+		else
+		{
+			// Hash collision, the chunk stays on its own and is looked at again next pass
+			CountBuffer(interner, chunk);
+		}
+	}
+}
+
+void UnloadChunkInterner(ChunkInterner *interner)
+{
+	for (uint32_t i = 0; i < interner->table.capacity; i++)
+	{
+		if (interner->table.slots[i].value != NULL)
+			ReleaseChunk((const Chunk *)interner->table.slots[i].value);
+	}
+	ChunkMapFree(&interner->table);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chunk_map.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Frames between InternWorldChunks passes in the game loop
+#define INTERN_INTERVAL 120
+
+// Hash consing of chunk contents. Every distinct chunk the world holds is kept once in a
+// table keyed by a hash of its contents, and positions whose chunk matches one there are
+// pointed at that copy instead. The table holds a reference of its own, so an interned chunk
+// is always shared and SetTile copies it on the first write like any snapshot shared chunk.
+// Large worlds repeat a lot of chunks (city blocks that are all BUILDING, pasted rail
+// patterns) and each repeat then costs a map slot instead of a chunk.
+typedef struct ChunkInterner
+{
+	ChunkMap table; // Content hash -> Chunk, each holding one reference
+	uint32_t pass;
+	// Counted by the last pass: chunk positions in the world and distinct chunks behind them
+	uint32_t positions;
+	uint32_t buffers;
+} ChunkInterner;
+
+struct World;
+struct Chunk;
+
+// Covers the tiles (through the type bit planes), rail masks and attribute planes, not
+// caches. Hashes 32 bytes per step with SSE2 when available, the scalar fallback gives
+// the same values
+uint64_t HashChunkContents(const struct World *world, const struct Chunk *chunk);
+bool ChunkContentsEqual(const struct World *world, const struct Chunk *a, const struct Chunk *b);
+
+// Interns every chunk written since the last pass and lets go of table entries nothing else
+// uses any more. Only chunks that are not interned yet get hashed, so a pass over a world
+// that did not change is a walk over the chunk map
+void InternWorldChunks(struct World *world);
+void UnloadChunkInterner(ChunkInterner *interner);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,336 @@
+#include "lod_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bits.h"
+#include "world.h"
+
+// Opacity of a block with a single painted tile, a fully painted block is opaque
+#define MIN_LOD_ALPHA 85
+// Texels recomputed per upload at most, a band of rows of the dirty rectangle
+#define LOD_BAND_TEXELS 4096
+
+static int LevelSide(int tiles, int level)
+{
+	return (int)(((int64_t)tiles + (1 << level) - 1) >> level);
+}
+
+// Average of the cell's pixels weighted by their opacity
+static Color AverageCellColor(const Color *pixels, int width, int height, Rectangle cell)
+{
+	uint64_t sums[4] = {0};
+	const int toX = (int)(cell.x + cell.width) < width ? (int)(cell.x + cell.width) : width;
+	const int toY = (int)(cell.y + cell.height) < height ? (int)(cell.y + cell.height) : height;
+	for (int y = cell.y > 0 ? (int)cell.y : 0; y < toY; y++)
+	{
+		for (int x = cell.x > 0 ? (int)cell.x : 0; x < toX; x++)
+		{
+			const Color pixel = pixels[y * width + x];
+			sums[0] += pixel.r * pixel.a;
+			sums[1] += pixel.g * pixel.a;
+			sums[2] += pixel.b * pixel.a;
+			sums[3] += pixel.a;
+		}
+	}
+	if (sums[3] == 0)
+		return BLANK;
+	return (Color){(unsigned char)(sums[0] / sums[3]), (unsigned char)(sums[1] / sums[3]), (unsigned char)(sums[2] / sums[3]), 255};
+}
+
+// Most common type of a 2^level block, ties go to the higher layer
+static Color BlockColor(const LodMap *lod, const uint64_t counts[TILE_TYPE_COUNT], uint64_t total, int level)
+{
+	if (total == 0)
+		return BLANK;
+	TileId dominant = BLANK_SPACE + 1;
+	for (int type = dominant + 1; type < TILE_TYPE_COUNT; type++)
+	{
+		if (counts[type] > counts[dominant] || (counts[type] == counts[dominant] && GetTileLayer((TileId)type) > GetTileLayer(dominant)))
+			dominant = (TileId)type;
+	}
+	const uint64_t area = 1ull << (2 * level);
+	const uint64_t alpha = MIN_LOD_ALPHA + (255 - MIN_LOD_ALPHA) * total / area;
+	Color color = lod->palette[dominant];
+	color.a = (unsigned char)(color.a * alpha / 255);
+	return color;
+}
+
+// Copy of evicted chunk (cx, cy), read from the stream once per flush however many texels
+// of however many levels need it. NULL when the record cannot be read
+static const Chunk *ReadEvictedChunk(const World *world, ChunkMap *streamed, const StreamedChunk *record, int cx, int cy)
+{
+	const uint64_t key = ChunkKey(cx, cy);
+	Chunk *chunk = (Chunk *)ChunkMapGet(streamed, key);
+	if (chunk != NULL)
+		return chunk;
+
+	chunk = (Chunk *)malloc(sizeof(Chunk));
+	if (chunk == NULL || !ReadStreamedChunk(world, record, chunk))
+	{
+		free(chunk);
+		return NULL;
+	}
+	if (!ChunkMapPut(streamed, key, chunk))
+	{
+		UnloadStreamedChunkCopy(chunk);
+		free(chunk);
+		return NULL;
+	}
+	return chunk;
+}
+
+static void FreeEvictedChunks(ChunkMap *streamed)
+{
+	for (uint32_t i = 0; i < streamed->capacity; i++)
+	{
+		Chunk *chunk = (Chunk *)streamed->slots[i].value;
+		if (chunk == NULL)
+			continue;
+		UnloadStreamedChunkCopy(chunk);
+		free(chunk);
+	}
+	ChunkMapFree(streamed);
+}
+
+// Evicted chunks are read into streamed, a NULL streamed or a failed read returns false and
+// leaves texel alone
+static bool LevelTexel(const LodMap *lod, ChunkMap *streamed, int level, int tx, int ty, Color *texel)
+{
+	uint64_t counts[TILE_TYPE_COUNT] = {0};
+	uint64_t total = 0;
+	if (level > CHUNK_SHIFT)
+	{
+		// The summary keeps counting evicted chunks, coarse levels are always up to date
+		const SummaryNode *node = GetSummaryNode(&lod->world->summary, level - CHUNK_SHIFT, tx, ty);
+		if (node != NULL)
+		{
+			memcpy(counts, node->counts, sizeof(counts));
+			total = node->total;
+		}
+		*texel = BlockColor(lod, counts, total, level);
+		return true;
+	}
+
+	const int shift = CHUNK_SHIFT - level;
+	const Chunk *chunk = GetChunk(lod->world, tx >> shift, ty >> shift);
+	const StreamedChunk *record = chunk == NULL ? GetStreamedChunk(lod->world, tx >> shift, ty >> shift) : NULL;
+	if (record != NULL)
+	{
+		// Only dirty after a snapshot restore put a different version in the directory
+		chunk = streamed != NULL ? ReadEvictedChunk(lod->world, streamed, record, tx >> shift, ty >> shift) : NULL;
+		if (chunk == NULL)
+			return false;
+	}
+	if (chunk == NULL)
+	{
+		*texel = BLANK;
+		return true;
+	}
+	// Whole rows of the type planes at once
+	const int side = 1 << level;
+	const int fromX = (tx << level) & CHUNK_MASK;
+	const int fromY = (ty << level) & CHUNK_MASK;
+	const uint32_t columns = BitRange32(fromX, fromX + side);
+	for (int y = fromY; y < fromY + side; y++)
+	{
+		total += PopCount32(chunk->occupancy[y] & columns);
+		for (int type = 1; type < TILE_TYPE_COUNT; type++)
+			counts[type] += PopCount32(chunk->planes[type - 1][y] & columns);
+	}
+	*texel = BlockColor(lod, counts, total, level);
+	return true;
+}
+
+// Recomputes texels [tx0, tx1] x [ty0, ty1] of level and uploads them, band by band. Texels
+// of evicted chunks that cannot be read are left out, the rows of such a band are sent in
+// runs around them
+static void UpdateLevelRect(LodMap *lod, ChunkMap *streamed, int level, int tx0, int ty0, int tx1, int ty1)
+{
+	const Texture2D texture = lod->levels[level];
+	if (tx1 >= texture.width)
+		tx1 = texture.width - 1;
+	if (ty1 >= texture.height)
+		ty1 = texture.height - 1;
+	const int width = tx1 - tx0 + 1;
+	if (width <= 0 || ty1 < ty0)
+		return;
+
+	Color texels[LOD_BAND_TEXELS];
+	bool computed[LOD_BAND_TEXELS];
+	const int bandRows = LOD_BAND_TEXELS / width;
+	for (int bandY = ty0; bandY <= ty1; bandY += bandRows)
+	{
+		const int rows = bandY + bandRows <= ty1 ? bandRows : ty1 - bandY + 1;
+		bool complete = true;
+		for (int y = 0; y < rows; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				computed[y * width + x] = LevelTexel(lod, streamed, level, tx0 + x, bandY + y, &texels[y * width + x]);
+				complete &= computed[y * width + x];
+			}
+		}
+		lod->texelUploads += rows * width;
+		if (complete)
+		{
+			UpdateTextureRec(texture, (Rectangle){(float)tx0, (float)bandY, (float)width, (float)rows}, texels);
+			continue;
+		}
+
+		for (int y = 0; y < rows; y++)
+		{
+			int runStart = 0;
+			for (int x = 0; x <= width; x++)
+			{
+				if (x < width && computed[y * width + x])
+					continue;
+				if (x > runStart)
+					UpdateTextureRec(texture, (Rectangle){(float)(tx0 + runStart), (float)(bandY + y), (float)(x - runStart), 1}, &texels[y * width + runStart]);
+				runStart = x + 1;
+			}
+		}
+	}
+}
+
+static void UpdateDirtyTexels(void *userData, const DirtyRect *rects, int count)
+{
+	LodMap *lod = (LodMap *)userData;
+	ChunkMap streamed = {0};
+	for (int r = 0; r < count; r++)
+	{
+		const DirtyRect *rect = &rects[r];
+		for (int level = lod->firstLevel; level <= lod->lastLevel; level++)
+			UpdateLevelRect(lod, &streamed, level, rect->x >> level, rect->y >> level, (rect->x + rect->width - 1) >> level, (rect->y + rect->height - 1) >> level);
+	}
+	FreeEvictedChunks(&streamed);
+}
+
+// Only painted blocks are visited, everything else stays blank
+static bool BuildLevel(LodMap *lod, int level)
+{
+	const World *world = lod->world;
+	const int width = LevelSide(world->width, level);
+	const int height = LevelSide(world->height, level);
+	Color *texels = (Color *)calloc((size_t)width * height, sizeof(Color));
+	if (texels == NULL)
+		return false;
+
+	if (level > CHUNK_SHIFT)
+	{
+		const ChunkMap *nodes = &world->summary.levels[level - CHUNK_SHIFT - 1];
+		for (uint32_t i = 0; i < nodes->capacity; i++)
+		{
+			if (nodes->slots[i].value == NULL)
+				continue;
+			const int tx = ChunkKeyX(nodes->slots[i].key);
+			const int ty = ChunkKeyY(nodes->slots[i].key);
+			LevelTexel(lod, NULL, level, tx, ty, &texels[ty * width + tx]);
+		}
+	}
+	else
+	{
+		// Chunks already evicted stay blank until they are painted again
+		const int shift = CHUNK_SHIFT - level;
+		DirectoryIterator iterator = {0};
+		uint64_t key;
+		void *entry;
+		while (NextDirectoryEntry(&world->chunks, &iterator, &key, &entry))
+		{
+			const int cx = ChunkKeyX(key);
+			const int cy = ChunkKeyY(key);
+			for (int ty = cy << shift; ty < (cy + 1) << shift && ty < height; ty++)
+			{
+				for (int tx = cx << shift; tx < (cx + 1) << shift && tx < width; tx++)
+					LevelTexel(lod, NULL, level, tx, ty, &texels[ty * width + tx]);
+			}
+		}
+	}
+
+	const Image image = {texels, width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+	lod->levels[level] = LoadTextureFromImage(image);
+	free(texels);
+	lod->texelUploads += width * height;
+	return lod->levels[level].id != 0;
+}
+
+static void UnloadLevels(LodMap *lod)
+{
+	for (int level = 0; level < MAX_LOD_LEVELS; level++)
+	{
+		if (lod->levels[level].id != 0)
+			UnloadTexture(lod->levels[level]);
+		lod->levels[level] = (Texture2D){0};
+	}
+}
+
+bool InitLodMap(LodMap *lod, World *world, const TileArt *art)
+{
+	memset(lod, 0, sizeof(LodMap));
+	lod->world = world;
+	lod->gridSize = (float)art->gridSize;
+
+	Image atlas = LoadImageFromTexture(art->atlas);
+	if (atlas.data == NULL)
+		return false;
+	Color *pixels = LoadImageColors(atlas);
+	for (int type = BLANK_SPACE + 1; type < TILE_TYPE_COUNT; type++)
+	{
+		if (GetTileLayer((TileId)type) == LAYER_TERRAIN)
+			lod->palette[type] = art->terrainColors[type];
+		else
+			lod->palette[type] = AverageCellColor(pixels, atlas.width, atlas.height, art->tileRects[type]);
+	}
+	UnloadImageColors(pixels);
+	UnloadImage(atlas);
+
+	while (LevelSide(world->width, lod->firstLevel) > LOD_MAX_SIDE || LevelSide(world->height, lod->firstLevel) > LOD_MAX_SIDE)
+		lod->firstLevel++;
+	lod->lastLevel = lod->firstLevel;
+	while (LevelSide(world->width, lod->lastLevel) > 1 || LevelSide(world->height, lod->lastLevel) > 1)
+		lod->lastLevel++;
+	for (int level = lod->firstLevel; level <= lod->lastLevel; level++)
+	{
+		if (BuildLevel(lod, level))
+			continue;
+		UnloadLevels(lod);
+		return false;
+	}
+
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if (SubscribeDirtyRegions(&world->dirty[layer], UpdateDirtyTexels, lod))
+			continue;
+		for (int subscribed = 0; subscribed < layer; subscribed++)
+			UnsubscribeDirtyRegions(&world->dirty[subscribed], UpdateDirtyTexels, lod);
+		UnloadLevels(lod);
+		return false;
+	}
+	return true;
+}
+
+void UnloadLodMap(LodMap *lod)
+{
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		UnsubscribeDirtyRegions(&lod->world->dirty[layer], UpdateDirtyTexels, lod);
+	UnloadLevels(lod);
+}
+
+int ChooseLodLevel(const LodMap *lod, float tilePixels)
+{
+	if (tilePixels >= LOD_TILE_PIXELS)
+		return -1;
+	int level = lod->firstLevel;
+	while (level < lod->lastLevel && (float)(1 << level) * tilePixels < 1.f)
+		level++;
+	return level;
+}
+
+void DrawLodMap(const LodMap *lod, int level, Color tint)
+{
+	const Texture2D texture = lod->levels[level];
+	const float texelSize = (float)(1 << level) * lod->gridSize;
+	const Rectangle source = {0, 0, (float)texture.width, (float)texture.height};
+	const Rectangle dest = {0, 0, texture.width * texelSize, texture.height * texelSize};
+	DrawTexturePro(texture, source, dest, (Vector2){0, 0}, 0.f, tint);
+}
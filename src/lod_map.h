@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "raylib.h"
+
+#include "chunk_textures.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Screen pixels per tile below which the map is drawn from the pyramid instead of tile art
+#define LOD_TILE_PIXELS 4.f
+// Texels across the finest level at most, levels above it are left out
+#define LOD_MAX_SIDE 2048
+// One texel per tile up to one texel for a MAX_WORLD_SIZE world
+#define MAX_LOD_LEVELS 21
+
+// Mip pyramid of the whole world for drawing it zoomed far out. A texel of level k covers
+// 2^k x 2^k tiles and holds the colour of the most common type painted there, more opaque
+// the more of the block is painted. Levels up to a chunk read the tile planes of one chunk,
+// coarser ones the world's summary pyramid, so an edit costs one texel per level and the
+// dirty trackers say which.
+typedef struct LodMap
+{
+	struct World *world;
+	float gridSize; // World units per tile
+	Color palette[TILE_TYPE_COUNT]; // Terrain colours, the average of the atlas cell for the rest
+	Texture2D levels[MAX_LOD_LEVELS]; // id 0 below firstLevel
+	int firstLevel; // Finest level that fits in LOD_MAX_SIDE
+	int lastLevel;  // A single texel
+	// For the debug overlay
+	int texelUploads;
+} LodMap;
+
+struct World;
+
+// Builds every level from what is painted and subscribes to the world's dirty trackers.
+// Returns false when the atlas cannot be read back, a level cannot be created or no
+// subscriber slot is left
+bool InitLodMap(LodMap *lod, struct World *world, const TileArt *art);
+void UnloadLodMap(LodMap *lod);
+
+// Finest level whose texels cover at least a pixel on screen, -1 when tiles are at least
+// LOD_TILE_PIXELS and should be drawn with their art
+int ChooseLodLevel(const LodMap *lod, float tilePixels);
+// Inside BeginMode2D: draws the whole world from level as one quad
+void DrawLodMap(const LodMap *lod, int level, Color tint);
+
+#if defined(__cplusplus)
+}
+#endif
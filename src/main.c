@@ -33,70 +33,892 @@ I've changed the original file - jujugogoom 2024-12-01
 
 #include "raymath.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "resource_dir.h" // utility header for SearchAndSetResourceDir
 
-#define BLANK_SPACE 0
-#define RAIL 1
-#define BUILDING 2
-#define STATION 3
+#include "bits.h"
+#include "chunk_textures.h"
+#include "generator.h"
+#include "grid_overlay.h"
+#include "lod_map.h"
+#include "minimap.h"
+#include "tile_mesh.h"
+#include "tilemap.h"
+#include "planes.h"
+#include "snapshot.h"
+#include "threads.h"
+#include "world.h"
 
-#define TOGGLES "Empty;Rail;Building;Station"
+#define TOGGLES "Empty;Rail;Building;Station;Water;Forest"
 
 #define GRID_SIZE 32
 #define INV_GRID_SIZE 0.03125f
-#define WORLD_SIZE 1000
 
 const int screenWidth = 680;
 const int screenHeight = 420;
 
-int world[WORLD_SIZE][WORLD_SIZE];
+// Ways to draw the map, B cycles through the ones that could be set up
+typedef enum RenderMode
+{
+	RENDER_TILEMAP,
+	RENDER_TILE_MESH,
+	RENDER_CHUNK_TEXTURES,
+	RENDER_TILES,
+	RENDER_MODE_COUNT,
+} RenderMode;
 
-void InitWorld()
+// Everything that draws the map, set up once the window is open
+typedef struct MapRenderers
 {
-	for (int i = 0; i < WORLD_SIZE; i++)
+	TileArt art;
+	GridOverlay grid;
+	LodMap lod;
+	bool lodAvailable;
+	bool modes[RENDER_MODE_COUNT]; // Render modes that could be set up
+	TilemapRenderer tilemap;
+	TileMeshRenderer tileMesh;
+	ChunkTextureCache chunkTextures;
+} MapRenderers;
+
+// Part of the world a frame shows and how it gets drawn, worked out before drawing starts
+typedef struct MapView
+{
+	Vector2 worldStart; // In tiles, clamped to the world
+	Vector2 worldEnd;
+	int startX; // Tiles on screen, end exclusive
+	int startY;
+	int endX;
+	int endY;
+	int lodLevel; // Of the pyramid, -1 when tiles are drawn
+	bool drawTilemap;
+	bool drawTileMesh;
+} MapView;
+
+bool CheckGuiCollision(Vector2 point, const Rectangle bounds[], int count)
+{
+	for (int i = 0; i < count; i++)
 	{
-		for (int j = 0; j < WORLD_SIZE; j++)
+		if (CheckCollisionPointRec(point, bounds[i]))
 		{
-			world[i][j] = 0;
+			return true;
 		}
 	}
+	return false;
 }
 
-void ToggleLocation(int x, int y)
+// Reads the world dimensions from "--size WIDTHxHEIGHT" or "--size N", leaves them untouched otherwise
+void ParseWorldSize(int argc, char *argv[], int *width, int *height)
 {
-	int curr = world[x][y];
-	world[x][y] = (curr + 1) % 4;
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "--size") != 0)
+			continue;
+
+		int w = 0;
+		int h = 0;
+		int read = sscanf(argv[i + 1], "%dx%d", &w, &h);
+		if (read == 1)
+			h = w;
+		if (read >= 1 && w > 0 && h > 0 && w <= MAX_WORLD_SIZE && h <= MAX_WORLD_SIZE)
+		{
+			*width = w;
+			*height = h;
+		}
+		else
+		{
+			TraceLog(LOG_WARNING, "WORLD: Invalid size \"%s\", expected WIDTHxHEIGHT up to %d", argv[i + 1], MAX_WORLD_SIZE);
+		}
+	}
 }
 
-bool CheckGuiCollision(Vector2 point, const Rectangle bounds[], int count)
+// Reads "--stream PATH", "--stream-budget MB" and "--compact SECONDS", path stays NULL when
+// streaming is not asked for
+void ParseStreamOptions(int argc, char *argv[], const char **path, size_t *budget, int *compactSeconds)
 {
-	for (int i = 0; i < count; i++)
+	for (int i = 1; i < argc - 1; i++)
 	{
-		if (CheckCollisionPointRec(point, bounds[i]))
+		if (strcmp(argv[i], "--stream") == 0)
 		{
-			return true;
+			*path = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--stream-budget") == 0)
+		{
+			int megabytes = 0;
+			if (sscanf(argv[i + 1], "%d", &megabytes) == 1 && megabytes > 0)
+				*budget = (size_t)megabytes * 1024 * 1024;
+			else
+				TraceLog(LOG_WARNING, "STREAM: Invalid budget \"%s\", expected megabytes", argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--compact") == 0)
+		{
+			int seconds = 0;
+			if (sscanf(argv[i + 1], "%d", &seconds) == 1 && seconds > 0 && seconds <= MAX_COMPACT_SECONDS)
+				*compactSeconds = seconds;
+			else
+				TraceLog(LOG_WARNING, "STREAM: Invalid idle time \"%s\", expected 1 to %d seconds", argv[i + 1], MAX_COMPACT_SECONDS);
 		}
 	}
-	return false;
+}
+
+// Reads "--seed N" and "--threads N", returns false when no seed is given and the world should start empty
+bool ParseGeneratorOptions(int argc, char *argv[], WorldGenSettings *settings)
+{
+	bool seeded = false;
+	for (int i = 1; i < argc - 1; i++)
+	{
+		unsigned int seed = 0;
+		int threads = 0;
+		if (strcmp(argv[i], "--seed") == 0 && sscanf(argv[i + 1], "%u", &seed) == 1)
+		{
+			settings->seed = seed;
+			seeded = true;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && sscanf(argv[i + 1], "%d", &threads) == 1 && threads > 0)
+		{
+			settings->threads = threads;
+		}
+	}
+	return seeded;
+}
+
+// Generates a 10k x 10k world with 1, 2, 4... threads up to one per processor, reports tiles
+// per second and checks that every thread count built the same world
+int RunGeneratorBenchmark(WorldGenSettings settings)
+{
+	const int size = 10000;
+	const int processors = GetProcessorCount();
+	uint64_t expected = 0;
+	bool identical = true;
+	for (int threads = 1;; threads = threads * 2 < processors ? threads * 2 : processors)
+	{
+		settings.threads = threads;
+		const double start = GetMonotonicTime();
+		World *world = GenerateWorld(size, size, &settings);
+		const double seconds = GetMonotonicTime() - start;
+		if (world == NULL)
+		{
+			TraceLog(LOG_ERROR, "GEN: Out of memory generating a %d x %d world", size, size);
+			return 1;
+		}
+
+		const uint64_t checksum = ChecksumWorldTiles(world);
+		if (threads == 1)
+			expected = checksum;
+		identical = identical && checksum == expected;
+		TraceLog(LOG_INFO, "GEN: %d threads, %.3f s, %.1f M tiles/s, checksum %016llx", threads, seconds, (double)size * size / seconds / 1e6, (unsigned long long)checksum);
+		UnloadWorld(world);
+
+		if (threads == processors)
+			break;
+	}
+
+	if (!identical)
+		TraceLog(LOG_ERROR, "GEN: Thread counts disagree on the world for seed %u", settings.seed);
+	return identical ? 0 : 1;
+}
+
+// Counts buildings, and buildings next to open ground, on a generated 10k x 10k world once
+// with a loop over GetTile and once on the bit planes, and checks both agree
+int RunPlaneBenchmark(WorldGenSettings settings)
+{
+	const int size = 10000;
+	World *world = GenerateWorld(size, size, &settings);
+	if (world == NULL)
+	{
+		TraceLog(LOG_ERROR, "PLANES: Out of memory generating a %d x %d world", size, size);
+		return 1;
+	}
+
+	double start = GetMonotonicTime();
+	uint64_t scalarCount = 0;
+	uint64_t scalarEdges = 0;
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+			scalarCount += GetTile(world, x, y) == BUILDING;
+	}
+	const double scalarCountTime = GetMonotonicTime() - start;
+
+	start = GetMonotonicTime();
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			if (GetTile(world, x, y) != BUILDING)
+				continue;
+			bool edge = x > 0 && GetTile(world, x - 1, y) == BLANK_SPACE;
+			edge = edge || (x < size - 1 && GetTile(world, x + 1, y) == BLANK_SPACE);
+			edge = edge || (y > 0 && GetTile(world, x, y - 1) == BLANK_SPACE);
+			edge = edge || (y < size - 1 && GetTile(world, x, y + 1) == BLANK_SPACE);
+			scalarEdges += edge;
+		}
+	}
+	const double scalarEdgesTime = GetMonotonicTime() - start;
+
+	start = GetMonotonicTime();
+	const uint64_t planeCount = CountTilesOfType(world, BUILDING, 0, 0, size, size);
+	const double planeCountTime = GetMonotonicTime() - start;
+
+	// Off by one so every chunk is only partly covered and has to be popcounted
+	start = GetMonotonicTime();
+	const uint64_t shiftedCount = CountTilesOfType(world, BUILDING, 1, 1, size - 1, size - 1);
+	const double shiftedCountTime = GetMonotonicTime() - start;
+
+	start = GetMonotonicTime();
+	const uint64_t planeEdges = CountAdjacentTiles(world, BUILDING, BLANK_SPACE, 0, 0, size, size);
+	const double planeEdgesTime = GetMonotonicTime() - start;
+
+	TileMask mask = {0};
+	double selectTime = 0.0;
+	double maskCountTime = 0.0;
+	uint64_t maskCount = 0;
+	if (InitTileMask(&mask, 0, 0, size, size))
+	{
+		start = GetMonotonicTime();
+		SelectTilesOfType(world, BUILDING, &mask);
+		selectTime = GetMonotonicTime() - start;
+		start = GetMonotonicTime();
+		maskCount = CountTileMask(&mask);
+		maskCountTime = GetMonotonicTime() - start;
+		UnloadTileMask(&mask);
+	}
+
+	uint64_t shiftedExpected = scalarCount;
+	for (int i = 0; i < size; i++)
+	{
+		shiftedExpected -= GetTile(world, i, 0) == BUILDING;
+		shiftedExpected -= i > 0 && GetTile(world, 0, i) == BUILDING;
+	}
+
+	TraceLog(LOG_INFO, "PLANES: Buildings, GetTile loop %.1f ms, planes %.3f ms, planes off by one %.1f ms", scalarCountTime * 1000.0, planeCountTime * 1000.0, shiftedCountTime * 1000.0);
+	TraceLog(LOG_INFO, "PLANES: Buildings, mask select %.1f ms, mask popcount %.1f ms", selectTime * 1000.0, maskCountTime * 1000.0);
+	TraceLog(LOG_INFO, "PLANES: Buildings next to blanks, GetTile loop %.1f ms, planes %.1f ms", scalarEdgesTime * 1000.0, planeEdgesTime * 1000.0);
+	UnloadWorld(world);
+
+	const bool agree = planeCount == scalarCount && shiftedCount == shiftedExpected && maskCount == scalarCount && planeEdges == scalarEdges;
+	if (!agree)
+		TraceLog(LOG_ERROR, "PLANES: Counts disagree, %llu buildings and %llu edges expected", (unsigned long long)scalarCount, (unsigned long long)scalarEdges);
+	return agree ? 0 : 1;
+}
+
+// Painted tiles in a rectangle of a row major map of int
+uint64_t CountVisibleInts(const int *tiles, int stride, int left, int top, int width, int height)
+{
+	uint64_t count = 0;
+	for (int y = top; y < top + height; y++)
+	{
+		for (int x = left; x < left + width; x++)
+			count += tiles[y * stride + x] != BLANK_SPACE;
+	}
+	return count;
+}
+
+// Same on a row major map of TileId
+uint64_t CountVisibleTileIds(const TileId *tiles, int stride, int left, int top, int width, int height)
+{
+	uint64_t count = 0;
+	for (int y = top; y < top + height; y++)
+	{
+		for (int x = left; x < left + width; x++)
+			count += tiles[y * stride + x] != BLANK_SPACE;
+	}
+	return count;
+}
+
+// Same through the world's chunks
+uint64_t CountVisibleTiles(const World *world, int left, int top, int width, int height)
+{
+	uint64_t count = 0;
+	for (int y = top; y < top + height; y++)
+	{
+		for (int x = left; x < left + width; x++)
+			count += GetTile(world, x, y) != BLANK_SPACE;
+	}
+	return count;
+}
+
+// Scans the tiles visible at zoom 1/8, panning across a generated 1000 x 1000 map, once in
+// a plain array of int per tile as the map used to be stored, once in an array of TileId
+// and once through GetTile, and checks all three count the same painted tiles
+int RunTileStorageBenchmark(WorldGenSettings settings)
+{
+	const int size = 1000;
+	const int rounds = 20;
+	const int viewWidth = (int)(screenWidth / (GRID_SIZE * 0.125f)) + 1;
+	const int viewHeight = (int)(screenHeight / (GRID_SIZE * 0.125f)) + 1;
+	World *world = GenerateWorld(size, size, &settings);
+	int *wide = (int *)malloc((size_t)size * size * sizeof(int));
+	TileId *narrow = (TileId *)malloc((size_t)size * size * sizeof(TileId));
+	if (world == NULL || wide == NULL || narrow == NULL)
+	{
+		TraceLog(LOG_ERROR, "STORAGE: Out of memory generating a %d x %d world", size, size);
+		UnloadWorld(world);
+		free(wide);
+		free(narrow);
+		return 1;
+	}
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			narrow[y * size + x] = GetTile(world, x, y);
+			wide[y * size + x] = narrow[y * size + x];
+		}
+	}
+
+	// Half a view per step, the way a pan across the map brings new tiles in
+	uint64_t counts[3] = {0};
+	double times[3] = {0};
+	for (int storage = 0; storage < 3; storage++)
+	{
+		const double start = GetMonotonicTime();
+		for (int round = 0; round < rounds; round++)
+		{
+			for (int top = 0; top + viewHeight <= size; top += viewHeight / 2)
+			{
+				for (int left = 0; left + viewWidth <= size; left += viewWidth / 2)
+				{
+					if (storage == 0)
+						counts[0] += CountVisibleInts(wide, size, left, top, viewWidth, viewHeight);
+					else if (storage == 1)
+						counts[1] += CountVisibleTileIds(narrow, size, left, top, viewWidth, viewHeight);
+					else
+						counts[2] += CountVisibleTiles(world, left, top, viewWidth, viewHeight);
+				}
+			}
+		}
+		times[storage] = GetMonotonicTime() - start;
+	}
+
+	TraceLog(LOG_INFO, "STORAGE: %d x %d views, int %.1f ms (%zu KB), TileId %.1f ms (%zu KB), GetTile %.1f ms", viewWidth, viewHeight, times[0] * 1000.0, (size_t)size * size * sizeof(int) / 1024, times[1] * 1000.0, (size_t)size * size * sizeof(TileId) / 1024, times[2] * 1000.0);
+	UnloadWorld(world);
+	free(wide);
+	free(narrow);
+
+	const bool agree = counts[0] == counts[1] && counts[1] == counts[2];
+	if (!agree)
+		TraceLog(LOG_ERROR, "STORAGE: Scans disagree, %llu int, %llu TileId, %llu GetTile", (unsigned long long)counts[0], (unsigned long long)counts[1], (unsigned long long)counts[2]);
+	return agree ? 0 : 1;
+}
+
+// Sum of y * stride + x + 1 over the painted tiles of a rectangle, testing every tile of a
+// row major map of TileId the way the draw loop did before the occupancy bitmaps
+uint64_t SumPaintedTilesPerTile(const TileId *tiles, int stride, int left, int top, int width, int height)
+{
+	uint64_t sum = 0;
+	for (int y = top; y < top + height; y++)
+	{
+		for (int x = left; x < left + width; x++)
+		{
+			if (tiles[y * stride + x] != BLANK_SPACE)
+				sum += (uint64_t)y * stride + x + 1;
+		}
+	}
+	return sum;
+}
+
+// Same walking the world chunk by chunk like the draw loop, skipping missing and empty
+// chunks and jumping from one set occupancy bit to the next
+uint64_t SumPaintedTilesByOccupancy(const World *world, int stride, int left, int top, int width, int height)
+{
+	uint64_t sum = 0;
+	for (int cy = top >> CHUNK_SHIFT; cy <= (top + height - 1) >> CHUNK_SHIFT; cy++)
+	{
+		for (int cx = left >> CHUNK_SHIFT; cx <= (left + width - 1) >> CHUNK_SHIFT; cx++)
+		{
+			const Chunk *chunk = GetChunk(world, cx, cy);
+			if (chunk == NULL || chunk->nonEmpty == 0)
+				continue;
+
+			const int chunkX = cx << CHUNK_SHIFT;
+			const int chunkY = cy << CHUNK_SHIFT;
+			const int fromX = (left > chunkX ? left : chunkX) - chunkX;
+			const int toX = (left + width < chunkX + CHUNK_SIZE ? left + width : chunkX + CHUNK_SIZE) - chunkX;
+			const int fromY = (top > chunkY ? top : chunkY) - chunkY;
+			const int toY = (top + height < chunkY + CHUNK_SIZE ? top + height : chunkY + CHUNK_SIZE) - chunkY;
+			const uint32_t columns = BitRange32(fromX, toX);
+			for (int y = fromY; y < toY; y++)
+			{
+				uint32_t bits = chunk->occupancy[y] & columns;
+				while (bits != 0)
+				{
+					const int x = CountTrailingZeros32(bits);
+					bits &= bits - 1;
+					sum += (uint64_t)(chunkY + y) * stride + chunkX + x + 1;
+				}
+			}
+		}
+	}
+	return sum;
+}
+
+// Pans the view at zoom 1/8 across a 1000 x 1000 map with one tile in 500 painted, testing
+// every visible tile and then scanning the occupancy bitmaps, and checks both find the
+// same tiles
+int RunOccupancyBenchmark(WorldGenSettings settings)
+{
+	const int size = 1000;
+	const int rounds = 20;
+	const int painted = size * size / 500;
+	const int viewWidth = (int)(screenWidth / (GRID_SIZE * 0.125f)) + 1;
+	const int viewHeight = (int)(screenHeight / (GRID_SIZE * 0.125f)) + 1;
+	World *world = CreateWorld(size, size);
+	TileId *tiles = (TileId *)calloc((size_t)size * size, sizeof(TileId));
+	if (world == NULL || tiles == NULL)
+	{
+		TraceLog(LOG_ERROR, "OCCUPANCY: Out of memory creating a %d x %d world", size, size);
+		UnloadWorld(world);
+		free(tiles);
+		return 1;
+	}
+	uint32_t state = settings.seed * 2654435761u + 1;
+	for (int i = 0; i < painted; i++)
+	{
+		state = state * 1664525u + 1013904223u;
+		const int x = (int)((state >> 8) % (uint32_t)size);
+		state = state * 1664525u + 1013904223u;
+		const int y = (int)((state >> 8) % (uint32_t)size);
+		SetTile(world, x, y, BUILDING);
+		tiles[y * size + x] = BUILDING;
+	}
+
+	uint64_t sums[2] = {0};
+	double times[2] = {0};
+	for (int method = 0; method < 2; method++)
+	{
+		const double start = GetMonotonicTime();
+		for (int round = 0; round < rounds; round++)
+		{
+			for (int top = 0; top + viewHeight <= size; top += viewHeight / 2)
+			{
+				for (int left = 0; left + viewWidth <= size; left += viewWidth / 2)
+				{
+					if (method == 0)
+						sums[0] += SumPaintedTilesPerTile(tiles, size, left, top, viewWidth, viewHeight);
+					else
+						sums[1] += SumPaintedTilesByOccupancy(world, size, left, top, viewWidth, viewHeight);
+				}
+			}
+		}
+		times[method] = GetMonotonicTime() - start;
+	}
+
+	TraceLog(LOG_INFO, "OCCUPANCY: %d painted tiles, %d x %d views, per tile test %.2f ms, occupancy scan %.2f ms", painted, viewWidth, viewHeight, times[0] * 1000.0, times[1] * 1000.0);
+	UnloadWorld(world);
+	free(tiles);
+
+	if (sums[0] != sums[1])
+		TraceLog(LOG_ERROR, "OCCUPANCY: Scans found different tiles");
+	return sums[0] == sums[1] ? 0 : 1;
+}
+
+// Takes snapshots of a generated 10k x 10k world with a tile painted in every chunk, so
+// every chunk exists, against a target of 1 ms each. Then paints over sampled tiles and
+// checks the last snapshot still reads what the world held when it was taken
+int RunSnapshotBenchmark(WorldGenSettings settings)
+{
+	const int size = 10000;
+	const int rounds = 5;
+	const double target = 0.001;
+	World *world = GenerateWorld(size, size, &settings);
+	if (world == NULL)
+	{
+		TraceLog(LOG_ERROR, "SNAPSHOT: Out of memory generating a %d x %d world", size, size);
+		return 1;
+	}
+	for (int y = 0; y < size; y += CHUNK_SIZE)
+	{
+		for (int x = 0; x < size; x += CHUNK_SIZE)
+			SetTile(world, x + (y / CHUNK_SIZE) % CHUNK_SIZE, y, STATION);
+	}
+
+	WorldSnapshot *snapshot = NULL;
+	double bestTake = 1e9;
+	double worstTake = 0.0;
+	for (int round = 0; round < rounds; round++)
+	{
+		UnloadWorldSnapshot(snapshot);
+		const double start = GetMonotonicTime();
+		snapshot = TakeWorldSnapshot(world);
+		const double seconds = GetMonotonicTime() - start;
+		if (snapshot == NULL)
+		{
+			TraceLog(LOG_ERROR, "SNAPSHOT: Out of memory taking a snapshot of %u chunks", world->chunks.count);
+			UnloadWorld(world);
+			return 1;
+		}
+		bestTake = seconds < bestTake ? seconds : bestTake;
+		worstTake = seconds > worstTake ? seconds : worstTake;
+	}
+
+	enum { SAMPLES = 4096 };
+	static int sampleX[SAMPLES];
+	static int sampleY[SAMPLES];
+	static TileId before[SAMPLES];
+	uint32_t state = settings.seed * 2654435761u + 1;
+	for (int i = 0; i < SAMPLES; i++)
+	{
+		state = state * 1664525u + 1013904223u;
+		sampleX[i] = (int)((state >> 8) % (uint32_t)size);
+		state = state * 1664525u + 1013904223u;
+		sampleY[i] = (int)((state >> 8) % (uint32_t)size);
+		before[i] = GetTile(world, sampleX[i], sampleY[i]);
+	}
+
+	// The first write copies a shared page and chunk, the rest mostly land in pages
+	// and chunks that were already copied or in ones of their own
+	double start = GetMonotonicTime();
+	SetTile(world, sampleX[0], sampleY[0], before[0] == STATION ? RAIL : STATION);
+	const double firstWrite = GetMonotonicTime() - start;
+	start = GetMonotonicTime();
+	for (int i = 1; i < SAMPLES; i++)
+		SetTile(world, sampleX[i], sampleY[i], before[i] == STATION ? RAIL : STATION);
+	const double laterWrites = GetMonotonicTime() - start;
+
+	int changed = 0;
+	int mismatches = 0;
+	for (int i = 0; i < SAMPLES; i++)
+	{
+		changed += GetTile(world, sampleX[i], sampleY[i]) != before[i];
+		mismatches += GetSnapshotTile(snapshot, sampleX[i], sampleY[i]) != before[i];
+	}
+
+	start = GetMonotonicTime();
+	UnloadWorldSnapshot(snapshot);
+	const double unloadTime = GetMonotonicTime() - start;
+
+	TraceLog(LOG_INFO, "SNAPSHOT: %u chunks, take best %.3f ms worst %.3f ms (target %.1f ms), unload %.3f ms", world->chunks.count, bestTake * 1000.0, worstTake * 1000.0, target * 1000.0, unloadTime * 1000.0);
+	TraceLog(LOG_INFO, "SNAPSHOT: First write after it %.3f ms, %d more writes %.3f us each", firstWrite * 1000.0, SAMPLES - 1, laterWrites / (SAMPLES - 1) * 1e6);
+	UnloadWorld(world);
+
+	if (mismatches != 0)
+		TraceLog(LOG_ERROR, "SNAPSHOT: %d of %d sampled tiles changed in the snapshot after writes to the world", mismatches, SAMPLES);
+	if (changed == 0)
+		TraceLog(LOG_ERROR, "SNAPSHOT: None of the writes changed the world, nothing was checked");
+	if (bestTake > target)
+		TraceLog(LOG_ERROR, "SNAPSHOT: Taking a snapshot missed the %.1f ms target", target * 1000.0);
+	return mismatches == 0 && changed != 0 && bestTake <= target ? 0 : 1;
+}
+
+// Loads the atlas and sets up every renderer that can run on this machine
+void InitMapRenderers(MapRenderers *renderers, World *world)
+{
+	TileArt *art = &renderers->art;
+	memset(art, 0, sizeof(TileArt));
+	art->gridSize = GRID_SIZE;
+	art->tileRects[RAIL] = (Rectangle){0, 0, 32, 32};
+	art->tileRects[BUILDING] = (Rectangle){32, 0, 32, 32};
+	art->tileRects[STATION] = (Rectangle){64, 0, 32, 32};
+	// Terrain has no art in the atlas yet and is drawn as flat colour
+	art->terrainColors[WATER] = SKYBLUE;
+	art->terrainColors[FOREST] = DARKGREEN;
+	// Rail variants for every connection mask, four to a row below the base tiles
+	for (int mask = 0; mask < RAIL_MASK_COUNT; mask++)
+	{
+		art->railRects[mask] = (Rectangle){(mask % 4) * 32, 32 + (mask / 4) * 32, 32, 32};
+	}
+	art->atlas = LoadTexture("resources/atlas.png");
+	GenTextureMipmaps(&art->atlas);
+
+	InitGridOverlay(&renderers->grid, GRID_SIZE);
+	// Zooming out past the tile art is only possible with the pyramid to draw from
+	renderers->lodAvailable = InitLodMap(&renderers->lod, world, art);
+	if (!renderers->lodAvailable)
+		TraceLog(LOG_WARNING, "RENDER: Level of detail map unavailable, zoom stays above 1/8");
+
+	renderers->modes[RENDER_TILEMAP] = InitTilemapRenderer(&renderers->tilemap, world, art);
+	if (!renderers->modes[RENDER_TILEMAP])
+		TraceLog(LOG_WARNING, "RENDER: Tilemap shader unavailable, drawing chunk by chunk");
+	renderers->modes[RENDER_TILE_MESH] = InitTileMeshRenderer(&renderers->tileMesh, world, art);
+	renderers->modes[RENDER_CHUNK_TEXTURES] = InitChunkTextureCache(&renderers->chunkTextures, world, art, 0);
+	renderers->modes[RENDER_TILES] = true;
+}
+
+void UnloadMapRenderers(MapRenderers *renderers)
+{
+	if (renderers->modes[RENDER_CHUNK_TEXTURES])
+		UnloadChunkTextureCache(&renderers->chunkTextures);
+	if (renderers->modes[RENDER_TILE_MESH])
+		UnloadTileMeshRenderer(&renderers->tileMesh);
+	if (renderers->modes[RENDER_TILEMAP])
+		UnloadTilemapRenderer(&renderers->tilemap);
+	if (renderers->lodAvailable)
+		UnloadLodMap(&renderers->lod);
+	UnloadGridOverlay(&renderers->grid);
+	UnloadTexture(renderers->art.atlas);
+}
+
+// Works out what a window of width x height pixels shows through camera and gets it ready
+// to draw in mode. Has to run before BeginDrawing
+MapView PrepareMapView(MapRenderers *renderers, World *world, Camera2D camera, int width, int height, RenderMode mode)
+{
+	const Vector2 worldSize = {(float)world->width, (float)world->height};
+	MapView view = {0};
+
+	// Calculate screen bounds to world bounds
+	const Vector2 start = GetScreenToWorld2D(Vector2Zero(), camera);
+	const Vector2 end = GetScreenToWorld2D((Vector2){(float)width, (float)height}, camera);
+	view.worldStart = Vector2Clamp(Vector2Scale(start, INV_GRID_SIZE), Vector2Zero(), worldSize);
+	view.worldEnd = Vector2Clamp(Vector2Scale(end, INV_GRID_SIZE), Vector2Zero(), worldSize);
+
+	// Only bother rendering parts of the world on screen
+	view.startX = (int)view.worldStart.x;
+	view.startY = (int)view.worldStart.y;
+	view.endX = (int)ceilf(view.worldEnd.x);
+	view.endY = (int)ceilf(view.worldEnd.y);
+	const int viewWidth = view.endX - view.startX;
+	const int viewHeight = view.endY - view.startY;
+
+	// Zoomed out this far no tile is looked at, so none has to be loaded or baked either
+	view.lodLevel = renderers->lodAvailable ? ChooseLodLevel(&renderers->lod, GRID_SIZE * camera.zoom) : -1;
+	if (view.lodLevel >= 0)
+		return view;
+	// One chunk of margin so panning finds the neighbours already loaded
+	KeepChunksResident(world, view.startX - CHUNK_SIZE, view.startY - CHUNK_SIZE, viewWidth + 2 * CHUNK_SIZE, viewHeight + 2 * CHUNK_SIZE);
+	// Before drawing starts, texture mode would drop the camera transform
+	if (mode == RENDER_CHUNK_TEXTURES)
+		BakeChunkTextures(&renderers->chunkTextures, view.startX, view.startY, viewWidth, viewHeight, GRID_SIZE * camera.zoom);
+	// Views too large for the data texture are drawn chunk by chunk
+	view.drawTilemap = mode == RENDER_TILEMAP && PrepareTilemap(&renderers->tilemap, view.startX, view.startY, viewWidth, viewHeight);
+	// Rebuilt only when the view leaves its margin or a tile in it changes
+	view.drawTileMesh = mode == RENDER_TILE_MESH && PrepareTileMesh(&renderers->tileMesh, view.startX, view.startY, viewWidth, viewHeight);
+	return view;
+}
+
+// Between BeginDrawing and EndDrawing: draws the map the way PrepareMapView set it up
+void DrawMapView(MapRenderers *renderers, const World *world, Camera2D camera, const MapView *view, RenderMode mode)
+{
+	const int startX = view->startX;
+	const int startY = view->startY;
+	const int endX = view->endX;
+	const int endY = view->endY;
+
+	BeginMode2D(camera);
+
+	DrawGridOverlay(&renderers->grid, startX, startY, endX - startX, endY - startY, camera.zoom, LIGHTGRAY);
+
+	if (view->lodLevel >= 0)
+	{
+		DrawLodMap(&renderers->lod, view->lodLevel, WHITE);
+	}
+	else if (view->drawTilemap)
+	{
+		DrawTilemap(&renderers->tilemap, startX, startY, endX - startX, endY - startY);
+	}
+	else if (view->drawTileMesh)
+	{
+		DrawTileMesh(&renderers->tileMesh);
+	}
+	else
+	{
+		// Walk chunk by chunk so unpainted chunks cost a single lookup
+		for (int cy = startY >> CHUNK_SHIFT; cy <= (endY - 1) >> CHUNK_SHIFT; cy++)
+		{
+			for (int cx = startX >> CHUNK_SHIFT; cx <= (endX - 1) >> CHUNK_SHIFT; cx++)
+			{
+				const Chunk *chunk = GetChunk(world, cx, cy);
+				if (chunk == NULL)
+				{
+					// Still on its way back from the backing file
+					if (GetStreamedChunk(world, cx, cy) != NULL)
+						DrawRectangle((cx << CHUNK_SHIFT) * GRID_SIZE, (cy << CHUNK_SHIFT) * GRID_SIZE, CHUNK_SIZE * GRID_SIZE, CHUNK_SIZE * GRID_SIZE, Fade(GRAY, 0.3f));
+					continue;
+				}
+
+				// Visible part of the chunk, in chunk local tiles
+				const int chunkX = cx << CHUNK_SHIFT;
+				const int chunkY = cy << CHUNK_SHIFT;
+				const int fromX = (startX > chunkX ? startX : chunkX) - chunkX;
+				const int toX = (endX < chunkX + CHUNK_SIZE ? endX : chunkX + CHUNK_SIZE) - chunkX;
+				const int fromY = (startY > chunkY ? startY : chunkY) - chunkY;
+				const int toY = (endY < chunkY + CHUNK_SIZE ? endY : chunkY + CHUNK_SIZE) - chunkY;
+				if (mode == RENDER_CHUNK_TEXTURES)
+					DrawCachedChunk(&renderers->chunkTextures, chunk, cx, cy, fromX, fromY, toX, toY);
+				else
+					DrawChunkTiles(&renderers->art, chunk, (Vector2){chunkX * GRID_SIZE, chunkY * GRID_SIZE}, GRID_SIZE, fromX, fromY, toX, toY);
+			}
+		}
+	}
+
+	EndMode2D();
+}
+
+// Draws frames of a generated world through a hidden window in every render mode that
+// could be set up, at each power of two zoom from 1/8 to 64, panning a tile per frame, and
+// reports the frame times of each. They are wall clock from preparing the frame to the end
+// of EndDrawing, so they include whatever the driver waits for at the buffer swap
+int RunRenderBenchmark(WorldGenSettings settings, int width, int height)
+{
+	static const char *modeNames[RENDER_MODE_COUNT] = {"Tilemap shader", "Tile mesh", "Chunk textures", "Tile by tile"};
+	const int warmupFrames = 10;
+	const int frames = 120;
+
+	SetConfigFlags(FLAG_WINDOW_HIDDEN);
+	InitWindow(screenWidth, screenHeight, "Render benchmark");
+	if (!IsWindowReady())
+	{
+		TraceLog(LOG_ERROR, "RENDER: No window to draw into");
+		return 1;
+	}
+	SetTargetFPS(0);
+	World *world = GenerateWorld(width, height, &settings);
+	if (world == NULL)
+	{
+		TraceLog(LOG_ERROR, "RENDER: Out of memory generating a %d x %d world", width, height);
+		CloseWindow();
+		return 1;
+	}
+	MapRenderers renderers;
+	InitMapRenderers(&renderers, world);
+
+	const Vector2 totalSize = {(float)world->width * GRID_SIZE, (float)world->height * GRID_SIZE};
+	for (int mode = 0; mode < RENDER_MODE_COUNT; mode++)
+	{
+		if (!renderers.modes[mode])
+		{
+			TraceLog(LOG_WARNING, "RENDER: %s unavailable, skipped", modeNames[mode]);
+			continue;
+		}
+		for (float zoom = 0.125f; zoom <= 64.0f; zoom *= 2.0f)
+		{
+			// Starts in the middle of the world and pans right, clamped like the camera
+			const Vector2 screenSize = {screenWidth / zoom, screenHeight / zoom};
+			const Vector2 lastTarget = Vector2Max(Vector2Zero(), Vector2Subtract(totalSize, screenSize));
+			Camera2D camera = {0};
+			camera.zoom = zoom;
+			camera.target = Vector2Scale(lastTarget, 0.5f);
+
+			double total = 0.0;
+			double worst = 0.0;
+			for (int frame = 0; frame < warmupFrames + frames; frame++)
+			{
+				camera.target.x = fminf(camera.target.x + GRID_SIZE, lastTarget.x);
+				const double start = GetMonotonicTime();
+				const MapView view = PrepareMapView(&renderers, world, camera, screenWidth, screenHeight, (RenderMode)mode);
+				BeginDrawing();
+				ClearBackground(RAYWHITE);
+				DrawMapView(&renderers, world, camera, &view, (RenderMode)mode);
+				EndDrawing();
+				const double seconds = GetMonotonicTime() - start;
+				if (renderers.modes[RENDER_CHUNK_TEXTURES])
+					UpdateChunkTextureCache(&renderers.chunkTextures);
+				UpdateWorldStream(world);
+				if (frame < warmupFrames)
+					continue;
+				total += seconds;
+				worst = seconds > worst ? seconds : worst;
+			}
+			TraceLog(LOG_INFO, "RENDER: %s, zoom %g, %.3f ms per frame, worst %.3f ms", modeNames[mode], zoom, total / frames * 1000.0, worst * 1000.0);
+		}
+	}
+
+	UnloadMapRenderers(&renderers);
+	UnloadWorld(world);
+	CloseWindow();
+	return 0;
+}
+
+// Debug overlay subscriber, keeps how much of the world changed in the last frame that changed
+// anything. Subscribed to every layer, so a tile changed on two layers counts twice
+typedef struct DirtyStats
+{
+	int rects;
+	long long tiles;
+	int writes;
+	int frameRects; // Summed over the layers flushed so far this frame
+	long long frameTiles;
+} DirtyStats;
+
+void CountDirtyRegions(void *userData, const DirtyRect *rects, int count)
+{
+	DirtyStats *stats = (DirtyStats *)userData;
+	stats->frameRects += count;
+	for (int i = 0; i < count; i++)
+		stats->frameTiles += (long long)rects[i].width * rects[i].height;
+}
+
+void CountTileChanges(void *userData, const TileChange *changes, int count)
+{
+	(void)changes;
+	((DirtyStats *)userData)->writes = count;
 }
 
 //------------------------------------------------------------------------------------
 // Program main entry point
 //------------------------------------------------------------------------------------
-int main(void)
+int main(int argc, char *argv[])
 {
 	// Initialization
 	//---------------------------------------------------------------------------------------
+	int worldWidth = DEFAULT_WORLD_SIZE;
+	int worldHeight = DEFAULT_WORLD_SIZE;
+	ParseWorldSize(argc, argv, &worldWidth, &worldHeight);
+	WorldGenSettings genSettings = DefaultWorldGenSettings(0);
+	const bool generate = ParseGeneratorOptions(argc, argv, &genSettings);
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--benchmark-generate") == 0)
+			return RunGeneratorBenchmark(genSettings);
+		if (strcmp(argv[i], "--benchmark-planes") == 0)
+			return RunPlaneBenchmark(genSettings);
+		if (strcmp(argv[i], "--benchmark-storage") == 0)
+			return RunTileStorageBenchmark(genSettings);
+		if (strcmp(argv[i], "--benchmark-occupancy") == 0)
+			return RunOccupancyBenchmark(genSettings);
+		if (strcmp(argv[i], "--benchmark-snapshot") == 0)
+			return RunSnapshotBenchmark(genSettings);
+		if (strcmp(argv[i], "--benchmark-render") == 0)
+			return RunRenderBenchmark(genSettings, worldWidth, worldHeight);
+	}
+
 	SetConfigFlags(FLAG_WINDOW_RESIZABLE);
 	InitWindow(screenWidth, screenHeight, "Tester");
-	InitWorld();
+	World *world = generate ? GenerateWorld(worldWidth, worldHeight, &genSettings) : CreateWorld(worldWidth, worldHeight);
+	if (world == NULL)
+	{
+		TraceLog(LOG_ERROR, "WORLD: Out of memory creating a %d x %d tile world", worldWidth, worldHeight);
+		CloseWindow();
+		return 1;
+	}
+	if (generate)
+		TraceLog(LOG_INFO, "WORLD: Generated %d x %d tile world from seed %u", world->width, world->height, genSettings.seed);
+	else
+		TraceLog(LOG_INFO, "WORLD: Created %d x %d tile world", world->width, world->height);
+	const char *streamPath = NULL;
+	size_t streamBudget = 0;
+	int compactSeconds = 0;
+	ParseStreamOptions(argc, argv, &streamPath, &streamBudget, &compactSeconds);
+	// Compaction rides on the stream, which falls back to a temporary file without a path
+	if (streamPath != NULL || compactSeconds > 0)
+	{
+		const char *streamName = streamPath != NULL ? streamPath : "temporary file";
+		if (EnableWorldStreaming(world, streamPath, streamBudget))
+			TraceLog(LOG_INFO, "STREAM: Evicting chunks to \"%s\" above %d MB", streamName, (int)(world->stream->budget / (1024 * 1024)));
+		else
+			TraceLog(LOG_WARNING, "STREAM: Could not open \"%s\", keeping every chunk in memory", streamName);
+		if (world->stream != NULL && compactSeconds > 0)
+		{
+			SetChunkCompaction(world, compactSeconds);
+			TraceLog(LOG_INFO, "STREAM: Compacting chunks idle for %d seconds", compactSeconds);
+		}
+	}
+	// Checkpoint kept with F5 and reverted to with F9
+	WorldSnapshot *checkpoint = NULL;
+	DirtyStats dirtyStats = {0};
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		SubscribeDirtyRegions(&world->dirty[layer], CountDirtyRegions, &dirtyStats);
+	SubscribeTileEvents(&world->events, CountTileChanges, &dirtyStats);
 
 	// Const init
 	//----------------------------------------------------------------------------------
 	const Vector2 ZeroVector = Vector2Zero();
 
-	const Vector2 WorldSizeVector = (const Vector2){WORLD_SIZE, WORLD_SIZE};
-	const Vector2 TotalSizeVector = (const Vector2){(WORLD_SIZE * GRID_SIZE), (WORLD_SIZE * GRID_SIZE)};
+	const Vector2 WorldSizeVector = (const Vector2){world->width, world->height};
+	const Vector2 LastTileVector = (const Vector2){world->width - 1, world->height - 1};
+	const Vector2 TotalSizeVector = Vector2Scale(WorldSizeVector, GRID_SIZE);
 	//----------------------------------------------------------------------------------
 
 	// Camera init
@@ -107,14 +929,13 @@ int main(void)
 	camera.rotation = 0.f;
 	//----------------------------------------------------------------------------------
 
-	// Texture loading
+	// Renderers
 	//----------------------------------------------------------------------------------
-	Rectangle textureRects[4];
-	textureRects[RAIL] = (Rectangle){0, 0, 32, 32};
-	textureRects[BUILDING] = (Rectangle){32, 0, 32, 32};
-	textureRects[STATION] = (Rectangle){64, 0, 32, 32};
-	Texture2D texture = LoadTexture("resources/atlas.png");
-	GenTextureMipmaps(&texture);
+	MapRenderers renderers;
+	InitMapRenderers(&renderers, world);
+	RenderMode renderMode = RENDER_TILEMAP;
+	while (!renderers.modes[renderMode])
+		renderMode++;
 	//----------------------------------------------------------------------------------
 
 	// layout_name: controls initialization
@@ -125,6 +946,7 @@ int main(void)
 	//----------------------------------------------------------------------------------
 
 	SetTargetFPS(1000);
+	int framesUntilIntern = INTERN_INTERVAL;
 	//--------------------------------------------------------------------------------------
 
 	// Main game loop
@@ -139,7 +961,9 @@ int main(void)
 		const Rectangle GuiDropdownBounds = (Rectangle){(int)(currScreenWidth * .5) - 40, 10, 80, 24};
 		const Rectangle GuiDebugToggleBounds = (Rectangle){10, currScreenHeight - 30, 20, 20};
 
-		const Rectangle GuiBounds[] = {GuiDropdownBounds, GuiDebugToggleBounds};
+		const Minimap minimap = renderers.lodAvailable ? LayoutMinimap(&renderers.lod, currScreenWidth) : (Minimap){0};
+
+		const Rectangle GuiBounds[] = {GuiDropdownBounds, GuiDebugToggleBounds, minimap.bounds};
 
 		float wheel = GetMouseWheelMove();
 		if (wheel != 0)
@@ -151,26 +975,80 @@ int main(void)
 			float scaleFactor = 1.0f + (0.25f * fabsf(wheel));
 			if (wheel < 0)
 				scaleFactor = 1.0f / scaleFactor;
-			camera.zoom = Clamp(camera.zoom * scaleFactor, 0.125f, 64.0f);
+			// With the pyramid, far enough out to fit the whole world on screen
+			const float minZoom = renderers.lodAvailable ? fminf(0.125f, fminf(currScreenWidth / TotalSizeVector.x, currScreenHeight / TotalSizeVector.y)) : 0.125f;
+			camera.zoom = Clamp(camera.zoom * scaleFactor, minZoom, 64.0f);
 
 			// Move camera, center around mouse position scaled by camera zoom
-			camera.target = Vector2Clamp(Vector2Subtract(mouseWorldPos, Vector2Scale(GetMousePosition(), 1.f / camera.zoom)), ZeroVector, Vector2Subtract(TotalSizeVector, (Vector2){currScreenWidth / camera.zoom, currScreenHeight / camera.zoom}));
+			camera.target = Vector2Clamp(Vector2Subtract(mouseWorldPos, Vector2Scale(GetMousePosition(), 1.f / camera.zoom)), ZeroVector, Vector2Max(ZeroVector, Vector2Subtract(TotalSizeVector, (Vector2){currScreenWidth / camera.zoom, currScreenHeight / camera.zoom})));
 		}
 
 		if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT))
 		{
 			Vector2 delta = GetMouseDelta();
 			delta = Vector2Scale(delta, -1.0f / camera.zoom);
-			camera.target = Vector2Clamp(Vector2Add(camera.target, delta), ZeroVector, Vector2Subtract(TotalSizeVector, (Vector2){currScreenWidth / camera.zoom, currScreenHeight / camera.zoom}));
+			camera.target = Vector2Clamp(Vector2Add(camera.target, delta), ZeroVector, Vector2Max(ZeroVector, Vector2Subtract(TotalSizeVector, (Vector2){currScreenWidth / camera.zoom, currScreenHeight / camera.zoom})));
 		}
 
-		if (IsMouseButtonDown(MOUSE_BUTTON_LEFT) && !CheckGuiCollision(GetMousePosition(), GuiBounds, 2) && !DropdownActive)
+		// Clicking or dragging on the minimap centres the camera on that spot
+		if (renderers.lodAvailable && IsMouseButtonDown(MOUSE_BUTTON_LEFT) && CheckCollisionPointRec(GetMousePosition(), minimap.bounds) && !DropdownActive)
+		{
+			const Vector2 tile = GetMinimapToWorld(&renderers.lod, minimap, GetMousePosition());
+			const Vector2 halfScreen = {currScreenWidth * .5f / camera.zoom, currScreenHeight * .5f / camera.zoom};
+			camera.target = Vector2Clamp(Vector2Subtract(Vector2Scale(tile, GRID_SIZE), halfScreen), ZeroVector, Vector2Max(ZeroVector, Vector2Subtract(TotalSizeVector, (Vector2){currScreenWidth / camera.zoom, currScreenHeight / camera.zoom})));
+		}
+
+		// Every stroke from press to release is a single undo step
+		if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+			BeginUndoTransaction(&world->undo);
+
+		if (IsMouseButtonDown(MOUSE_BUTTON_LEFT) && !CheckGuiCollision(GetMousePosition(), GuiBounds, 3) && !DropdownActive)
 		{
 			Vector2 mousePos = GetScreenToWorld2D(GetMousePosition(), camera);
-			Vector2 clicked = Vector2Clamp(Vector2Scale((Vector2){mousePos.x, mousePos.y}, INV_GRID_SIZE), ZeroVector, WorldSizeVector);
-			world[(int)clicked.x][(int)clicked.y] = SelectedMode;
+			Vector2 clicked = Vector2Clamp(Vector2Scale((Vector2){mousePos.x, mousePos.y}, INV_GRID_SIZE), ZeroVector, LastTileVector);
+			SetTile(world, (int)clicked.x, (int)clicked.y, (TileId)SelectedMode);
 		}
 
+		if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT) && !EndUndoTransaction(&world->undo))
+			TraceLog(LOG_WARNING, "UNDO: Stroke is larger than the undo budget and cannot be undone");
+
+		if (IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL))
+		{
+			const bool shift = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+			if (IsKeyPressed(KEY_Z) && !shift)
+				UndoWorld(world);
+			if (IsKeyPressed(KEY_Y) || (IsKeyPressed(KEY_Z) && shift))
+				RedoWorld(world);
+		}
+
+		if (IsKeyPressed(KEY_F5) && !IsMouseButtonDown(MOUSE_BUTTON_LEFT))
+		{
+			UnloadWorldSnapshot(checkpoint);
+			checkpoint = TakeWorldSnapshot(world);
+		}
+		if (IsKeyPressed(KEY_F9) && checkpoint != NULL && !IsMouseButtonDown(MOUSE_BUTTON_LEFT))
+			RestoreWorldSnapshot(world, checkpoint);
+		if (IsKeyPressed(KEY_B))
+		{
+			do
+				renderMode = (renderMode + 1) % RENDER_MODE_COUNT;
+			while (!renderers.modes[renderMode]);
+		}
+
+		// Everything this frame changed reaches the subscribers at once
+		FlushTileEvents(&world->events);
+		for (int layer = 0; layer < LAYER_COUNT; layer++)
+			FlushDirtyRegions(&world->dirty[layer]);
+		if (dirtyStats.frameRects > 0)
+		{
+			dirtyStats.rects = dirtyStats.frameRects;
+			dirtyStats.tiles = dirtyStats.frameTiles;
+			dirtyStats.frameRects = 0;
+			dirtyStats.frameTiles = 0;
+		}
+
+		const MapView view = PrepareMapView(&renderers, world, camera, currScreenWidth, currScreenHeight, renderMode);
+
 		// Draw
 		//----------------------------------------------------------------------------------
 		BeginDrawing();
@@ -179,32 +1057,7 @@ int main(void)
 
 		// Draw 2d
 		//----------------------------------------------------------------------------------
-		BeginMode2D(camera);
-		// Calculate screen bounds to world bounds
-		Vector2 start = GetScreenToWorld2D(ZeroVector, camera);
-		Vector2 end = GetScreenToWorld2D((Vector2){currScreenWidth, currScreenHeight}, camera);
-		Vector2 worldStart = Vector2Clamp(Vector2Scale(start, INV_GRID_SIZE), ZeroVector, WorldSizeVector);
-		Vector2 worldEnd = Vector2Clamp(Vector2Scale(end, INV_GRID_SIZE), ZeroVector, WorldSizeVector);
-
-		// Only bother rendering parts of the world on screen
-		for (int i = worldStart.x; i < worldEnd.x; i++)
-		{
-			DrawLineV((Vector2){(float)GRID_SIZE * i, 0}, (Vector2){(float)GRID_SIZE * i, WORLD_SIZE * GRID_SIZE}, LIGHTGRAY);
-			for (int j = worldStart.y; j < worldEnd.y; j++)
-			{
-				if (i == (int)worldStart.x)
-				{
-					DrawLineV((Vector2){0, (float)GRID_SIZE * j}, (Vector2){WORLD_SIZE * GRID_SIZE, (float)GRID_SIZE * j}, LIGHTGRAY);
-				}
-				if (world[i][j] != 0)
-				{
-					int currPos = world[i][j];
-					DrawTextureRec(texture, textureRects[currPos], (Vector2){i * GRID_SIZE, j * GRID_SIZE}, WHITE);
-				}
-			}
-		}
-
-		EndMode2D();
+		DrawMapView(&renderers, world, camera, &view, renderMode);
 		//----------------------------------------------------------------------------------
 
 		// raygui: controls drawing
@@ -212,26 +1065,77 @@ int main(void)
 		if (GuiDropdownBox(GuiDropdownBounds, TOGGLES, &SelectedMode, DropdownActive))
 			DropdownActive = !DropdownActive;
 		GuiToggle(GuiDebugToggleBounds, "#191#", &DebugActive);
+		if (renderers.lodAvailable)
+			DrawMinimap(&renderers.lod, minimap, (Rectangle){view.worldStart.x, view.worldStart.y, view.worldEnd.x - view.worldStart.x, view.worldEnd.y - view.worldStart.y});
 		if (DebugActive)
 		{
 			const char *fpsText = TextFormat("CURRENT FPS: %i", GetFPS());
 			DrawText(fpsText, currScreenWidth - (MeasureText(fpsText, 20) + 20), currScreenHeight - 30, 20, GREEN);
-			const char *renderInfo = TextFormat("Rendering from x %d to %d; y %d to %d", (int)worldStart.x, (int)worldEnd.x, (int)worldStart.y, (int)worldEnd.y);
+			const char *renderInfo = TextFormat("Rendering from x %d to %d; y %d to %d", (int)view.worldStart.x, (int)view.worldEnd.x, (int)view.worldStart.y, (int)view.worldEnd.y);
 			DrawText(renderInfo, currScreenWidth - (MeasureText(renderInfo, 20) + 20), currScreenHeight - 60, 20, GREEN);
 			const char *positionInfo = TextFormat("Currently targeting %d, %d", (int)camera.target.x, (int)camera.target.y);
 			DrawText(positionInfo, currScreenWidth - (MeasureText(positionInfo, 20) + 20), currScreenHeight - 90, 20, GREEN);
 			const Vector2 mousePos = Vector2Scale(GetMousePosition(), 1.f / camera.zoom);
 			const char *mouseInfo = TextFormat("Mouse targeting %d, %d", (int)mousePos.x, (int)mousePos.y);
 			DrawText(mouseInfo, currScreenWidth - (MeasureText(mouseInfo, 20) + 20), currScreenHeight - 120, 20, GREEN);
+			const char *chunkInfo = TextFormat("Chunks allocated: %u (%u KB)", world->chunks.count, (unsigned int)(world->chunks.count * sizeof(Chunk) / 1024));
+			DrawText(chunkInfo, currScreenWidth - (MeasureText(chunkInfo, 20) + 20), currScreenHeight - 150, 20, GREEN);
+			uint64_t visibleCounts[TILE_TYPE_COUNT];
+			CountTilesInRect(world, view.startX, view.startY, view.endX - view.startX, view.endY - view.startY, visibleCounts);
+			const char *countInfo = TextFormat("Visible rail %d, buildings %d, stations %d, water %d, forest %d", (int)visibleCounts[RAIL], (int)visibleCounts[BUILDING], (int)visibleCounts[STATION], (int)visibleCounts[WATER], (int)visibleCounts[FOREST]);
+			DrawText(countInfo, currScreenWidth - (MeasureText(countInfo, 20) + 20), currScreenHeight - 180, 20, GREEN);
+			const char *undoInfo = TextFormat("Undo %d, redo %d (%d of %d KB)", world->undo.undoCount, world->undo.redoCount, (int)((world->undo.redoEnd - world->undo.head) / 1024), (int)(world->undo.budget / 1024));
+			DrawText(undoInfo, currScreenWidth - (MeasureText(undoInfo, 20) + 20), currScreenHeight - 210, 20, GREEN);
+			const char *checkpointInfo = checkpoint ? TextFormat("Checkpoint of %u chunks (F9 to revert)", checkpoint->chunks.count) : "No checkpoint (F5 to save)";
+			DrawText(checkpointInfo, currScreenWidth - (MeasureText(checkpointInfo, 20) + 20), currScreenHeight - 240, 20, GREEN);
+			const char *dirtyInfo = TextFormat("Last change: %d writes, %d rects, %lld tiles", dirtyStats.writes, dirtyStats.rects, dirtyStats.tiles);
+			DrawText(dirtyInfo, currScreenWidth - (MeasureText(dirtyInfo, 20) + 20), currScreenHeight - 270, 20, GREEN);
+			const char *renderModeInfo;
+			if (view.lodLevel >= 0)
+				renderModeInfo = TextFormat("Level of detail %d: %d tiles per texel, %d texel uploads, %.2f ms frame", view.lodLevel, 1 << view.lodLevel, renderers.lod.texelUploads, GetFrameTime() * 1000.f);
+			else if (view.drawTilemap)
+				renderModeInfo = TextFormat("Tilemap shader (B): %d chunk uploads, %d rect uploads, %.2f ms frame", renderers.tilemap.chunkUploads, renderers.tilemap.rectUploads, GetFrameTime() * 1000.f);
+			else if (view.drawTileMesh)
+				renderModeInfo = TextFormat("Tile mesh (B): %d quads, %d rebuilds, %.2f ms frame", renderers.tileMesh.vertexCount / 6, renderers.tileMesh.rebuilds, GetFrameTime() * 1000.f);
+			else if (renderMode == RENDER_CHUNK_TEXTURES)
+				renderModeInfo = TextFormat("Chunk textures (B): %d baked, %d direct, %u cached in %d of %d MB, %.2f ms frame", renderers.chunkTextures.drawnBaked, renderers.chunkTextures.drawnDirect, renderers.chunkTextures.textures.count, (int)(renderers.chunkTextures.bytes >> 20), (int)(renderers.chunkTextures.budget >> 20), GetFrameTime() * 1000.f);
+			else
+				renderModeInfo = TextFormat("Tile by tile (B): %.2f ms frame", GetFrameTime() * 1000.f);
+			DrawText(renderModeInfo, currScreenWidth - (MeasureText(renderModeInfo, 20) + 20), currScreenHeight - 300, 20, GREEN);
+			const ChunkInterner *interner = &world->interner;
+			const char *internInfo = TextFormat("Dedup: %u chunks share %u buffers (%.2fx)", interner->positions, interner->buffers, interner->buffers > 0 ? (double)interner->positions / interner->buffers : 1.0);
+			DrawText(internInfo, currScreenWidth - (MeasureText(internInfo, 20) + 20), currScreenHeight - 330, 20, GREEN);
+			if (world->stream != NULL)
+			{
+				const char *streamInfo = TextFormat("Streaming: %u out of memory, %d loading, %d evictions, %d loads", world->stream->evicted.count, world->stream->loadsInFlight, world->stream->evictions, world->stream->loads);
+				DrawText(streamInfo, currScreenWidth - (MeasureText(streamInfo, 20) + 20), currScreenHeight - 360, 20, GREEN);
+				const ChunkStream *stream = world->stream;
+				const uint32_t hotReads = stream->hotHits + stream->hotMisses;
+				const char *compactInfo = TextFormat("Compacted: %d chunks, %d of %d KB, %.0f%% hot hits, %.1f us per decompress", stream->compactions, (int)(stream->compressedBytes / 1024), (int)(stream->compactedBytes / 1024), hotReads > 0 ? 100.0 * stream->hotHits / hotReads : 0.0, stream->decompressions > 0 ? 1e6 * stream->decompressSeconds / stream->decompressions : 0.0);
+				DrawText(compactInfo, currScreenWidth - (MeasureText(compactInfo, 20) + 20), currScreenHeight - 390, 20, GREEN);
+			}
 		}
 		//----------------------------------------------------------------------------------
 
 		EndDrawing();
 		//----------------------------------------------------------------------------------
+
+		if (renderers.modes[RENDER_CHUNK_TEXTURES])
+			UpdateChunkTextureCache(&renderers.chunkTextures);
+		// Finished loads show up next frame, evictions happen after the frame is out
+		UpdateWorldStream(world);
+		// Chunks painted since the last pass get shared with any identical ones
+		if (--framesUntilIntern == 0)
+		{
+			InternWorldChunks(world);
+			framesUntilIntern = INTERN_INTERVAL;
+		}
 	}
 
 	// De-Initialization
-	UnloadTexture(texture);
+	UnloadMapRenderers(&renderers);
+	UnloadWorldSnapshot(checkpoint);
+	UnloadWorld(world);
 	CloseWindow(); // Close window and OpenGL context
 	//--------------------------------------------------------------------------------------
 
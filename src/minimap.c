@@ -0,0 +1,49 @@
+#include "minimap.h"
+
+#include "raymath.h"
+
+#include "world.h"
+
+Minimap LayoutMinimap(const LodMap *lod, int screenWidth)
+{
+	const World *world = lod->world;
+	const float longest = (float)(world->width > world->height ? world->width : world->height);
+	Minimap minimap = {0};
+	minimap.bounds.width = MINIMAP_SIZE * world->width / longest;
+	minimap.bounds.height = MINIMAP_SIZE * world->height / longest;
+	minimap.bounds.x = screenWidth - MINIMAP_MARGIN - minimap.bounds.width;
+	minimap.bounds.y = MINIMAP_MARGIN;
+
+	// Finest level no wider than the panel, texels never get smaller than a pixel
+	minimap.level = lod->firstLevel;
+	while (minimap.level < lod->lastLevel && (lod->levels[minimap.level].width > MINIMAP_SIZE || lod->levels[minimap.level].height > MINIMAP_SIZE))
+		minimap.level++;
+	return minimap;
+}
+
+void DrawMinimap(const LodMap *lod, Minimap minimap, Rectangle view)
+{
+	const World *world = lod->world;
+	const Texture2D texture = lod->levels[minimap.level];
+	// The last texel of a row or column can reach past the world, only the world is shown
+	const float texelTiles = (float)(1 << minimap.level);
+	const Rectangle source = {0, 0, world->width / texelTiles, world->height / texelTiles};
+	DrawRectangleRec(minimap.bounds, Fade(BLACK, 0.6f));
+	DrawTexturePro(texture, source, minimap.bounds, (Vector2){0, 0}, 0.f, WHITE);
+	DrawRectangleLinesEx(minimap.bounds, 1.f, GRAY);
+
+	// Clamped to the panel, zoomed out or near an edge the view reaches past the world
+	const float scale = minimap.bounds.width / world->width;
+	const Rectangle bounds = minimap.bounds;
+	const float left = Clamp(bounds.x + view.x * scale, bounds.x, bounds.x + bounds.width - 2.f);
+	const float top = Clamp(bounds.y + view.y * scale, bounds.y, bounds.y + bounds.height - 2.f);
+	const float right = Clamp(bounds.x + (view.x + view.width) * scale, left + 2.f, bounds.x + bounds.width);
+	const float bottom = Clamp(bounds.y + (view.y + view.height) * scale, top + 2.f, bounds.y + bounds.height);
+	DrawRectangleLinesEx((Rectangle){left, top, right - left, bottom - top}, 1.f, RED);
+}
+
+Vector2 GetMinimapToWorld(const LodMap *lod, Minimap minimap, Vector2 point)
+{
+	const float scale = lod->world->width / minimap.bounds.width;
+	return (Vector2){(point.x - minimap.bounds.x) * scale, (point.y - minimap.bounds.y) * scale};
+}
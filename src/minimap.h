@@ -0,0 +1,35 @@
+#pragma once
+
+#include "raylib.h"
+
+#include "lod_map.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Screen pixels of the panel's longer side
+#define MINIMAP_SIZE 160
+// Screen pixels between the panel and the corner of the window
+#define MINIMAP_MARGIN 10
+
+// Overview of the whole world in the top right corner. Shows a level of the LOD pyramid,
+// the finest one that still fits the panel, so it costs nothing to keep up to date beyond
+// the texels the pyramid uploads for edits anyway
+typedef struct Minimap
+{
+	Rectangle bounds; // On screen
+	int level;        // Of the pyramid, about one texel per pixel of the panel
+} Minimap;
+
+// Places the panel for the window size, keeping the world's aspect ratio
+Minimap LayoutMinimap(const LodMap *lod, int screenWidth);
+// Outside BeginMode2D: draws the panel with the rectangle (in tiles) the camera shows
+void DrawMinimap(const LodMap *lod, Minimap minimap, Rectangle view);
+// Tile position under a point of the panel
+Vector2 GetMinimapToWorld(const LodMap *lod, Minimap minimap, Vector2 point);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,264 @@
+#include "palette.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "world.h"
+
+// Every palette fits an 8 bit index
+typedef char PaletteFitsByteIndex[(TILE_TYPE_COUNT <= 256) ? 1 : -1];
+
+#define NO_SLOT 0xFF
+
+static int BitsForCount(int count)
+{
+	if (count <= 1)
+		return 0;
+	if (count <= 2)
+		return 1;
+	if (count <= 4)
+		return 2;
+	if (count <= 16)
+		return 4;
+	return 8;
+}
+
+static size_t PackedWords(int bits)
+{
+	return (size_t)CHUNK_AREA * bits / 64;
+}
+
+static TileLayer *AllocTileLayer(int bits)
+{
+	const size_t size = sizeof(TileLayer) + PackedWords(bits) * sizeof(uint64_t);
+	TileLayer *layer = (TileLayer *)malloc(size);
+	if (layer == NULL)
+		return NULL;
+	memset(layer, 0, size);
+	layer->bits = (uint8_t)bits;
+	return layer;
+}
+
+static void SetTileLayerSlot(TileLayer *layer, int index, int slot)
+{
+	const unsigned int bit = (unsigned int)index * layer->bits;
+	const uint64_t mask = (((uint64_t)1 << layer->bits) - 1) << (bit & 63);
+	uint64_t *word = &layer->packed[bit >> 6];
+	*word = (*word & ~mask) | ((uint64_t)slot << (bit & 63));
+}
+
+static int FindPaletteSlot(const TileLayer *layer, TileId tile)
+{
+	for (int slot = 0; slot < layer->count; slot++)
+	{
+		if (layer->palette[slot] == tile)
+			return slot;
+	}
+	return -1;
+}
+
+// Copy with the unused entries dropped, wide enough for extra more
+static TileLayer *RepackTileLayer(const TileLayer *layer, int extra)
+{
+	uint8_t remap[TILE_TYPE_COUNT];
+	int live = 0;
+	for (int slot = 0; slot < layer->count; slot++)
+		remap[slot] = layer->uses[slot] != 0 ? (uint8_t)live++ : NO_SLOT;
+
+	TileLayer *packed = AllocTileLayer(BitsForCount(live + extra));
+	if (packed == NULL)
+		return NULL;
+	for (int slot = 0; slot < layer->count; slot++)
+	{
+		if (remap[slot] == NO_SLOT)
+			continue;
+		packed->palette[remap[slot]] = layer->palette[slot];
+		packed->uses[remap[slot]] = layer->uses[slot];
+	}
+	packed->count = (uint8_t)live;
+	if (packed->bits != 0)
+	{
+		for (int index = 0; index < CHUNK_AREA; index++)
+			SetTileLayerSlot(packed, index, remap[GetTileLayerSlot(layer, index)]);
+	}
+	return packed;
+}
+
+TileLayer *CreateTileLayer(TileId fill)
+{
+	TileLayer *layer = AllocTileLayer(0);
+	if (layer == NULL)
+		return NULL;
+	layer->palette[0] = fill;
+	layer->uses[0] = CHUNK_AREA;
+	layer->count = 1;
+	return layer;
+}
+
+TileLayer *PackTileLayer(const TileId *tiles)
+{
+	uint8_t slots[TILE_TYPE_COUNT];
+	memset(slots, NO_SLOT, sizeof(slots));
+	TileId palette[TILE_TYPE_COUNT];
+	uint16_t uses[TILE_TYPE_COUNT] = {0};
+	int count = 0;
+	for (int index = 0; index < CHUNK_AREA; index++)
+	{
+		const TileId tile = tiles[index];
+		if (slots[tile] == NO_SLOT)
+		{
+			slots[tile] = (uint8_t)count;
+			palette[count++] = tile;
+		}
+		uses[slots[tile]]++;
+	}
+
+	TileLayer *layer = AllocTileLayer(BitsForCount(count));
+	if (layer == NULL)
+		return NULL;
+	memcpy(layer->palette, palette, count);
+	memcpy(layer->uses, uses, count * sizeof(uint16_t));
+	layer->count = (uint8_t)count;
+	if (layer->bits != 0)
+	{
+		for (int index = 0; index < CHUNK_AREA; index++)
+			SetTileLayerSlot(layer, index, slots[tiles[index]]);
+	}
+	return layer;
+}
+
+void UnpackTileLayer(const TileLayer *layer, TileId *tiles)
+{
+	if (layer->bits == 0)
+	{
+		memset(tiles, layer->palette[0], CHUNK_AREA);
+		return;
+	}
+	for (int index = 0; index < CHUNK_AREA; index++)
+		tiles[index] = ReadTileLayer(layer, index);
+}
+
+TileLayer *CopyTileLayer(const TileLayer *layer)
+{
+	const size_t size = GetTileLayerBytes(layer);
+	TileLayer *copy = (TileLayer *)malloc(size);
+	if (copy != NULL)
+		memcpy(copy, layer, size);
+	return copy;
+}
+
+void FreeTileLayer(TileLayer *layer)
+{
+	free(layer);
+}
+
+size_t GetTileLayerBytes(const TileLayer *layer)
+{
+	return sizeof(TileLayer) + PackedWords(layer->bits) * sizeof(uint64_t);
+}
+
+bool WriteTileLayer(TileLayer **layer, int index, TileId tile)
+{
+	TileLayer *current = *layer;
+	if (ReadTileLayer(current, index) == tile)
+		return true;
+
+	int slot = FindPaletteSlot(current, tile);
+	if (slot < 0)
+	{
+		for (int unused = 0; unused < current->count && slot < 0; unused++)
+		{
+			if (current->uses[unused] == 0)
+				slot = unused;
+		}
+		if (slot < 0 && current->count < (1 << current->bits))
+			slot = current->count++;
+		if (slot < 0)
+		{
+			TileLayer *wider = RepackTileLayer(current, 1);
+			if (wider == NULL)
+				return false;
+			FreeTileLayer(current);
+			current = *layer = wider;
+			slot = current->count++;
+		}
+		current->palette[slot] = tile;
+	}
+
+	// Looked up after a repack, which moves the slots
+	const int prev = GetTileLayerSlot(current, index);
+	SetTileLayerSlot(current, index, slot);
+	current->uses[slot]++;
+	if (--current->uses[prev] != 0)
+		return true;
+
+	int live = 0;
+	for (int entry = 0; entry < current->count; entry++)
+		live += current->uses[entry] != 0;
+	if (BitsForCount(live) < current->bits)
+	{
+		// Staying wide is still correct, so running out of memory here is not a failure
+		TileLayer *narrower = RepackTileLayer(current, 0);
+		if (narrower != NULL)
+		{
+			FreeTileLayer(current);
+			*layer = narrower;
+		}
+	}
+	return true;
+}
+//----------------------------------------------------------------------------------
+
+// Encoding
+//----------------------------------------------------------------------------------
+uint32_t GetEncodedTileLayerSize(const TileLayer *layer)
+{
+	return 2 + layer->count + (uint32_t)(PackedWords(layer->bits) * sizeof(uint64_t));
+}
+
+uint8_t *EncodeTileLayer(const TileLayer *layer, uint8_t *data)
+{
+	const size_t packedSize = PackedWords(layer->bits) * sizeof(uint64_t);
+	data[0] = layer->bits;
+	data[1] = layer->count;
+	memcpy(data + 2, layer->palette, layer->count);
+	memcpy(data + 2 + layer->count, layer->packed, packedSize);
+	return data + 2 + layer->count + packedSize;
+}
+
+uint32_t MeasureEncodedTileLayer(const uint8_t *data)
+{
+	return 2 + data[1] + (uint32_t)(PackedWords(data[0]) * sizeof(uint64_t));
+}
+
+TileLayer *DecodeTileLayer(const uint8_t *data)
+{
+	const int bits = data[0];
+	const int count = data[1];
+	if (bits > 8 || (bits & (bits - 1)) != 0 || count < 1 || count > TILE_TYPE_COUNT || count > (1 << bits))
+		return NULL;
+
+	TileLayer *layer = AllocTileLayer(bits);
+	if (layer == NULL)
+		return NULL;
+	layer->count = (uint8_t)count;
+	memcpy(layer->palette, data + 2, count);
+	memcpy(layer->packed, data + 2 + count, PackedWords(bits) * sizeof(uint64_t));
+
+	bool valid = true;
+	for (int slot = 0; slot < count; slot++)
+		valid &= layer->palette[slot] < TILE_TYPE_COUNT;
+	for (int index = 0; index < CHUNK_AREA && valid; index++)
+	{
+		const int slot = GetTileLayerSlot(layer, index);
+		valid = slot < count;
+		if (valid)
+			layer->uses[slot]++;
+	}
+	if (!valid)
+	{
+		FreeTileLayer(layer);
+		return NULL;
+	}
+	return layer;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tiles.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// One layer of one chunk, CHUNK_AREA tiles stored as indices into a palette of the values
+// the layer holds. Indices are 0, 1, 2, 4 or 8 bits, the fewest the palette fits in, so a
+// layer that is one value everywhere has no index bits at all and one holding a type or two
+// next to blanks costs an eighth or a quarter of a byte per tile. Widths are powers of two
+// so an index never straddles two words and reading a tile stays a shift and a mask.
+typedef struct TileLayer
+{
+	uint8_t bits;  // Per index
+	uint8_t count; // Palette entries, an entry nothing uses any more is kept until its slot is needed
+	TileId palette[TILE_TYPE_COUNT]; // Distinct values
+	uint16_t uses[TILE_TYPE_COUNT];  // Tiles pointing at each entry
+	uint64_t packed[];               // Index of tile i is at bit i * bits, CHUNK_AREA * bits / 64 words
+} TileLayer;
+
+static inline int GetTileLayerSlot(const TileLayer *layer, int index)
+{
+	if (layer->bits == 0)
+		return 0;
+	const unsigned int bit = (unsigned int)index * layer->bits;
+	return (int)((layer->packed[bit >> 6] >> (bit & 63)) & ((1u << layer->bits) - 1));
+}
+
+static inline TileId ReadTileLayer(const TileLayer *layer, int index)
+{
+	return layer->palette[GetTileLayerSlot(layer, index)];
+}
+
+// Every tile fill, no index bits. NULL when out of memory
+TileLayer *CreateTileLayer(TileId fill);
+// Packs CHUNK_AREA tiles at the narrowest width their values allow. NULL when out of memory
+TileLayer *PackTileLayer(const TileId *tiles);
+// Writes all CHUNK_AREA tiles out as one byte each
+void UnpackTileLayer(const TileLayer *layer, TileId *tiles);
+TileLayer *CopyTileLayer(const TileLayer *layer);
+void FreeTileLayer(TileLayer *layer);
+// Heap bytes the layer takes
+size_t GetTileLayerBytes(const TileLayer *layer);
+
+// Re-packs when the palette outgrows the index width, and when entries falling out of use let
+// it shrink to a narrower one. *layer may be replaced. Returns false when out of memory, the
+// layer is left as it was then
+bool WriteTileLayer(TileLayer **layer, int index, TileId tile);
+
+// Packed form for the stream file: bits, count, the palette, then the indices
+uint32_t GetEncodedTileLayerSize(const TileLayer *layer);
+// Returns the byte after the encoded layer
+uint8_t *EncodeTileLayer(const TileLayer *layer, uint8_t *data);
+uint32_t MeasureEncodedTileLayer(const uint8_t *data);
+// NULL when out of memory or the data is not an encoded layer
+TileLayer *DecodeTileLayer(const uint8_t *data);
+
+#if defined(__cplusplus)
+}
+#endif
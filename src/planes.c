@@ -0,0 +1,348 @@
+#include "planes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "world.h"
+
+#if defined(__AVX2__)
+#define PLANES_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PLANES_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define PLANES_NEON
+#include <arm_neon.h>
+#endif
+
+uint64_t PopCountBytes(const void *data, size_t size)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+	uint64_t total = 0;
+	size_t i = 0;
+#if defined(PLANES_AVX2)
+	// Bits per nibble from a lookup table, then eight bytes at a time summed by the absolute difference to 0
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	__m256i sums = _mm256_setzero_si256();
+	for (; i + 32 <= size; i += 32)
+	{
+		const __m256i value = _mm256_loadu_si256((const __m256i *)(bytes + i));
+		const __m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(value, nibble));
+		const __m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(value, 4), nibble));
+		sums = _mm256_add_epi64(sums, _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+	}
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i *)lanes, sums);
+	total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(PLANES_SSE2)
+	// No byte shuffle in SSE2, the bits of each byte are added up pairwise instead
+	const __m128i pairs = _mm_set1_epi8(0x55);
+	const __m128i quads = _mm_set1_epi8(0x33);
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+	__m128i sums = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i value = _mm_loadu_si128((const __m128i *)(bytes + i));
+		value = _mm_sub_epi8(value, _mm_and_si128(_mm_srli_epi16(value, 1), pairs));
+		value = _mm_add_epi8(_mm_and_si128(value, quads), _mm_and_si128(_mm_srli_epi16(value, 2), quads));
+		value = _mm_and_si128(_mm_add_epi8(value, _mm_srli_epi16(value, 4)), nibble);
+		sums = _mm_add_epi64(sums, _mm_sad_epu8(value, _mm_setzero_si128()));
+	}
+	uint64_t lanes[2];
+	_mm_storeu_si128((__m128i *)lanes, sums);
+	total = lanes[0] + lanes[1];
+#elif defined(PLANES_NEON)
+	uint64x2_t sums = vdupq_n_u64(0);
+	for (; i + 16 <= size; i += 16)
+		sums = vpadalq_u32(sums, vpaddlq_u16(vpaddlq_u8(vcntq_u8(vld1q_u8(bytes + i)))));
+	total = vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
+#endif
+	for (; i + 4 <= size; i += 4)
+	{
+		uint32_t word;
+		memcpy(&word, bytes + i, sizeof(word));
+		total += (uint64_t)PopCount32(word);
+	}
+	for (; i < size; i++)
+		total += (uint64_t)PopCount32(bytes[i]);
+	return total;
+}
+
+// Tile masks
+//----------------------------------------------------------------------------------
+bool InitTileMask(TileMask *mask, int x, int y, int width, int height)
+{
+	memset(mask, 0, sizeof(TileMask));
+	if (width <= 0 || height <= 0)
+		return true;
+
+	const int stride = (width + 63) >> 6;
+	uint64_t *bits = (uint64_t *)calloc((size_t)stride * (size_t)height, sizeof(uint64_t));
+	if (bits == NULL)
+		return false;
+	mask->x = x;
+	mask->y = y;
+	mask->width = width;
+	mask->height = height;
+	mask->stride = stride;
+	mask->bits = bits;
+	return true;
+}
+
+void UnloadTileMask(TileMask *mask)
+{
+	free(mask->bits);
+	memset(mask, 0, sizeof(TileMask));
+}
+
+static bool SameTileMaskRect(const TileMask *mask, const TileMask *other)
+{
+	return mask->x == other->x && mask->y == other->y && mask->width == other->width && mask->height == other->height;
+}
+
+bool IntersectTileMasks(TileMask *mask, const TileMask *other)
+{
+	if (!SameTileMaskRect(mask, other))
+		return false;
+	const size_t words = (size_t)mask->stride * (size_t)mask->height;
+	for (size_t i = 0; i < words; i++)
+		mask->bits[i] &= other->bits[i];
+	return true;
+}
+
+bool UniteTileMasks(TileMask *mask, const TileMask *other)
+{
+	if (!SameTileMaskRect(mask, other))
+		return false;
+	const size_t words = (size_t)mask->stride * (size_t)mask->height;
+	for (size_t i = 0; i < words; i++)
+		mask->bits[i] |= other->bits[i];
+	return true;
+}
+
+uint64_t CountTileMask(const TileMask *mask)
+{
+	// Bits past the width of a row are never set
+	return PopCountBytes(mask->bits, (size_t)mask->stride * (size_t)mask->height * sizeof(uint64_t));
+}
+
+// Sets bits, a chunk row of the mask's row, whose bit 0 is column offset of the mask.
+// bits must already be clipped to the mask
+static void SetTileMaskBits(TileMask *mask, int row, int offset, uint32_t bits)
+{
+	uint64_t *words = mask->bits + (size_t)row * (size_t)mask->stride;
+	if (offset < 0)
+	{
+		bits >>= -offset;
+		offset = 0;
+	}
+	const int word = offset >> 6;
+	const int shift = offset & 63;
+	words[word] |= (uint64_t)bits << shift;
+	if (shift > 32 && (bits >> (64 - shift)) != 0)
+		words[word + 1] |= (uint64_t)(bits >> (64 - shift));
+}
+//----------------------------------------------------------------------------------
+
+// Chunk rows
+//----------------------------------------------------------------------------------
+// Rows of chunk (cx, cy) with the bits of tiles of type set. Evicted chunks are read back
+// from the stream, anything past the edge of the world is left clear
+static void ReadTypeRows(const World *world, int cx, int cy, TileId type, uint32_t rows[CHUNK_SIZE])
+{
+	memset(rows, 0, sizeof(uint32_t) * CHUNK_SIZE);
+	if (cx < 0 || cy < 0)
+		return;
+	const int chunkX = cx << CHUNK_SHIFT;
+	const int chunkY = cy << CHUNK_SHIFT;
+	if (chunkX >= world->width || chunkY >= world->height)
+		return;
+
+	const Chunk *chunk = GetChunk(world, cx, cy);
+	Chunk streamed;
+	if (chunk == NULL)
+	{
+		const StreamedChunk *record = GetStreamedChunk(world, cx, cy);
+		if (record != NULL && ReadStreamedChunk(world, record, &streamed))
+			chunk = &streamed;
+	}
+
+	if (type != BLANK_SPACE)
+	{
+		if (chunk != NULL)
+			memcpy(rows, chunk->planes[type - 1], sizeof(uint32_t) * CHUNK_SIZE);
+	}
+	else
+	{
+		const int columns = world->width - chunkX < CHUNK_SIZE ? world->width - chunkX : CHUNK_SIZE;
+		const int height = world->height - chunkY < CHUNK_SIZE ? world->height - chunkY : CHUNK_SIZE;
+		const uint32_t visible = BitRange32(0, columns);
+		for (int y = 0; y < height; y++)
+			rows[y] = (chunk != NULL ? ~chunk->occupancy[y] : 0xFFFFFFFFu) & visible;
+	}
+	if (chunk == &streamed)
+		UnloadStreamedChunkCopy(&streamed);
+}
+
+// Rows of chunk (cx, cy) with the bits of tiles of type that have a neighbour of the other type set
+static void ReadAdjacentRows(const World *world, int cx, int cy, TileId type, TileId neighbour, uint32_t rows[CHUNK_SIZE])
+{
+	ReadTypeRows(world, cx, cy, type, rows);
+	uint32_t any = 0;
+	for (int y = 0; y < CHUNK_SIZE; y++)
+		any |= rows[y];
+	if (any == 0)
+		return;
+
+	uint32_t centre[CHUNK_SIZE];
+	uint32_t west[CHUNK_SIZE];
+	uint32_t east[CHUNK_SIZE];
+	uint32_t north[CHUNK_SIZE];
+	uint32_t south[CHUNK_SIZE];
+	ReadTypeRows(world, cx, cy, neighbour, centre);
+	ReadTypeRows(world, cx - 1, cy, neighbour, west);
+	ReadTypeRows(world, cx + 1, cy, neighbour, east);
+	ReadTypeRows(world, cx, cy - 1, neighbour, north);
+	ReadTypeRows(world, cx, cy + 1, neighbour, south);
+
+	for (int y = 0; y < CHUNK_SIZE; y++)
+	{
+		// Bit x is column x, so shifting a row up one bit lines every tile up with its western neighbour
+		uint32_t touching = (centre[y] << 1) | (west[y] >> CHUNK_MASK) | (centre[y] >> 1) | (east[y] << CHUNK_MASK);
+		touching |= y > 0 ? centre[y - 1] : north[CHUNK_MASK];
+		touching |= y < CHUNK_MASK ? centre[y + 1] : south[0];
+		rows[y] &= touching;
+	}
+}
+
+static uint64_t WholeChunkCount(const World *world, int cx, int cy, TileId type)
+{
+	const Chunk *chunk = GetChunk(world, cx, cy);
+	if (chunk != NULL)
+		return (uint64_t)chunk->typeCounts[type];
+	const StreamedChunk *record = GetStreamedChunk(world, cx, cy);
+	if (record != NULL)
+		return record->typeCounts[type];
+	return type == BLANK_SPACE ? CHUNK_AREA : 0;
+}
+//----------------------------------------------------------------------------------
+
+// Rectangle walk
+//----------------------------------------------------------------------------------
+typedef struct PlaneQuery
+{
+	const World *world;
+	TileId type;
+	TileId neighbour;
+	bool adjacent;      // Only tiles of type next to one of neighbour type
+	int x0, y0, x1, y1; // Clipped to the world, end exclusive
+	TileMask *mask;     // Set when selecting, counting otherwise
+	uint64_t total;
+} PlaneQuery;
+
+static bool ClipPlaneQuery(PlaneQuery *query, int x, int y, int width, int height)
+{
+	if (query->type >= TILE_TYPE_COUNT || query->neighbour >= TILE_TYPE_COUNT)
+		return false;
+	query->x0 = x > 0 ? x : 0;
+	query->y0 = y > 0 ? y : 0;
+	query->x1 = x + width < query->world->width ? x + width : query->world->width;
+	query->y1 = y + height < query->world->height ? y + height : query->world->height;
+	return query->x0 < query->x1 && query->y0 < query->y1;
+}
+
+static void RunPlaneQuery(PlaneQuery *query)
+{
+	for (int cy = query->y0 >> CHUNK_SHIFT; cy <= (query->y1 - 1) >> CHUNK_SHIFT; cy++)
+	{
+		const int chunkY = cy << CHUNK_SHIFT;
+		const int fromY = query->y0 > chunkY ? query->y0 - chunkY : 0;
+		const int toY = query->y1 < chunkY + CHUNK_SIZE ? query->y1 - chunkY : CHUNK_SIZE;
+		for (int cx = query->x0 >> CHUNK_SHIFT; cx <= (query->x1 - 1) >> CHUNK_SHIFT; cx++)
+		{
+			const int chunkX = cx << CHUNK_SHIFT;
+			const int fromX = query->x0 > chunkX ? query->x0 - chunkX : 0;
+			const int toX = query->x1 < chunkX + CHUNK_SIZE ? query->x1 - chunkX : CHUNK_SIZE;
+			const bool covered = fromX == 0 && fromY == 0 && toX == CHUNK_SIZE && toY == CHUNK_SIZE;
+			if (covered && query->mask == NULL && !query->adjacent)
+			{
+				query->total += WholeChunkCount(query->world, cx, cy, query->type);
+				continue;
+			}
+
+			uint32_t rows[CHUNK_SIZE];
+			if (query->adjacent)
+				ReadAdjacentRows(query->world, cx, cy, query->type, query->neighbour, rows);
+			else
+				ReadTypeRows(query->world, cx, cy, query->type, rows);
+
+			const uint32_t columns = BitRange32(fromX, toX);
+			for (int y = 0; y < CHUNK_SIZE; y++)
+				rows[y] = y >= fromY && y < toY ? rows[y] & columns : 0;
+
+			if (query->mask == NULL)
+			{
+				query->total += PopCountBytes(rows, sizeof(rows));
+				continue;
+			}
+			for (int y = fromY; y < toY; y++)
+			{
+				if (rows[y] != 0)
+					SetTileMaskBits(query->mask, chunkY + y - query->mask->y, chunkX - query->mask->x, rows[y]);
+			}
+		}
+	}
+}
+
+static void SelectTiles(PlaneQuery *query, TileMask *mask)
+{
+	if (mask->bits == NULL)
+		return;
+	memset(mask->bits, 0, (size_t)mask->stride * (size_t)mask->height * sizeof(uint64_t));
+	query->mask = mask;
+	if (ClipPlaneQuery(query, mask->x, mask->y, mask->width, mask->height))
+		RunPlaneQuery(query);
+}
+//----------------------------------------------------------------------------------
+
+void SelectTilesOfType(const World *world, TileId type, TileMask *mask)
+{
+	PlaneQuery query = {0};
+	query.world = world;
+	query.type = type;
+	SelectTiles(&query, mask);
+}
+
+void SelectAdjacentTiles(const World *world, TileId type, TileId neighbour, TileMask *mask)
+{
+	PlaneQuery query = {0};
+	query.world = world;
+	query.type = type;
+	query.neighbour = neighbour;
+	query.adjacent = true;
+	SelectTiles(&query, mask);
+}
+
+uint64_t CountTilesOfType(const World *world, TileId type, int x, int y, int width, int height)
+{
+	PlaneQuery query = {0};
+	query.world = world;
+	query.type = type;
+	if (ClipPlaneQuery(&query, x, y, width, height))
+		RunPlaneQuery(&query);
+	return query.total;
+}
+
+uint64_t CountAdjacentTiles(const World *world, TileId type, TileId neighbour, int x, int y, int width, int height)
+{
+	PlaneQuery query = {0};
+	query.world = world;
+	query.type = type;
+	query.neighbour = neighbour;
+	query.adjacent = true;
+	if (ClipPlaneQuery(&query, x, y, width, height))
+		RunPlaneQuery(&query);
+	return query.total;
+}
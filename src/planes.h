@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tiles.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Region statistics on the per type bit planes of the chunks (Chunk.planes). A row of a
+// chunk is one word per type, so counting is a popcount and neighbourhood tests are
+// shifts and ANDs over whole rows instead of a compare per tile byte.
+
+// Bit mask over a rectangle of tiles. Bit (x - mask->x) of row (y - mask->y) stands for
+// tile (x, y), each row starts on a new word
+typedef struct TileMask
+{
+	int x;
+	int y;
+	int width;
+	int height;
+	int stride; // Words per row
+	uint64_t *bits;
+} TileMask;
+
+struct World;
+
+// Returns false when out of memory, the mask is left empty then. All bits start clear
+bool InitTileMask(TileMask *mask, int x, int y, int width, int height);
+void UnloadTileMask(TileMask *mask);
+
+// Both fill the whole mask, tiles outside the world are left clear
+//----------------------------------------------------------------------------------
+// Tiles of type
+void SelectTilesOfType(const struct World *world, TileId type, TileMask *mask);
+// Tiles of type with a tile of neighbour type directly north, east, south or west
+void SelectAdjacentTiles(const struct World *world, TileId type, TileId neighbour, TileMask *mask);
+//----------------------------------------------------------------------------------
+
+// Return false and leave mask untouched unless other covers the same rectangle
+bool IntersectTileMasks(TileMask *mask, const TileMask *other);
+bool UniteTileMasks(TileMask *mask, const TileMask *other);
+uint64_t CountTileMask(const TileMask *mask);
+
+// Same results as selecting a mask and counting it, without the mask. Both walk every
+// chunk under the rectangle; whole chunks of one type come from Chunk.typeCounts, the
+// rest is popcounted row by row
+//----------------------------------------------------------------------------------
+uint64_t CountTilesOfType(const struct World *world, TileId type, int x, int y, int width, int height);
+uint64_t CountAdjacentTiles(const struct World *world, TileId type, TileId neighbour, int x, int y, int width, int height);
+//----------------------------------------------------------------------------------
+
+// Set bits in size bytes, vectorised with AVX2, SSE2 or NEON when the compiler targets them
+uint64_t PopCountBytes(const void *data, size_t size);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,267 @@
+#include "snapshot.h"
+
+#include <stdlib.h>
+
+#include "world.h"
+
+static void RetainAllRecords(const ChunkMap *records)
+{
+	for (uint32_t i = 0; i < records->capacity; i++)
+	{
+		if (records->slots[i].value != NULL)
+			((StreamedChunk *)records->slots[i].value)->refCount++;
+	}
+}
+
+static void ReleaseAllRecords(ChunkMap *records)
+{
+	for (uint32_t i = 0; i < records->capacity; i++)
+	{
+		if (records->slots[i].value != NULL)
+			ReleaseStreamedChunk((StreamedChunk *)records->slots[i].value);
+	}
+	ChunkMapFree(records);
+}
+
+// Tile events and dirty regions for a restore
+//----------------------------------------------------------------------------------
+// Where a chunk lives in a world or snapshot, both NULL when it is all blank
+typedef struct ChunkVersion
+{
+	const Chunk *chunk;
+	const StreamedChunk *record;
+} ChunkVersion;
+
+static ChunkVersion FindChunkVersion(const ChunkDirectory *chunks, const ChunkMap *evicted, uint64_t key)
+{
+	ChunkVersion version;
+	version.chunk = (const Chunk *)GetDirectoryEntry(chunks, key);
+	version.record = version.chunk == NULL && evicted != NULL ? (const StreamedChunk *)ChunkMapGet(evicted, key) : NULL;
+	return version;
+}
+
+// Shared chunks and records never change, so the same one on both sides means no difference
+static bool SameChunkVersion(ChunkVersion a, ChunkVersion b)
+{
+	if (a.chunk != NULL && b.chunk != NULL)
+		return a.chunk == b.chunk;
+	if (a.record != NULL && b.record != NULL)
+		return a.record == b.record;
+	if (a.chunk != NULL && b.record != NULL)
+		return a.chunk->source == b.record;
+	if (b.chunk != NULL && a.record != NULL)
+		return b.chunk->source == a.record;
+	return a.chunk == NULL && a.record == NULL && b.chunk == NULL && b.record == NULL;
+}
+
+static const Chunk *ReadChunkVersion(const World *world, ChunkVersion version, Chunk *scratch)
+{
+	if (version.record != NULL)
+		return ReadStreamedChunk(world, version.record, scratch) ? scratch : NULL;
+	return version.chunk;
+}
+
+static void PublishChunkDifferences(World *world, uint64_t key, ChunkVersion before, ChunkVersion after)
+{
+	if (SameChunkVersion(before, after))
+		return;
+
+	Chunk beforeScratch;
+	Chunk afterScratch;
+	const Chunk *from = ReadChunkVersion(world, before, &beforeScratch);
+	const Chunk *to = ReadChunkVersion(world, after, &afterScratch);
+	const int chunkX = ChunkKeyX(key) << CHUNK_SHIFT;
+	const int chunkY = ChunkKeyY(key) << CHUNK_SHIFT;
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if ((from == NULL || from->layers[layer] == NULL) && (to == NULL || to->layers[layer] == NULL))
+			continue;
+		for (int index = 0; index < CHUNK_AREA; index++)
+		{
+			const TileId prev = from ? GetChunkTile(from, layer, index) : BLANK_SPACE;
+			const TileId next = to ? GetChunkTile(to, layer, index) : BLANK_SPACE;
+			if (prev != next)
+				PublishTileChange(&world->events, chunkX + (index & CHUNK_MASK), chunkY + (index >> CHUNK_SHIFT), prev, next);
+		}
+	}
+
+	if (from == &beforeScratch)
+		UnloadStreamedChunkCopy(&beforeScratch);
+	if (to == &afterScratch)
+		UnloadStreamedChunkCopy(&afterScratch);
+}
+
+typedef void (*ChunkDifferenceCallback)(World *world, uint64_t key, ChunkVersion before, ChunkVersion after);
+
+// Keys the world has were visited already
+static void VisitSnapshotOnlyKey(World *world, const WorldSnapshot *snapshot, uint64_t key, ChunkDifferenceCallback visit)
+{
+	const ChunkMap *worldEvicted = world->stream != NULL ? &world->stream->evicted : NULL;
+	const ChunkVersion before = FindChunkVersion(&world->chunks, worldEvicted, key);
+	if (before.chunk == NULL && before.record == NULL)
+		visit(world, key, before, FindChunkVersion(&snapshot->chunks, &snapshot->evicted, key));
+}
+
+// Calls visit once for every key either side has, resident or evicted, with the world's
+// version first. Only chunks that are not shared between the two differ
+static void ForEachRestoredChunk(World *world, const WorldSnapshot *snapshot, ChunkDifferenceCallback visit)
+{
+	const ChunkMap *worldEvicted = world->stream != NULL ? &world->stream->evicted : NULL;
+	DirectoryIterator iterator = {0};
+	uint64_t key;
+	void *entry;
+	while (NextDirectoryEntry(&world->chunks, &iterator, &key, &entry))
+		visit(world, key, FindChunkVersion(&world->chunks, worldEvicted, key), FindChunkVersion(&snapshot->chunks, &snapshot->evicted, key));
+	for (uint32_t i = 0; worldEvicted != NULL && i < worldEvicted->capacity; i++)
+	{
+		if (worldEvicted->slots[i].value == NULL)
+			continue;
+		key = worldEvicted->slots[i].key;
+		visit(world, key, FindChunkVersion(&world->chunks, worldEvicted, key), FindChunkVersion(&snapshot->chunks, &snapshot->evicted, key));
+	}
+
+	iterator = (DirectoryIterator){0};
+	while (NextDirectoryEntry(&snapshot->chunks, &iterator, &key, &entry))
+		VisitSnapshotOnlyKey(world, snapshot, key, visit);
+	for (uint32_t i = 0; i < snapshot->evicted.capacity; i++)
+	{
+		if (snapshot->evicted.slots[i].value != NULL)
+			VisitSnapshotOnlyKey(world, snapshot, snapshot->evicted.slots[i].key, visit);
+	}
+}
+
+// Only the layers either side has can look different. An evicted side is not read, so all
+// of its layers count
+static void MarkChunkDifferencesDirty(World *world, uint64_t key, ChunkVersion before, ChunkVersion after)
+{
+	if (SameChunkVersion(before, after))
+		return;
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		const bool beforeHas = before.record != NULL || (before.chunk != NULL && before.chunk->layers[layer] != NULL);
+		const bool afterHas = after.record != NULL || (after.chunk != NULL && after.chunk->layers[layer] != NULL);
+		if (beforeHas || afterHas)
+			MarkChunkDirty(&world->dirty[layer], ChunkKeyX(key), ChunkKeyY(key));
+	}
+}
+//----------------------------------------------------------------------------------
+
+WorldSnapshot *TakeWorldSnapshot(World *world)
+{
+	WorldSnapshot *snapshot = (WorldSnapshot *)calloc(1, sizeof(WorldSnapshot));
+	if (snapshot == NULL)
+		return NULL;
+
+	snapshot->width = world->width;
+	snapshot->height = world->height;
+	const bool shared = ShareChunkDirectory(&snapshot->chunks, &world->chunks);
+	if (world->stream != NULL)
+		ChunkMapCopy(&snapshot->evicted, &world->stream->evicted);
+	if (!shared || (world->stream != NULL && snapshot->evicted.count != world->stream->evicted.count))
+	{
+		FreeChunkDirectory(&snapshot->chunks);
+		ChunkMapFree(&snapshot->evicted);
+		free(snapshot);
+		return NULL;
+	}
+	RetainAllRecords(&snapshot->evicted);
+	return snapshot;
+}
+
+void UnloadWorldSnapshot(WorldSnapshot *snapshot)
+{
+	if (snapshot == NULL)
+		return;
+
+	FreeChunkDirectory(&snapshot->chunks);
+	ReleaseAllRecords(&snapshot->evicted);
+	free(snapshot);
+}
+
+TileId GetSnapshotTile(const WorldSnapshot *snapshot, int x, int y)
+{
+	const Chunk *chunk = (const Chunk *)GetDirectoryEntry(&snapshot->chunks, ChunkKey(x >> CHUNK_SHIFT, y >> CHUNK_SHIFT));
+	return chunk ? GetChunkTopTile(chunk, ChunkTileIndex(x, y)) : BLANK_SPACE;
+}
+
+// Sums the snapshot's resident and evicted chunks into a fresh pyramid for the world's size
+static bool BuildRestoredSummary(const World *world, const WorldSnapshot *snapshot, WorldSummary *summary)
+{
+	InitWorldSummary(summary, (world->width + CHUNK_MASK) >> CHUNK_SHIFT, (world->height + CHUNK_MASK) >> CHUNK_SHIFT);
+	DirectoryIterator iterator = {0};
+	uint64_t key;
+	void *entry;
+	while (NextDirectoryEntry(&snapshot->chunks, &iterator, &key, &entry))
+	{
+		if (!AddChunkToWorldSummary(summary, ChunkKeyX(key), ChunkKeyY(key), ((const Chunk *)entry)->typeCounts))
+		{
+			UnloadWorldSummary(summary);
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < snapshot->evicted.capacity; i++)
+	{
+		const StreamedChunk *record = (const StreamedChunk *)snapshot->evicted.slots[i].value;
+		if (record == NULL)
+			continue;
+		int typeCounts[TILE_TYPE_COUNT];
+		for (int type = 0; type < TILE_TYPE_COUNT; type++)
+			typeCounts[type] = record->typeCounts[type];
+		if (!AddChunkToWorldSummary(summary, ChunkKeyX(snapshot->evicted.slots[i].key), ChunkKeyY(snapshot->evicted.slots[i].key), typeCounts))
+		{
+			UnloadWorldSummary(summary);
+			return false;
+		}
+	}
+	return true;
+}
+
+void RestoreWorldSnapshot(World *world, const WorldSnapshot *snapshot)
+{
+	if (snapshot->width != world->width || snapshot->height != world->height)
+		return;
+	if (snapshot->evicted.count != 0 && world->stream == NULL)
+		return;
+	ChunkDirectory restored = {0};
+	if (!ShareChunkDirectory(&restored, &snapshot->chunks))
+		return;
+	// The pyramid is rebuilt from the per chunk counts, which travel with the chunks. Built
+	// first so running out of memory leaves the world as it was
+	WorldSummary summary;
+	if (!BuildRestoredSummary(world, snapshot, &summary))
+	{
+		FreeChunkDirectory(&restored);
+		return;
+	}
+
+	if (world->events.subscriberCount != 0)
+		ForEachRestoredChunk(world, snapshot, PublishChunkDifferences);
+	// Whatever was painted before or after can look different now, evicted chunks included
+	ForEachRestoredChunk(world, snapshot, MarkChunkDifferencesDirty);
+
+	FreeChunkDirectory(&world->chunks);
+	world->chunks = restored;
+	if (world->stream != NULL)
+	{
+		ReleaseAllRecords(&world->stream->evicted);
+		ChunkMapCopy(&world->stream->evicted, &snapshot->evicted);
+		RetainAllRecords(&world->stream->evicted);
+		// The stamps belonged to the chunks that were just dropped. The restored ones count
+		// as used now, so they are not evicted or compacted as if idle since the start
+		ChunkMapFree(&world->stream->lastUsed);
+		DirectoryIterator iterator = {0};
+		uint64_t key;
+		void *entry;
+		// Out of memory only means the rest look idle and go first
+		while (NextDirectoryEntry(&world->chunks, &iterator, &key, &entry))
+		{
+			if (!ChunkMapPut(&world->stream->lastUsed, key, (void *)(uintptr_t)world->stream->frame))
+				break;
+		}
+	}
+
+	UnloadWorldSummary(&world->summary);
+	world->summary = summary;
+
+	ClearUndoJournal(&world->undo);
+}
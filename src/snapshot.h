@@ -0,0 +1,41 @@
+#pragma once
+
+#include "chunk_directory.h"
+#include "chunk_map.h"
+#include "tiles.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Read only view of the world at the time it was taken. The snapshot shares the world's
+// chunk directory page by page, so taking one only copies the small table of pages and
+// bumps one reference count per page. A later write to the world copies the page and the
+// single chunk it touches before changing them, which keeps the snapshot unchanged for as
+// long as it lives.
+typedef struct WorldSnapshot
+{
+	int width;
+	int height;
+	ChunkDirectory chunks; // Pages are shared with the world until either side writes to them
+	// Chunks a streaming world had evicted, ChunkKey -> StreamedChunk holding one reference.
+	// Their tiles stay in the backing file, GetSnapshotTile reads them as blank
+	ChunkMap evicted;
+} WorldSnapshot;
+
+struct World;
+
+// O(directory pages), plus O(evicted chunks) for a streaming world. No tile data is copied
+WorldSnapshot *TakeWorldSnapshot(struct World *world);
+void UnloadWorldSnapshot(WorldSnapshot *snapshot);
+// Topmost tile, as GetTile
+TileId GetSnapshotTile(const WorldSnapshot *snapshot, int x, int y);
+// Puts the world back to the snapshot, which stays valid and can be restored again.
+// The undo history is cleared since it describes edits to a world that no longer exists.
+// Does nothing if the snapshot holds evicted chunks and the world stopped streaming
+void RestoreWorldSnapshot(struct World *world, const WorldSnapshot *snapshot);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,896 @@
+// fseeko is hidden by strict C99 unless POSIX is requested
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <sys/types.h>
+#endif
+
+#include "compress.h"
+#include "world.h"
+
+// A record is a u16 of flags, then every layer as EncodeTileLayer packs it, the rail masks and
+// every attribute plane the chunk has, in that order. Bit 0 of the flags is set with rail
+// masks, bit 1 + i with attribute plane i and bit RECORD_LAYER_SHIFT + layer with that layer
+#define RECORD_FLAGS_SIZE 2
+#define RECORD_HAS_RAIL_MASKS 1
+#define RECORD_LAYER_SHIFT (1 + MAX_TILE_ATTRIBUTES)
+
+// Most idle chunks compacted per pass, the rest wait for the next second
+#define MAX_COMPACTIONS_PER_PASS 4096
+
+typedef enum StreamJobType
+{
+	STREAM_JOB_WRITE,
+	STREAM_JOB_COMPRESS,
+	STREAM_JOB_LOAD,
+} StreamJobType;
+
+typedef struct StreamJob
+{
+	StreamJobType type;
+	uint64_t key;
+	StreamedChunk *record; // Referenced until the render thread picks the job up again
+	uint8_t *data;         // What a load read
+	bool failed;
+	bool decompressed;     // The load came from a compacted record, taking decompressSeconds
+	double decompressSeconds;
+	struct StreamJob *next;
+} StreamJob;
+
+typedef struct EvictionCandidate
+{
+	uint64_t key;
+	uint32_t lastUsed;
+} EvictionCandidate;
+
+void ReleaseStreamedChunk(StreamedChunk *record)
+{
+	if (--record->refCount > 0)
+		return;
+	free(record->pending);
+	free(record->compressed);
+	free(record);
+}
+
+// File access
+//----------------------------------------------------------------------------------
+static bool SeekFile(FILE *file, uint64_t offset)
+{
+#if defined(_WIN32)
+	return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static bool ReadFileAt(ChunkStream *stream, uint64_t offset, uint8_t *data, uint32_t size)
+{
+	LockWorkerMutex(stream->fileMutex);
+	const bool read = SeekFile(stream->file, offset) && fread(data, 1, size, stream->file) == size;
+	UnlockWorkerMutex(stream->fileMutex);
+	return read;
+}
+
+static bool WriteFileAt(ChunkStream *stream, uint64_t offset, const uint8_t *data, uint32_t size)
+{
+	LockWorkerMutex(stream->fileMutex);
+	const bool written = SeekFile(stream->file, offset) && fwrite(data, 1, size, stream->file) == size;
+	UnlockWorkerMutex(stream->fileMutex);
+	return written;
+}
+
+static bool DecompressRecord(const StreamedChunk *record, uint8_t *data, double *seconds)
+{
+	const double start = GetMonotonicTime();
+	const bool decompressed = DecompressBytes(record->compressed, record->compressedSize, data, record->size);
+	*seconds = GetMonotonicTime() - start;
+	return decompressed;
+}
+
+// Copies a compacted record out of the hot cache, decompressing and caching it on a miss
+static bool ReadCompactedRecord(ChunkStream *stream, const StreamedChunk *record, uint8_t *data)
+{
+	stream->hotClock++;
+	HotChunk *oldest = &stream->hotChunks[0];
+	for (int i = 0; i < HOT_CHUNK_COUNT; i++)
+	{
+		HotChunk *hot = &stream->hotChunks[i];
+		if (hot->record == record)
+		{
+			memcpy(data, hot->data, record->size);
+			hot->lastUsed = stream->hotClock;
+			stream->hotHits++;
+			return true;
+		}
+		if (hot->record == NULL || (oldest->record != NULL && hot->lastUsed < oldest->lastUsed))
+			oldest = hot;
+	}
+
+	stream->hotMisses++;
+	double seconds;
+	const bool decompressed = DecompressRecord(record, data, &seconds);
+	stream->decompressions++;
+	stream->decompressSeconds += seconds;
+	if (!decompressed)
+		return false;
+
+	uint8_t *copy = (uint8_t *)malloc(record->size);
+	if (copy == NULL)
+		return true;
+	memcpy(copy, data, record->size);
+	if (oldest->record != NULL)
+		ReleaseStreamedChunk(oldest->record);
+	free(oldest->data);
+	oldest->record = (StreamedChunk *)record;
+	oldest->record->refCount++;
+	oldest->data = copy;
+	oldest->lastUsed = stream->hotClock;
+	return true;
+}
+
+static void FreeHotChunks(ChunkStream *stream)
+{
+	for (int i = 0; i < HOT_CHUNK_COUNT; i++)
+	{
+		HotChunk *hot = &stream->hotChunks[i];
+		if (hot->record != NULL)
+			ReleaseStreamedChunk(hot->record);
+		free(hot->data);
+		*hot = (HotChunk){0};
+	}
+}
+
+// Returns a copy of the record's bytes, from memory while its write is still queued or when
+// it was compacted. Render thread only, the hot cache is not guarded
+static uint8_t *ReadRecord(ChunkStream *stream, const StreamedChunk *record)
+{
+	uint8_t *data = (uint8_t *)malloc(record->size);
+	if (data == NULL)
+		return NULL;
+
+	LockWorkerMutex(stream->queueMutex);
+	const bool pending = record->pending != NULL;
+	if (pending)
+		memcpy(data, record->pending, record->size);
+	const bool compacted = record->compressed != NULL;
+	UnlockWorkerMutex(stream->queueMutex);
+
+	bool read = pending;
+	if (!read && compacted)
+		read = ReadCompactedRecord(stream, record, data);
+	else if (!read)
+		read = ReadFileAt(stream, record->offset, data, record->size);
+	if (!read)
+	{
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+//----------------------------------------------------------------------------------
+
+// Loader thread
+//----------------------------------------------------------------------------------
+static void QueueStreamJob(ChunkStream *stream, StreamJob *job)
+{
+	job->record->refCount++;
+	job->next = NULL;
+
+	LockWorkerMutex(stream->queueMutex);
+	if (stream->queuedTail != NULL)
+		stream->queuedTail->next = job;
+	else
+		stream->queued = job;
+	stream->queuedTail = job;
+	SignalWorkerCondition(stream->queueSignal);
+	UnlockWorkerMutex(stream->queueMutex);
+}
+
+static void RunStreamLoader(void *userData)
+{
+	ChunkStream *stream = (ChunkStream *)userData;
+
+	LockWorkerMutex(stream->queueMutex);
+	for (;;)
+	{
+		while (stream->queued == NULL && !stream->stopping)
+			WaitWorkerCondition(stream->queueSignal, stream->queueMutex);
+		if (stream->stopping)
+			break;
+
+		StreamJob *job = stream->queued;
+		stream->queued = job->next;
+		if (stream->queued == NULL)
+			stream->queuedTail = NULL;
+		StreamedChunk *record = job->record;
+		const uint8_t *pending = record->pending;
+		UnlockWorkerMutex(stream->queueMutex);
+
+		size_t compressedSize = 0;
+		if (job->type == STREAM_JOB_WRITE)
+		{
+			job->failed = !WriteFileAt(stream, record->offset, pending, record->size);
+		}
+		else if (job->type == STREAM_JOB_COMPRESS)
+		{
+			// Only kept when it saves something, otherwise the plain bytes stay
+			const size_t capacity = record->size - record->size / 8;
+			job->data = (uint8_t *)malloc(capacity);
+			if (job->data != NULL)
+				compressedSize = CompressBytes(pending, record->size, job->data, capacity);
+			job->failed = compressedSize == 0;
+		}
+		else
+		{
+			// Only the loader sets compressed, so reading it here needs no lock
+			job->data = (uint8_t *)malloc(record->size);
+			job->decompressed = record->compressed != NULL;
+			if (job->data == NULL)
+				job->failed = true;
+			else if (job->decompressed)
+				job->failed = !DecompressRecord(record, job->data, &job->decompressSeconds);
+			else if (pending != NULL)
+				memcpy(job->data, pending, record->size);
+			else
+				job->failed = !ReadFileAt(stream, record->offset, job->data, record->size);
+		}
+
+		LockWorkerMutex(stream->queueMutex);
+		// A failed write or compression keeps its bytes in memory so the chunk is never lost
+		if (job->type != STREAM_JOB_LOAD && !job->failed)
+		{
+			free(record->pending);
+			record->pending = NULL;
+		}
+		if (job->type == STREAM_JOB_COMPRESS && !job->failed)
+		{
+			uint8_t *shrunk = (uint8_t *)realloc(job->data, compressedSize);
+			record->compressed = shrunk != NULL ? shrunk : job->data;
+			record->compressedSize = (uint32_t)compressedSize;
+			job->data = NULL;
+		}
+		job->next = stream->finished;
+		stream->finished = job;
+	}
+	UnlockWorkerMutex(stream->queueMutex);
+}
+
+static void FreeStreamJobs(StreamJob *job)
+{
+	while (job != NULL)
+	{
+		StreamJob *next = job->next;
+		ReleaseStreamedChunk(job->record);
+		free(job->data);
+		free(job);
+		job = next;
+	}
+}
+
+static void StopStreamLoader(ChunkStream *stream)
+{
+	if (stream->loader == NULL)
+		return;
+
+	LockWorkerMutex(stream->queueMutex);
+	stream->stopping = true;
+	BroadcastWorkerCondition(stream->queueSignal);
+	UnlockWorkerMutex(stream->queueMutex);
+	JoinWorkerThread(stream->loader);
+	stream->loader = NULL;
+}
+//----------------------------------------------------------------------------------
+
+// Chunk encoding
+//----------------------------------------------------------------------------------
+static uint32_t EncodedChunkSize(const World *world, const Chunk *chunk)
+{
+	uint32_t size = RECORD_FLAGS_SIZE;
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if (chunk->layers[layer] != NULL)
+			size += GetEncodedTileLayerSize(chunk->layers[layer]);
+	}
+	if (chunk->railMasks != NULL)
+		size += CHUNK_AREA;
+	for (int i = 0; i < MAX_TILE_ATTRIBUTES; i++)
+	{
+		if (chunk->attributes[i] != NULL)
+			size += CHUNK_AREA * world->attributes[i].size;
+	}
+	return size;
+}
+
+static void EncodeChunk(const World *world, const Chunk *chunk, uint8_t *data)
+{
+	uint8_t *write = data + RECORD_FLAGS_SIZE;
+	unsigned int flags = 0;
+
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if (chunk->layers[layer] == NULL)
+			continue;
+		flags |= 1u << (RECORD_LAYER_SHIFT + layer);
+		write = EncodeTileLayer(chunk->layers[layer], write);
+	}
+	if (chunk->railMasks != NULL)
+	{
+		flags |= RECORD_HAS_RAIL_MASKS;
+		memcpy(write, chunk->railMasks, CHUNK_AREA);
+		write += CHUNK_AREA;
+	}
+	for (int i = 0; i < MAX_TILE_ATTRIBUTES; i++)
+	{
+		if (chunk->attributes[i] == NULL)
+			continue;
+		flags |= 2u << i;
+		memcpy(write, chunk->attributes[i], (size_t)CHUNK_AREA * world->attributes[i].size);
+		write += CHUNK_AREA * world->attributes[i].size;
+	}
+
+	data[0] = (uint8_t)flags;
+	data[1] = (uint8_t)(flags >> 8);
+}
+
+static unsigned int RecordFlags(const uint8_t *data)
+{
+	return data[0] | (data[1] << 8);
+}
+
+// Fills the layer planes of a chunk that has none yet. Occupancy, bit planes and counts are
+// not stored, they follow from the tiles. Returns false when out of memory or a layer does not
+// decode, whatever was allocated is left in the chunk for its owner to free
+static bool DecodeTiles(Chunk *chunk, const uint8_t *data)
+{
+	const unsigned int flags = RecordFlags(data);
+	const uint8_t *read = data + RECORD_FLAGS_SIZE;
+	memset(chunk->occupancy, 0, sizeof(chunk->occupancy));
+	memset(chunk->planes, 0, sizeof(chunk->planes));
+	memset(chunk->typeCounts, 0, sizeof(chunk->typeCounts));
+	chunk->nonEmpty = 0;
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if (!(flags & (1u << (RECORD_LAYER_SHIFT + layer))))
+			continue;
+		chunk->layers[layer] = DecodeTileLayer(read);
+		if (chunk->layers[layer] == NULL)
+			return false;
+		read += MeasureEncodedTileLayer(read);
+
+		TileId tiles[CHUNK_AREA];
+		UnpackTileLayer(chunk->layers[layer], tiles);
+		for (int index = 0; index < CHUNK_AREA; index++)
+		{
+			const TileId tile = tiles[index];
+			if (tile == BLANK_SPACE)
+				continue;
+			chunk->typeCounts[tile]++;
+			chunk->occupancy[index >> CHUNK_SHIFT] |= 1u << (index & CHUNK_MASK);
+			chunk->planes[tile - 1][index >> CHUNK_SHIFT] |= 1u << (index & CHUNK_MASK);
+		}
+	}
+	for (int row = 0; row < CHUNK_SIZE; row++)
+		chunk->nonEmpty += PopCount32(chunk->occupancy[row]);
+	chunk->typeCounts[BLANK_SPACE] = CHUNK_AREA - chunk->nonEmpty;
+	return true;
+}
+
+// Copies rail masks and attribute planes out of a record, all or nothing
+static bool DecodePlanes(const World *world, const uint8_t *data, uint8_t **railMasks, void *attributes[MAX_TILE_ATTRIBUTES])
+{
+	const unsigned int flags = RecordFlags(data);
+	const uint8_t *read = data + RECORD_FLAGS_SIZE;
+	bool decoded = true;
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if (flags & (1u << (RECORD_LAYER_SHIFT + layer)))
+			read += MeasureEncodedTileLayer(read);
+	}
+
+	*railMasks = NULL;
+	if (flags & RECORD_HAS_RAIL_MASKS)
+	{
+		*railMasks = (uint8_t *)malloc(CHUNK_AREA);
+		if (*railMasks != NULL)
+			memcpy(*railMasks, read, CHUNK_AREA);
+		decoded = *railMasks != NULL;
+		read += CHUNK_AREA;
+	}
+	for (int i = 0; i < MAX_TILE_ATTRIBUTES; i++)
+	{
+		attributes[i] = NULL;
+		if (!(flags & (2u << i)))
+			continue;
+		const size_t size = (size_t)CHUNK_AREA * world->attributes[i].size;
+		attributes[i] = malloc(size);
+		if (attributes[i] != NULL)
+			memcpy(attributes[i], read, size);
+		decoded = decoded && attributes[i] != NULL;
+		read += size;
+	}
+
+	if (!decoded)
+	{
+		free(*railMasks);
+		for (int i = 0; i < MAX_TILE_ATTRIBUTES; i++)
+			free(attributes[i]);
+	}
+	return decoded;
+}
+//----------------------------------------------------------------------------------
+
+// Puts an evicted chunk back into the world. The reference the evicted directory held
+// moves to chunk->source when the chunk comes back unmodified, so evicting it again
+// skips the write
+static Chunk *InstallChunk(World *world, uint64_t key, StreamedChunk *record, const uint8_t *data, bool keepSource)
+{
+	ChunkStream *stream = world->stream;
+	uint8_t *railMasks;
+	void *attributes[MAX_TILE_ATTRIBUTES];
+	if (!DecodePlanes(world, data, &railMasks, attributes))
+		return NULL;
+
+	Chunk *chunk = CreateChunk();
+	if (chunk == NULL || !DecodeTiles(chunk, data))
+	{
+		if (chunk != NULL)
+			ReleaseChunk(chunk);
+		free(railMasks);
+		for (int i = 0; i < MAX_TILE_ATTRIBUTES; i++)
+			free(attributes[i]);
+		return NULL;
+	}
+
+	// The summary pyramid never stopped counting the chunk, so only the chunk itself is filled in
+	chunk->railMasks = railMasks;
+	memcpy(chunk->attributes, attributes, sizeof(chunk->attributes));
+	// Stamped first, a chunk without a stamp would look idle since the start and go right back
+	if (!ChunkMapPut(&stream->lastUsed, key, (void *)(uintptr_t)stream->frame))
+	{
+		ReleaseChunk(chunk);
+		return NULL;
+	}
+	if (!PutDirectoryEntry(&world->chunks, key, chunk))
+	{
+		ChunkMapRemove(&stream->lastUsed, key);
+		ReleaseChunk(chunk);
+		return NULL;
+	}
+	ChunkMapRemove(&stream->evicted, key);
+	if (keepSource)
+		chunk->source = record;
+	else
+		ReleaseStreamedChunk(record);
+
+	// Every layer was drawn as a stand in until now
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		MarkChunkDirty(&world->dirty[layer], ChunkKeyX(key), ChunkKeyY(key));
+	stream->loads++;
+	return chunk;
+}
+
+// type is STREAM_JOB_WRITE to evict the chunk to the file or STREAM_JOB_COMPRESS to compact it
+static bool EvictChunk(World *world, uint64_t key, Chunk *chunk, StreamJobType type)
+{
+	ChunkStream *stream = world->stream;
+	StreamedChunk *record = chunk->source;
+	bool compacted = type == STREAM_JOB_COMPRESS;
+	StreamJob *job = NULL;
+	if (record != NULL)
+	{
+		// Unchanged since it was loaded, the file or the compressed copy already has it. A
+		// file record stays a file record, compacting it would only hide a blocking read
+		record->refCount++;
+		LockWorkerMutex(stream->queueMutex);
+		compacted = compacted && record->compressed != NULL;
+		UnlockWorkerMutex(stream->queueMutex);
+	}
+	else
+	{
+		const uint32_t size = EncodedChunkSize(world, chunk);
+		record = (StreamedChunk *)calloc(1, sizeof(StreamedChunk));
+		job = (StreamJob *)calloc(1, sizeof(StreamJob));
+		uint8_t *data = (uint8_t *)malloc(size);
+		if (record == NULL || job == NULL || data == NULL)
+		{
+			free(record);
+			free(job);
+			free(data);
+			return false;
+		}
+
+		EncodeChunk(world, chunk, data);
+		record->size = size;
+		record->refCount = 1;
+		record->pending = data;
+		for (int tile = 0; tile < TILE_TYPE_COUNT; tile++)
+			record->typeCounts[tile] = (uint16_t)chunk->typeCounts[tile];
+		job->type = type;
+		job->key = key;
+		job->record = record;
+	}
+
+	record->compacted = compacted;
+	if (!ChunkMapPut(&stream->evicted, key, record))
+	{
+		// Nothing was queued or removed yet, the chunk just stays resident
+		ReleaseStreamedChunk(record);
+		free(job);
+		return false;
+	}
+	if (job != NULL)
+	{
+		if (type == STREAM_JOB_WRITE)
+		{
+			record->offset = stream->fileEnd;
+			stream->fileEnd += record->size;
+		}
+		QueueStreamJob(stream, job);
+	}
+	ChunkMapRemove(&stream->lastUsed, key);
+	RemoveDirectoryEntry(&world->chunks, key);
+	ReleaseChunk(chunk);
+	if (compacted)
+		stream->compactions++;
+	else
+		stream->evictions++;
+	return true;
+}
+
+static int CompareCandidates(const void *a, const void *b)
+{
+	const uint32_t lastUsedA = ((const EvictionCandidate *)a)->lastUsed;
+	const uint32_t lastUsedB = ((const EvictionCandidate *)b)->lastUsed;
+	return (lastUsedA > lastUsedB) - (lastUsedA < lastUsedB);
+}
+
+static void EvictChunks(World *world)
+{
+	ChunkStream *stream = world->stream;
+	// Charged as one layer per chunk, which is what most of them paint
+	const uint32_t limit = (uint32_t)(stream->budget / (sizeof(Chunk) + CHUNK_AREA * sizeof(TileId)));
+	if (world->chunks.count <= limit)
+		return;
+	// Going an eighth below the budget keeps this from running again on the next stroke
+	const uint32_t target = limit - limit / 8;
+
+	EvictionCandidate *candidates = (EvictionCandidate *)malloc(world->chunks.count * sizeof(EvictionCandidate));
+	if (candidates == NULL)
+		return;
+
+	uint32_t count = 0;
+	DirectoryIterator iterator = {0};
+	uint64_t key;
+	void *entry;
+	while (NextDirectoryEntry(&world->chunks, &iterator, &key, &entry))
+	{
+		const Chunk *chunk = (const Chunk *)entry;
+		// Chunks a snapshot shares would stay in memory anyway. Interned ones are shared by the
+		// table, evicting them drops this position's reference
+		if (IsDirectoryPageShared(&world->chunks, key) || (chunk->refCount != 1 && !chunk->interned))
+			continue;
+		const uint32_t lastUsed = (uint32_t)(uintptr_t)ChunkMapGet(&stream->lastUsed, key);
+		if (lastUsed != stream->frame)
+			candidates[count++] = (EvictionCandidate){key, lastUsed};
+	}
+
+	qsort(candidates, count, sizeof(EvictionCandidate), CompareCandidates);
+	for (uint32_t i = 0; i < count && world->chunks.count > target; i++)
+	{
+		Chunk *chunk = (Chunk *)GetDirectoryEntry(&world->chunks, candidates[i].key);
+		if (!EvictChunk(world, candidates[i].key, chunk, STREAM_JOB_WRITE))
+			break;
+	}
+	free(candidates);
+}
+
+static void CompactIdleChunks(World *world)
+{
+	ChunkStream *stream = world->stream;
+	const uint32_t idleSeconds = (uint32_t)stream->compactSeconds;
+	if (idleSeconds == 0 || stream->seconds <= idleSeconds)
+		return;
+	// Chunks last kept before the frame that was current idleSeconds ago have been idle since
+	const uint32_t idleBefore = stream->secondFrames[(stream->seconds - 1 - idleSeconds) % (MAX_COMPACT_SECONDS + 1)];
+
+	// Collected first, evicting removes from the map being walked
+	uint64_t *keys = (uint64_t *)malloc(MAX_COMPACTIONS_PER_PASS * sizeof(uint64_t));
+	if (keys == NULL)
+		return;
+	uint32_t count = 0;
+	DirectoryIterator iterator = {0};
+	uint64_t key;
+	void *entry;
+	while (count < MAX_COMPACTIONS_PER_PASS && NextDirectoryEntry(&world->chunks, &iterator, &key, &entry))
+	{
+		const Chunk *chunk = (const Chunk *)entry;
+		// Same rule as eviction, a chunk a snapshot shares would stay unpacked anyway
+		if (IsDirectoryPageShared(&world->chunks, key) || (chunk->refCount != 1 && !chunk->interned))
+			continue;
+		if ((uint32_t)(uintptr_t)ChunkMapGet(&stream->lastUsed, key) < idleBefore)
+			keys[count++] = key;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Chunk *chunk = (Chunk *)GetDirectoryEntry(&world->chunks, keys[i]);
+		if (!EvictChunk(world, keys[i], chunk, STREAM_JOB_COMPRESS))
+			break;
+	}
+	free(keys);
+}
+
+bool EnableWorldStreaming(World *world, const char *path, size_t budget)
+{
+	if (world->stream != NULL)
+		return false;
+
+	ChunkStream *stream = (ChunkStream *)calloc(1, sizeof(ChunkStream));
+	if (stream == NULL)
+		return false;
+	stream->file = path != NULL ? fopen(path, "w+b") : tmpfile();
+	stream->budget = budget != 0 ? budget : DEFAULT_STREAM_BUDGET;
+	stream->frame = 1;
+	stream->queueMutex = CreateWorkerMutex();
+	stream->queueSignal = CreateWorkerCondition();
+	stream->fileMutex = CreateWorkerMutex();
+	if (stream->file == NULL || stream->queueMutex == NULL || stream->queueSignal == NULL || stream->fileMutex == NULL)
+	{
+		UnloadChunkStream(stream);
+		return false;
+	}
+
+	stream->loader = StartWorkerThread(RunStreamLoader, stream);
+	if (stream->loader == NULL)
+	{
+		UnloadChunkStream(stream);
+		return false;
+	}
+
+	world->stream = stream;
+	return true;
+}
+
+void DisableWorldStreaming(World *world)
+{
+	ChunkStream *stream = world->stream;
+	if (stream == NULL)
+		return;
+
+	// Queued writes keep their bytes in memory, so everything can be read back without the loader
+	StopStreamLoader(stream);
+
+	uint64_t *keys = (uint64_t *)malloc(stream->evicted.count * sizeof(uint64_t));
+	uint32_t count = 0;
+	for (uint32_t i = 0; keys != NULL && i < stream->evicted.capacity; i++)
+	{
+		if (stream->evicted.slots[i].value != NULL)
+			keys[count++] = stream->evicted.slots[i].key;
+	}
+	for (uint32_t i = 0; i < count; i++)
+		LoadStreamedChunk(world, ChunkKeyX(keys[i]), ChunkKeyY(keys[i]));
+	free(keys);
+
+	// The records chunks were loaded from are about to go with the file
+	DirectoryIterator iterator = {0};
+	uint64_t key;
+	void *entry;
+	while (NextDirectoryEntry(&world->chunks, &iterator, &key, &entry))
+	{
+		Chunk *chunk = (Chunk *)entry;
+		if (chunk->source != NULL)
+		{
+			ReleaseStreamedChunk(chunk->source);
+			chunk->source = NULL;
+		}
+	}
+
+	UnloadChunkStream(stream);
+	world->stream = NULL;
+}
+
+void UnloadChunkStream(ChunkStream *stream)
+{
+	if (stream == NULL)
+		return;
+
+	StopStreamLoader(stream);
+	FreeStreamJobs(stream->queued);
+	FreeStreamJobs(stream->finished);
+	FreeHotChunks(stream);
+	for (uint32_t i = 0; i < stream->evicted.capacity; i++)
+	{
+		if (stream->evicted.slots[i].value != NULL)
+			ReleaseStreamedChunk((StreamedChunk *)stream->evicted.slots[i].value);
+	}
+	ChunkMapFree(&stream->evicted);
+	ChunkMapFree(&stream->lastUsed);
+
+	DestroyWorkerMutex(stream->queueMutex);
+	DestroyWorkerCondition(stream->queueSignal);
+	DestroyWorkerMutex(stream->fileMutex);
+	if (stream->file != NULL)
+		fclose(stream->file);
+	free(stream);
+}
+
+void KeepChunksResident(World *world, int x, int y, int width, int height)
+{
+	ChunkStream *stream = world->stream;
+	if (stream == NULL)
+		return;
+
+	const int x0 = x > 0 ? x : 0;
+	const int y0 = y > 0 ? y : 0;
+	const int x1 = x + width < world->width ? x + width : world->width;
+	const int y1 = y + height < world->height ? y + height : world->height;
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	for (int cy = y0 >> CHUNK_SHIFT; cy <= (y1 - 1) >> CHUNK_SHIFT; cy++)
+	{
+		for (int cx = x0 >> CHUNK_SHIFT; cx <= (x1 - 1) >> CHUNK_SHIFT; cx++)
+		{
+			const uint64_t key = ChunkKey(cx, cy);
+			if (GetDirectoryEntry(&world->chunks, key) != NULL)
+			{
+				// Out of memory for the stamp, anything loaded now would only be evicted again
+				if (!ChunkMapPut(&stream->lastUsed, key, (void *)(uintptr_t)stream->frame))
+					return;
+				continue;
+			}
+
+			StreamedChunk *record = (StreamedChunk *)ChunkMapGet(&stream->evicted, key);
+			if (record == NULL)
+				continue;
+			if (record->compacted)
+			{
+				// Still in memory, so unpacking it now is cheaper than a trip through the loader.
+				// The record stays the chunk's source and the next compaction just puts it back
+				uint8_t *data = ReadRecord(stream, record);
+				if (data != NULL)
+				{
+					InstallChunk(world, key, record, data, true);
+					free(data);
+					continue;
+				}
+			}
+			if (record->loading)
+				continue;
+			StreamJob *job = (StreamJob *)calloc(1, sizeof(StreamJob));
+			if (job == NULL)
+				continue;
+			job->type = STREAM_JOB_LOAD;
+			job->key = key;
+			job->record = record;
+			record->loading = true;
+			stream->loadsInFlight++;
+			QueueStreamJob(stream, job);
+		}
+	}
+}
+
+void UpdateWorldStream(World *world)
+{
+	ChunkStream *stream = world->stream;
+	if (stream == NULL)
+		return;
+
+	LockWorkerMutex(stream->queueMutex);
+	StreamJob *finished = stream->finished;
+	stream->finished = NULL;
+	UnlockWorkerMutex(stream->queueMutex);
+
+	while (finished != NULL)
+	{
+		StreamJob *job = finished;
+		finished = job->next;
+		if (job->type == STREAM_JOB_COMPRESS && !job->failed)
+		{
+			stream->compactedBytes += job->record->size;
+			stream->compressedBytes += job->record->compressedSize;
+		}
+		if (job->type == STREAM_JOB_LOAD)
+		{
+			job->record->loading = false;
+			stream->loadsInFlight--;
+			if (job->decompressed)
+			{
+				stream->decompressions++;
+				stream->decompressSeconds += job->decompressSeconds;
+			}
+			// A restore or a write may have replaced or brought back the chunk in the meantime
+			if (!job->failed && ChunkMapGet(&stream->evicted, job->key) == job->record)
+				InstallChunk(world, job->key, job->record, job->data, true);
+		}
+		job->next = NULL;
+		FreeStreamJobs(job);
+	}
+
+	EvictChunks(world);
+
+	const double now = GetMonotonicTime();
+	if (now >= stream->nextSecond)
+	{
+		stream->secondFrames[stream->seconds % (MAX_COMPACT_SECONDS + 1)] = stream->frame;
+		stream->seconds++;
+		stream->nextSecond = now + 1.0;
+		CompactIdleChunks(world);
+	}
+	stream->frame++;
+}
+
+void SetChunkCompaction(World *world, int idleSeconds)
+{
+	if (world->stream == NULL)
+		return;
+	if (idleSeconds < 0)
+		idleSeconds = 0;
+	world->stream->compactSeconds = idleSeconds < MAX_COMPACT_SECONDS ? idleSeconds : MAX_COMPACT_SECONDS;
+}
+
+const StreamedChunk *GetStreamedChunk(const World *world, int cx, int cy)
+{
+	if (world->stream == NULL)
+		return NULL;
+	return (const StreamedChunk *)ChunkMapGet(&world->stream->evicted, ChunkKey(cx, cy));
+}
+
+bool ReadStreamedChunk(const World *world, const StreamedChunk *record, Chunk *chunk)
+{
+	uint8_t *data = ReadRecord(world->stream, record);
+	if (data == NULL)
+		return false;
+
+	memset(chunk, 0, sizeof(Chunk));
+	uint8_t *railMasks;
+	void *attributes[MAX_TILE_ATTRIBUTES];
+	const bool decoded = DecodeTiles(chunk, data) && DecodePlanes(world, data, &railMasks, attributes);
+	free(data);
+	if (!decoded)
+	{
+		UnloadStreamedChunkCopy(chunk);
+		return false;
+	}
+	chunk->railMasks = railMasks;
+	memcpy(chunk->attributes, attributes, sizeof(chunk->attributes));
+	return true;
+}
+
+void UnloadStreamedChunkCopy(Chunk *chunk)
+{
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		FreeChunkLayer(chunk, layer);
+	free(chunk->railMasks);
+	chunk->railMasks = NULL;
+	for (int i = 0; i < MAX_TILE_ATTRIBUTES; i++)
+	{
+		free(chunk->attributes[i]);
+		chunk->attributes[i] = NULL;
+	}
+}
+
+Chunk *LoadStreamedChunk(World *world, int cx, int cy)
+{
+	if (world->stream == NULL)
+		return NULL;
+
+	const uint64_t key = ChunkKey(cx, cy);
+	StreamedChunk *record = (StreamedChunk *)ChunkMapGet(&world->stream->evicted, key);
+	if (record == NULL)
+		return NULL;
+
+	uint8_t *data = ReadRecord(world->stream, record);
+	if (data == NULL)
+		return NULL;
+	// Loaded to be written to, so there is no point remembering where it came from
+	Chunk *chunk = InstallChunk(world, key, record, data, false);
+	free(data);
+	return chunk;
+}
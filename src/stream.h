@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chunk_map.h"
+#include "threads.h"
+#include "tiles.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Used by EnableWorldStreaming when no budget is given
+#define DEFAULT_STREAM_BUDGET (256 * 1024 * 1024)
+// Longest idle time SetChunkCompaction takes
+#define MAX_COMPACT_SECONDS 255
+// Compacted records kept decompressed for repeated reads
+#define HOT_CHUNK_COUNT 8
+
+// Copy of a chunk in the backing file, or compressed in memory when the chunk was compacted
+// instead of evicted. Records are only ever appended, so one stays valid for as long as
+// something references it: the evicted directory, a snapshot, a pending load, or a resident
+// chunk that was loaded from it and not modified since.
+typedef struct StreamedChunk
+{
+	uint64_t offset; // In the backing file
+	uint32_t size;   // In bytes, before compression
+	int refCount;
+	bool loading;                        // An asynchronous load is queued
+	uint16_t typeCounts[TILE_TYPE_COUNT]; // So counting queries do not need the tiles
+	uint8_t *pending; // Bytes still waiting for the loader thread to write or compress them, guarded by queueMutex
+	uint8_t *compressed; // Set instead of a file copy for compacted records, guarded by queueMutex
+	uint32_t compressedSize;
+	bool compacted; // Put in the evicted directory by compaction, KeepChunksResident unpacks it on the spot
+} StreamedChunk;
+
+// Decompressed copy of a compacted record
+typedef struct HotChunk
+{
+	StreamedChunk *record; // Referenced while cached, NULL for a free slot
+	uint8_t *data;
+	uint32_t lastUsed;
+} HotChunk;
+
+struct StreamJob;
+
+// Keeps at most budget bytes of chunks resident. Chunks that were not kept this frame
+// (see KeepChunksResident) are evicted least recently used first once the budget is
+// exceeded. Evicted chunks come back asynchronously when kept again, or synchronously
+// when something writes to them. Only the loader thread touches the disk for
+// asynchronous work, the render thread just queues jobs and installs the results.
+//
+// While a chunk is evicted GetChunk returns NULL and GetTile reads it as blank. The
+// summary pyramid still counts it, and CountTilesInRect and ForEachTileInRect read it
+// back from the file, so queries stay exact. Compacted chunks read the same way, through
+// the hot cache instead of the file, and keeping one resident unpacks it right away.
+typedef struct ChunkStream
+{
+	FILE *file;
+	uint64_t fileEnd;
+	size_t budget;
+	uint32_t frame;    // Stamp of the current frame, starts at 1
+	ChunkMap evicted;  // ChunkKey -> StreamedChunk, each holding one reference
+	ChunkMap lastUsed; // ChunkKey -> frame the resident chunk was last kept in
+	int loadsInFlight;
+	int evictions;     // Totals since streaming started, for the debug overlay
+	int loads;
+
+	// Compaction, see SetChunkCompaction
+	int compactSeconds;
+	uint32_t secondFrames[MAX_COMPACT_SECONDS + 1]; // Frame stamp each of the last seconds started at
+	uint32_t seconds;
+	double nextSecond;
+	HotChunk hotChunks[HOT_CHUNK_COUNT];
+	uint32_t hotClock;
+	int compactions; // Totals since streaming started, for the debug overlay
+	uint64_t compactedBytes;  // Records that went through the compressor
+	uint64_t compressedBytes; // and what they came out as
+	uint32_t hotHits;
+	uint32_t hotMisses;
+	uint32_t decompressions;
+	double decompressSeconds;
+
+	WorkerThread *loader;
+	WorkerMutex *queueMutex; // Guards the job lists and StreamedChunk.pending
+	WorkerCondition *queueSignal;
+	WorkerMutex *fileMutex; // The loader and synchronous loads share the file
+	struct StreamJob *queued;   // FIFO the loader works through
+	struct StreamJob *queuedTail;
+	struct StreamJob *finished; // Handed back to the render thread
+	bool stopping;
+} ChunkStream;
+
+struct World;
+struct Chunk;
+
+// path is created or truncated, NULL uses an anonymous temporary file. A budget of 0
+// uses DEFAULT_STREAM_BUDGET. Returns false if the file or the loader thread could not
+// be created, or the world is already streaming
+bool EnableWorldStreaming(struct World *world, const char *path, size_t budget);
+// Brings every evicted chunk back into memory and stops the loader
+void DisableWorldStreaming(struct World *world);
+// Frees the stream without loading anything back, used when the whole world goes away
+void UnloadChunkStream(ChunkStream *stream);
+
+// Marks the chunks under the rectangle (in tiles) as in use this frame and queues loads for
+// the evicted ones. Called for the camera and for anything else that is working on the world
+void KeepChunksResident(struct World *world, int x, int y, int width, int height);
+// Once per frame: installs finished loads, then evicts down to the budget. Once a second
+// it also compacts idle chunks when SetChunkCompaction asked for it
+void UpdateWorldStream(struct World *world);
+// Chunks not kept resident for idleSeconds are compressed into memory on the loader thread
+// instead of staying unpacked, 0 turns this off. Keeping one resident installs it again
+// right away, decompressing through a small cache of the last few records, and it keeps its
+// record, so compacting it again costs nothing until it is written to. An idle chunk that
+// was loaded unchanged from the file goes back to the file instead. Does nothing unless the
+// world is streaming
+void SetChunkCompaction(struct World *world, int idleSeconds);
+
+// Returns NULL unless chunk (cx, cy) is evicted
+const StreamedChunk *GetStreamedChunk(const struct World *world, int cx, int cy);
+// Reads tiles, occupancy, counts, rail masks and attributes of an evicted chunk into chunk
+// without installing it. Blocks on the file. The copy has to be released with
+// UnloadStreamedChunkCopy
+bool ReadStreamedChunk(const struct World *world, const StreamedChunk *record, struct Chunk *chunk);
+void UnloadStreamedChunkCopy(struct Chunk *chunk);
+// Installs evicted chunk (cx, cy) right away, blocking on the file. Returns NULL if the
+// chunk is not evicted. Used by EnsureChunk so writes never land on a blank stand in
+struct Chunk *LoadStreamedChunk(struct World *world, int cx, int cy);
+void ReleaseStreamedChunk(StreamedChunk *record);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,277 @@
+#include "summary.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "world.h"
+
+void InitWorldSummary(WorldSummary *summary, int chunksWide, int chunksHigh)
+{
+	memset(summary, 0, sizeof(WorldSummary));
+
+	const int chunksAcross = chunksWide > chunksHigh ? chunksWide : chunksHigh;
+	while ((1 << summary->levelCount) < chunksAcross && summary->levelCount < MAX_SUMMARY_LEVELS)
+		summary->levelCount++;
+}
+
+void UnloadWorldSummary(WorldSummary *summary)
+{
+	for (int level = 0; level < MAX_SUMMARY_LEVELS; level++)
+	{
+		ChunkMap *map = &summary->levels[level];
+		for (uint32_t i = 0; i < map->capacity; i++)
+			free(map->slots[i].value);
+		ChunkMapFree(map);
+	}
+	summary->levelCount = 0;
+}
+
+// Makes sure every level above chunk (cx, cy) has a node. Nodes with nothing counted yet are
+// the ones just added, so on failure they are taken out again and the pyramid is unchanged
+static bool EnsureSummaryNodes(WorldSummary *summary, int cx, int cy)
+{
+	for (int level = 1; level <= summary->levelCount; level++)
+	{
+		ChunkMap *map = &summary->levels[level - 1];
+		const uint64_t key = ChunkKey(cx >> level, cy >> level);
+		if (ChunkMapGet(map, key) != NULL)
+			continue;
+
+		SummaryNode *node = (SummaryNode *)calloc(1, sizeof(SummaryNode));
+		if (node != NULL && ChunkMapPut(map, key, node))
+			continue;
+		free(node);
+		for (int added = 1; added < level; added++)
+		{
+			ChunkMap *addedMap = &summary->levels[added - 1];
+			const uint64_t addedKey = ChunkKey(cx >> added, cy >> added);
+			SummaryNode *addedNode = (SummaryNode *)ChunkMapGet(addedMap, addedKey);
+			if (addedNode->total == 0)
+			{
+				ChunkMapRemove(addedMap, addedKey);
+				free(addedNode);
+			}
+		}
+		return false;
+	}
+	return true;
+}
+
+bool UpdateWorldSummary(WorldSummary *summary, int cx, int cy, TileId prev, TileId tile, int occupiedChange)
+{
+	// Only painting can reach a missing node, erasing implies the node already counts the tile
+	if (tile != BLANK_SPACE && !EnsureSummaryNodes(summary, cx, cy))
+		return false;
+
+	for (int level = 1; level <= summary->levelCount; level++)
+	{
+		ChunkMap *map = &summary->levels[level - 1];
+		const uint64_t key = ChunkKey(cx >> level, cy >> level);
+		SummaryNode *node = (SummaryNode *)ChunkMapGet(map, key);
+		if (prev != BLANK_SPACE)
+			node->counts[prev]--;
+		if (tile != BLANK_SPACE)
+			node->counts[tile]++;
+		node->total += (uint64_t)(int64_t)occupiedChange;
+
+		if (node->total == 0)
+		{
+			ChunkMapRemove(map, key);
+			free(node);
+		}
+	}
+	return true;
+}
+
+bool AddChunkToWorldSummary(WorldSummary *summary, int cx, int cy, const int typeCounts[TILE_TYPE_COUNT])
+{
+	const uint64_t painted = (uint64_t)(CHUNK_AREA - typeCounts[BLANK_SPACE]);
+	if (painted == 0)
+		return true;
+	if (!EnsureSummaryNodes(summary, cx, cy))
+		return false;
+
+	for (int level = 1; level <= summary->levelCount; level++)
+	{
+		SummaryNode *node = (SummaryNode *)ChunkMapGet(&summary->levels[level - 1], ChunkKey(cx >> level, cy >> level));
+		for (int type = BLANK_SPACE + 1; type < TILE_TYPE_COUNT; type++)
+			node->counts[type] += (uint64_t)typeCounts[type];
+		node->total += painted;
+	}
+	return true;
+}
+
+const SummaryNode *GetSummaryNode(const WorldSummary *summary, int level, int nx, int ny)
+{
+	if (level < 1 || level > summary->levelCount)
+		return NULL;
+	return (const SummaryNode *)ChunkMapGet(&summary->levels[level - 1], ChunkKey(nx, ny));
+}
+
+// Rectangle queries
+//----------------------------------------------------------------------------------
+typedef struct SummaryQuery
+{
+	const World *world;
+	int x0, y0, x1, y1; // Clipped to the world, end exclusive
+	uint64_t *counts;   // Set when counting, whole nodes inside the rectangle are added at once
+	uint64_t occupied;  // Positions with anything on them, when counting
+	TileVisitor visit;  // Set when visiting, every painted tile is reported
+	void *userData;
+} SummaryQuery;
+
+// Reports every painted tile of the chunk inside the rectangle
+static void VisitChunk(SummaryQuery *query, const Chunk *chunk, int chunkX, int chunkY)
+{
+	const int fromX = query->x0 > chunkX ? query->x0 : chunkX;
+	const int toX = query->x1 < chunkX + CHUNK_SIZE ? query->x1 : chunkX + CHUNK_SIZE;
+	const int fromY = query->y0 > chunkY ? query->y0 : chunkY;
+	const int toY = query->y1 < chunkY + CHUNK_SIZE ? query->y1 : chunkY + CHUNK_SIZE;
+	const uint32_t columns = BitRange32(fromX - chunkX, toX - chunkX);
+
+	for (int y = fromY; y < toY; y++)
+	{
+		uint32_t bits = chunk->occupancy[y - chunkY] & columns;
+		while (bits != 0)
+		{
+			const int x = chunkX + CountTrailingZeros32(bits);
+			bits &= bits - 1;
+			for (int layer = 0; layer < LAYER_COUNT; layer++)
+			{
+				const TileId tile = GetChunkTile(chunk, layer, ChunkTileIndex(x, y));
+				if (tile != BLANK_SPACE)
+					query->visit(query->userData, x, y, tile);
+			}
+		}
+	}
+}
+
+static void QueryNode(SummaryQuery *query, int level, int nx, int ny)
+{
+	const int shift = CHUNK_SHIFT + level;
+	const int nodeX0 = nx << shift;
+	const int nodeY0 = ny << shift;
+	const int nodeX1 = nodeX0 + (1 << shift);
+	const int nodeY1 = nodeY0 + (1 << shift);
+	if (nodeX1 <= query->x0 || nodeY1 <= query->y0 || nodeX0 >= query->x1 || nodeY0 >= query->y1)
+		return;
+
+	const bool covered = nodeX0 >= query->x0 && nodeY0 >= query->y0 && nodeX1 <= query->x1 && nodeY1 <= query->y1;
+
+	if (level == 0)
+	{
+		const Chunk *chunk = GetChunk(query->world, nx, ny);
+		Chunk streamed;
+		if (chunk == NULL)
+		{
+			// Evicted chunks still count, whole ones straight from their record
+			const StreamedChunk *record = GetStreamedChunk(query->world, nx, ny);
+			if (record == NULL)
+				return;
+			if (covered && query->counts != NULL)
+			{
+				for (int type = BLANK_SPACE + 1; type < TILE_TYPE_COUNT; type++)
+					query->counts[type] += record->typeCounts[type];
+				query->occupied += (uint64_t)(CHUNK_AREA - record->typeCounts[BLANK_SPACE]);
+				return;
+			}
+			if (!ReadStreamedChunk(query->world, record, &streamed))
+				return;
+			chunk = &streamed;
+		}
+		else if (covered && query->counts != NULL)
+		{
+			for (int type = BLANK_SPACE + 1; type < TILE_TYPE_COUNT; type++)
+				query->counts[type] += chunk->typeCounts[type];
+			query->occupied += (uint64_t)chunk->nonEmpty;
+			return;
+		}
+
+		if (query->counts != NULL)
+		{
+			// Edge of the rectangle, four lookups per type once the chunk has a summed area table.
+			// A copy read back from the stream is scanned, it is gone after this query
+			const int fromX = query->x0 > nodeX0 ? query->x0 - nodeX0 : 0;
+			const int fromY = query->y0 > nodeY0 ? query->y0 - nodeY0 : 0;
+			const int toX = query->x1 < nodeX1 ? query->x1 - nodeX0 : CHUNK_SIZE;
+			const int toY = query->y1 < nodeY1 ? query->y1 - nodeY0 : CHUNK_SIZE;
+			AreaTablePool *pool = chunk == &streamed ? NULL : (AreaTablePool *)&query->world->areaTables;
+			query->occupied += CountChunkTilesInRect(pool, chunk, fromX, fromY, toX, toY, query->counts);
+		}
+		else
+		{
+			VisitChunk(query, chunk, nodeX0, nodeY0);
+		}
+		if (chunk == &streamed)
+			UnloadStreamedChunkCopy(&streamed);
+		return;
+	}
+
+	const SummaryNode *node = GetSummaryNode(&query->world->summary, level, nx, ny);
+	if (node == NULL)
+		return;
+	if (covered && query->counts != NULL)
+	{
+		for (int type = BLANK_SPACE + 1; type < TILE_TYPE_COUNT; type++)
+			query->counts[type] += node->counts[type];
+		query->occupied += node->total;
+		return;
+	}
+
+	for (int dy = 0; dy < 2; dy++)
+	{
+		for (int dx = 0; dx < 2; dx++)
+			QueryNode(query, level - 1, nx * 2 + dx, ny * 2 + dy);
+	}
+}
+
+static bool ClipQuery(SummaryQuery *query, int x, int y, int width, int height)
+{
+	query->x0 = x > 0 ? x : 0;
+	query->y0 = y > 0 ? y : 0;
+	query->x1 = x + width < query->world->width ? x + width : query->world->width;
+	query->y1 = y + height < query->world->height ? y + height : query->world->height;
+	return query->x0 < query->x1 && query->y0 < query->y1;
+}
+
+static void RunQuery(SummaryQuery *query)
+{
+	const int top = query->world->summary.levelCount;
+	const int shift = CHUNK_SHIFT + top;
+	for (int ny = query->y0 >> shift; ny <= (query->y1 - 1) >> shift; ny++)
+	{
+		for (int nx = query->x0 >> shift; nx <= (query->x1 - 1) >> shift; nx++)
+			QueryNode(query, top, nx, ny);
+	}
+}
+
+void CountTilesInRect(const World *world, int x, int y, int width, int height, uint64_t counts[TILE_TYPE_COUNT])
+{
+	memset(counts, 0, sizeof(uint64_t) * TILE_TYPE_COUNT);
+
+	SummaryQuery query = {0};
+	query.world = world;
+	query.counts = counts;
+	if (!ClipQuery(&query, x, y, width, height))
+		return;
+	RunQuery(&query);
+	counts[BLANK_SPACE] = (uint64_t)(query.x1 - query.x0) * (uint64_t)(query.y1 - query.y0) - query.occupied;
+}
+
+void CountTilesAround(const World *world, int x, int y, int radius, uint64_t counts[TILE_TYPE_COUNT])
+{
+	CountTilesInRect(world, x - radius, y - radius, radius * 2 + 1, radius * 2 + 1, counts);
+}
+
+void ForEachTileInRect(const World *world, int x, int y, int width, int height, TileVisitor visit, void *userData)
+{
+	SummaryQuery query = {0};
+	query.world = world;
+	query.visit = visit;
+	query.userData = userData;
+	if (!ClipQuery(&query, x, y, width, height))
+		return;
+	RunQuery(&query);
+}
+//----------------------------------------------------------------------------------
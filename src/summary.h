@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chunk_map.h"
+#include "tiles.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Enough levels for one root node over a MAX_WORLD_SIZE world of 32 tile chunks
+#define MAX_SUMMARY_LEVELS 16
+
+// Per type tile counts of a square block of chunks. Level 0 is the chunk itself
+// (Chunk.typeCounts), a level k node covers 2^k x 2^k chunks and sums the four
+// level k - 1 nodes below it. Nodes only exist while something in them is painted.
+typedef struct SummaryNode
+{
+	uint64_t counts[TILE_TYPE_COUNT]; // counts[BLANK_SPACE] is always 0
+	uint64_t total;                   // Tile positions with anything on any layer
+} SummaryNode;
+
+typedef struct WorldSummary
+{
+	int levelCount;                       // Highest level, whose nodes cover the whole world
+	ChunkMap levels[MAX_SUMMARY_LEVELS]; // levels[k - 1] holds level k, keyed by ChunkKey(nx, ny)
+} WorldSummary;
+
+typedef void (*TileVisitor)(void *userData, int x, int y, TileId tile);
+
+struct World;
+
+void InitWorldSummary(WorldSummary *summary, int chunksWide, int chunksHigh);
+void UnloadWorldSummary(WorldSummary *summary);
+// Moves one layer tile of chunk (cx, cy) from prev to tile in every level above the chunk,
+// O(levelCount). occupiedChange is +1 or -1 when the position went from having nothing on
+// any layer to something or back, 0 otherwise. Returns false when out of memory for a new
+// node, the pyramid is left as it was then. Only painting a block's first tile adds nodes
+bool UpdateWorldSummary(WorldSummary *summary, int cx, int cy, TileId prev, TileId tile, int occupiedChange);
+// Adds a whole chunk worth of tiles to every level above it, used when rebuilding the
+// pyramid. typeCounts[BLANK_SPACE] is the number of empty positions, as in Chunk.typeCounts.
+// Returns false when out of memory, the pyramid is left as it was then
+bool AddChunkToWorldSummary(WorldSummary *summary, int cx, int cy, const int typeCounts[TILE_TYPE_COUNT]);
+// Returns NULL when nothing is painted under the node
+const SummaryNode *GetSummaryNode(const WorldSummary *summary, int level, int nx, int ny);
+
+// Rectangle queries in tiles. Both only descend into populated nodes, so their cost
+// follows the number of painted blocks touched by the rectangle rather than its area.
+//----------------------------------------------------------------------------------
+// Fills counts with the number of tiles of each type over all layers, counts[BLANK_SPACE]
+// being the positions with nothing on any layer. Chunks cut by the edge of the rectangle
+// cost a popcount per row and type, or four lookups per type in a summed area table once
+// queries keep cutting the same chunk, see area_table.h
+void CountTilesInRect(const struct World *world, int x, int y, int width, int height, uint64_t counts[TILE_TYPE_COUNT]);
+// Same for the square of tiles at most radius away from (x, y) along either axis
+void CountTilesAround(const struct World *world, int x, int y, int radius, uint64_t counts[TILE_TYPE_COUNT]);
+// Calls visit for every non blank tile, chunk by chunk and row by row inside a chunk,
+// bottom layer first where tiles are stacked
+void ForEachTileInRect(const struct World *world, int x, int y, int width, int height, TileVisitor visit, void *userData);
+//----------------------------------------------------------------------------------
+
+#if defined(__cplusplus)
+}
+#endif
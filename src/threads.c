@@ -0,0 +1,261 @@
+// pthreads and sysconf are hidden by strict C99 unless POSIX is requested
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "threads.h"
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+struct WorkerThread
+{
+	HANDLE handle;
+	WorkerFunction function;
+	void *userData;
+};
+
+struct WorkerMutex
+{
+	CRITICAL_SECTION section;
+};
+
+struct WorkerCondition
+{
+	CONDITION_VARIABLE variable;
+};
+
+static DWORD WINAPI RunWorkerThread(LPVOID parameter)
+{
+	WorkerThread *thread = (WorkerThread *)parameter;
+	thread->function(thread->userData);
+	return 0;
+}
+
+WorkerThread *StartWorkerThread(WorkerFunction function, void *userData)
+{
+	WorkerThread *thread = (WorkerThread *)calloc(1, sizeof(WorkerThread));
+	if (thread == NULL)
+		return NULL;
+	thread->function = function;
+	thread->userData = userData;
+	thread->handle = CreateThread(NULL, 0, RunWorkerThread, thread, 0, NULL);
+	if (thread->handle == NULL)
+	{
+		free(thread);
+		return NULL;
+	}
+	return thread;
+}
+
+void JoinWorkerThread(WorkerThread *thread)
+{
+	if (thread == NULL)
+		return;
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	free(thread);
+}
+
+WorkerMutex *CreateWorkerMutex(void)
+{
+	WorkerMutex *mutex = (WorkerMutex *)calloc(1, sizeof(WorkerMutex));
+	if (mutex != NULL)
+		InitializeCriticalSection(&mutex->section);
+	return mutex;
+}
+
+void DestroyWorkerMutex(WorkerMutex *mutex)
+{
+	if (mutex == NULL)
+		return;
+	DeleteCriticalSection(&mutex->section);
+	free(mutex);
+}
+
+void LockWorkerMutex(WorkerMutex *mutex)
+{
+	EnterCriticalSection(&mutex->section);
+}
+
+void UnlockWorkerMutex(WorkerMutex *mutex)
+{
+	LeaveCriticalSection(&mutex->section);
+}
+
+WorkerCondition *CreateWorkerCondition(void)
+{
+	WorkerCondition *condition = (WorkerCondition *)calloc(1, sizeof(WorkerCondition));
+	if (condition != NULL)
+		InitializeConditionVariable(&condition->variable);
+	return condition;
+}
+
+void DestroyWorkerCondition(WorkerCondition *condition)
+{
+	free(condition);
+}
+
+void WaitWorkerCondition(WorkerCondition *condition, WorkerMutex *mutex)
+{
+	SleepConditionVariableCS(&condition->variable, &mutex->section, INFINITE);
+}
+
+void SignalWorkerCondition(WorkerCondition *condition)
+{
+	WakeConditionVariable(&condition->variable);
+}
+
+void BroadcastWorkerCondition(WorkerCondition *condition)
+{
+	WakeAllConditionVariable(&condition->variable);
+}
+
+int GetProcessorCount(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+double GetMonotonicTime(void)
+{
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+#else
+struct WorkerThread
+{
+	pthread_t handle;
+	WorkerFunction function;
+	void *userData;
+};
+
+struct WorkerMutex
+{
+	pthread_mutex_t mutex;
+};
+
+struct WorkerCondition
+{
+	pthread_cond_t condition;
+};
+
+static void *RunWorkerThread(void *parameter)
+{
+	WorkerThread *thread = (WorkerThread *)parameter;
+	thread->function(thread->userData);
+	return NULL;
+}
+
+WorkerThread *StartWorkerThread(WorkerFunction function, void *userData)
+{
+	WorkerThread *thread = (WorkerThread *)calloc(1, sizeof(WorkerThread));
+	if (thread == NULL)
+		return NULL;
+	thread->function = function;
+	thread->userData = userData;
+	if (pthread_create(&thread->handle, NULL, RunWorkerThread, thread) != 0)
+	{
+		free(thread);
+		return NULL;
+	}
+	return thread;
+}
+
+void JoinWorkerThread(WorkerThread *thread)
+{
+	if (thread == NULL)
+		return;
+	pthread_join(thread->handle, NULL);
+	free(thread);
+}
+
+WorkerMutex *CreateWorkerMutex(void)
+{
+	WorkerMutex *mutex = (WorkerMutex *)calloc(1, sizeof(WorkerMutex));
+	if (mutex != NULL && pthread_mutex_init(&mutex->mutex, NULL) != 0)
+	{
+		free(mutex);
+		return NULL;
+	}
+	return mutex;
+}
+
+void DestroyWorkerMutex(WorkerMutex *mutex)
+{
+	if (mutex == NULL)
+		return;
+	pthread_mutex_destroy(&mutex->mutex);
+	free(mutex);
+}
+
+void LockWorkerMutex(WorkerMutex *mutex)
+{
+	pthread_mutex_lock(&mutex->mutex);
+}
+
+void UnlockWorkerMutex(WorkerMutex *mutex)
+{
+	pthread_mutex_unlock(&mutex->mutex);
+}
+
+WorkerCondition *CreateWorkerCondition(void)
+{
+	WorkerCondition *condition = (WorkerCondition *)calloc(1, sizeof(WorkerCondition));
+	if (condition != NULL && pthread_cond_init(&condition->condition, NULL) != 0)
+	{
+		free(condition);
+		return NULL;
+	}
+	return condition;
+}
+
+void DestroyWorkerCondition(WorkerCondition *condition)
+{
+	if (condition == NULL)
+		return;
+	pthread_cond_destroy(&condition->condition);
+	free(condition);
+}
+
+void WaitWorkerCondition(WorkerCondition *condition, WorkerMutex *mutex)
+{
+	pthread_cond_wait(&condition->condition, &mutex->mutex);
+}
+
+void SignalWorkerCondition(WorkerCondition *condition)
+{
+	pthread_cond_signal(&condition->condition);
+}
+
+void BroadcastWorkerCondition(WorkerCondition *condition)
+{
+	pthread_cond_broadcast(&condition->condition);
+}
+
+int GetProcessorCount(void)
+{
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
+double GetMonotonicTime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+#endif
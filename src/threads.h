@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Thin wrapper over pthreads and Win32 threads. The types stay opaque so windows.h
+// never has to be included next to raylib.h, whose names clash with it.
+typedef struct WorkerThread WorkerThread;
+typedef struct WorkerMutex WorkerMutex;
+typedef struct WorkerCondition WorkerCondition;
+
+typedef void (*WorkerFunction)(void *userData);
+
+// Returns NULL if the thread could not be started
+WorkerThread *StartWorkerThread(WorkerFunction function, void *userData);
+// Waits for the thread to return and frees it
+void JoinWorkerThread(WorkerThread *thread);
+
+WorkerMutex *CreateWorkerMutex(void);
+void DestroyWorkerMutex(WorkerMutex *mutex);
+void LockWorkerMutex(WorkerMutex *mutex);
+void UnlockWorkerMutex(WorkerMutex *mutex);
+
+WorkerCondition *CreateWorkerCondition(void);
+void DestroyWorkerCondition(WorkerCondition *condition);
+// mutex has to be locked, it is released while waiting and locked again before returning
+void WaitWorkerCondition(WorkerCondition *condition, WorkerMutex *mutex);
+void SignalWorkerCondition(WorkerCondition *condition);
+void BroadcastWorkerCondition(WorkerCondition *condition);
+
+// Logical processors available to the process, at least 1
+int GetProcessorCount(void);
+// Monotonic wall clock in seconds, works before raylib has opened a window
+double GetMonotonicTime(void);
+
+#if defined(__cplusplus)
+}
+#endif
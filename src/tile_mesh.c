@@ -0,0 +1,276 @@
+#include "tile_mesh.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "bits.h"
+#include "raymath.h"
+#include "rlgl.h"
+
+#include "world.h"
+
+#define QUAD_VERTICES 6
+
+static uint16_t AtlasCoordinate(float pixels, int size)
+{
+	return (uint16_t)(pixels / size * 65535.f + 0.5f);
+}
+
+// Two triangles in the order raylib winds its own quads, so culling keeps them
+static void PushQuad(TileMeshRenderer *mesh, Rectangle dest, Rectangle source, Color color)
+{
+	TileMeshVertex *vertex = &mesh->vertices[mesh->vertexCount];
+	const uint16_t u0 = AtlasCoordinate(source.x, mesh->atlas.width);
+	const uint16_t v0 = AtlasCoordinate(source.y, mesh->atlas.height);
+	const uint16_t u1 = AtlasCoordinate(source.x + source.width, mesh->atlas.width);
+	const uint16_t v1 = AtlasCoordinate(source.y + source.height, mesh->atlas.height);
+	const float x0 = dest.x;
+	const float y0 = dest.y;
+	const float x1 = dest.x + dest.width;
+	const float y1 = dest.y + dest.height;
+	vertex[0] = (TileMeshVertex){x0, y0, u0, v0, color};
+	vertex[1] = (TileMeshVertex){x0, y1, u0, v1, color};
+	vertex[2] = (TileMeshVertex){x1, y1, u1, v1, color};
+	vertex[3] = vertex[0];
+	vertex[4] = vertex[2];
+	vertex[5] = (TileMeshVertex){x1, y0, u1, v0, color};
+	mesh->vertexCount += QUAD_VERTICES;
+}
+
+static bool ReserveQuads(TileMeshRenderer *mesh, int quads)
+{
+	const int needed = mesh->vertexCount + quads * QUAD_VERTICES;
+	if (needed > MAX_TILE_MESH_QUADS * QUAD_VERTICES)
+		return false;
+	if (needed <= mesh->vertexCapacity)
+		return true;
+
+	int capacity = mesh->vertexCapacity > 0 ? mesh->vertexCapacity : 4096 * QUAD_VERTICES;
+	while (capacity < needed)
+		capacity *= 2;
+	TileMeshVertex *vertices = (TileMeshVertex *)realloc(mesh->vertices, (size_t)capacity * sizeof(TileMeshVertex));
+	if (vertices == NULL)
+		return false;
+	mesh->vertices = vertices;
+	mesh->vertexCapacity = capacity;
+	return true;
+}
+
+static void MarkMeshStale(void *userData, const DirtyRect *rects, int count)
+{
+	TileMeshRenderer *mesh = (TileMeshRenderer *)userData;
+	for (int r = 0; r < count && !mesh->stale; r++)
+	{
+		const DirtyRect *rect = &rects[r];
+		mesh->stale = rect->x < mesh->x + mesh->width && rect->x + rect->width > mesh->x && rect->y < mesh->y + mesh->height && rect->y + rect->height > mesh->y;
+	}
+}
+
+bool InitTileMeshRenderer(TileMeshRenderer *mesh, World *world, const TileArt *art)
+{
+	*mesh = (TileMeshRenderer){0};
+	mesh->world = world;
+	mesh->art = art;
+
+	Image atlas = LoadImageFromTexture(art->atlas);
+	if (atlas.data == NULL)
+		return false;
+	Image padded = GenImageColor(atlas.width, atlas.height + art->gridSize, BLANK);
+	ImageDraw(&padded, atlas, (Rectangle){0, 0, atlas.width, atlas.height}, (Rectangle){0, 0, atlas.width, atlas.height}, WHITE);
+	ImageDrawRectangle(&padded, 0, atlas.height, art->gridSize, art->gridSize, WHITE);
+	mesh->atlas = LoadTextureFromImage(padded);
+	UnloadImage(padded);
+	UnloadImage(atlas);
+	if (mesh->atlas.id == 0)
+		return false;
+	GenTextureMipmaps(&mesh->atlas);
+
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if (SubscribeDirtyRegions(&world->dirty[layer], MarkMeshStale, mesh))
+			continue;
+		for (int subscribed = 0; subscribed < layer; subscribed++)
+			UnsubscribeDirtyRegions(&world->dirty[subscribed], MarkMeshStale, mesh);
+		UnloadTexture(mesh->atlas);
+		return false;
+	}
+	return true;
+}
+
+static void UnloadMeshBuffers(TileMeshRenderer *mesh)
+{
+	if (mesh->vao != 0)
+		rlUnloadVertexArray(mesh->vao);
+	if (mesh->vbo != 0)
+		rlUnloadVertexBuffer(mesh->vbo);
+	mesh->vao = 0;
+	mesh->vbo = 0;
+	mesh->capacity = 0;
+}
+
+void UnloadTileMeshRenderer(TileMeshRenderer *mesh)
+{
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		UnsubscribeDirtyRegions(&mesh->world->dirty[layer], MarkMeshStale, mesh);
+	UnloadMeshBuffers(mesh);
+	UnloadTexture(mesh->atlas);
+	free(mesh->vertices);
+}
+
+static void SetMeshAttributes(void)
+{
+	rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, 2, RL_FLOAT, false, sizeof(TileMeshVertex), offsetof(TileMeshVertex, x));
+	rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION);
+	rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD, 2, RL_UNSIGNED_SHORT, true, sizeof(TileMeshVertex), offsetof(TileMeshVertex, u));
+	rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD);
+	rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR, 4, RL_UNSIGNED_BYTE, true, sizeof(TileMeshVertex), offsetof(TileMeshVertex, color));
+	rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR);
+}
+
+// Sends the built vertices to the GPU, reusing the buffer while they fit
+static void UploadMesh(TileMeshRenderer *mesh)
+{
+	const int size = mesh->vertexCount * (int)sizeof(TileMeshVertex);
+	if (mesh->vertexCount <= mesh->capacity)
+	{
+		if (size > 0)
+			rlUpdateVertexBuffer(mesh->vbo, mesh->vertices, size, 0);
+		return;
+	}
+
+	UnloadMeshBuffers(mesh);
+	mesh->capacity = mesh->vertexCapacity;
+	mesh->vao = rlLoadVertexArray();
+	rlEnableVertexArray(mesh->vao);
+	mesh->vbo = rlLoadVertexBuffer(NULL, mesh->capacity * (int)sizeof(TileMeshVertex), true);
+	rlUpdateVertexBuffer(mesh->vbo, mesh->vertices, size, 0);
+	SetMeshAttributes();
+	rlDisableVertexArray();
+}
+
+// Adds the quads of the chunk's tiles inside the window
+static bool BuildChunkQuads(TileMeshRenderer *mesh, const Chunk *chunk, int cx, int cy, Rectangle white)
+{
+	const TileArt *art = mesh->art;
+	const float gridSize = (float)art->gridSize;
+	const int chunkX = cx << CHUNK_SHIFT;
+	const int chunkY = cy << CHUNK_SHIFT;
+	const int fromX = (mesh->x > chunkX ? mesh->x : chunkX) - chunkX;
+	const int fromY = (mesh->y > chunkY ? mesh->y : chunkY) - chunkY;
+	const int toX = (mesh->x + mesh->width < chunkX + CHUNK_SIZE ? mesh->x + mesh->width : chunkX + CHUNK_SIZE) - chunkX;
+	const int toY = (mesh->y + mesh->height < chunkY + CHUNK_SIZE ? mesh->y + mesh->height : chunkY + CHUNK_SIZE) - chunkY;
+
+	const uint32_t columns = BitRange32(fromX, toX);
+	for (int y = fromY; y < toY; y++)
+	{
+		uint32_t bits = chunk->occupancy[y] & columns;
+		if (!ReserveQuads(mesh, PopCount32(bits) * LAYER_COUNT))
+			return false;
+		while (bits != 0)
+		{
+			const int x = CountTrailingZeros32(bits);
+			bits &= bits - 1;
+			const int index = y * CHUNK_SIZE + x;
+			const Rectangle dest = {(chunkX + x - mesh->x) * gridSize, (chunkY + y - mesh->y) * gridSize, gridSize, gridSize};
+			// Bottom layer first, later quads draw over earlier ones
+			for (int layer = 0; layer < LAYER_COUNT; layer++)
+			{
+				const TileId tile = GetChunkTile(chunk, layer, index);
+				if (tile == BLANK_SPACE)
+					continue;
+				if (layer == LAYER_TERRAIN)
+					PushQuad(mesh, dest, white, art->terrainColors[tile]);
+				else
+					PushQuad(mesh, dest, tile == RAIL ? art->railRects[GetChunkRailMask(chunk, index)] : art->tileRects[tile], WHITE);
+			}
+		}
+	}
+	return true;
+}
+
+static bool BuildTileMesh(TileMeshRenderer *mesh)
+{
+	const World *world = mesh->world;
+	const float gridSize = (float)mesh->art->gridSize;
+	// Inset half a pixel so filtering never reaches past the white cell
+	const Rectangle white = {0.5f, mesh->atlas.height - gridSize + 0.5f, gridSize - 1.f, gridSize - 1.f};
+	mesh->vertexCount = 0;
+	for (int cy = mesh->y >> CHUNK_SHIFT; cy <= (mesh->y + mesh->height - 1) >> CHUNK_SHIFT; cy++)
+	{
+		for (int cx = mesh->x >> CHUNK_SHIFT; cx <= (mesh->x + mesh->width - 1) >> CHUNK_SHIFT; cx++)
+		{
+			const Chunk *chunk = GetChunk(world, cx, cy);
+			if (chunk != NULL)
+			{
+				if (!BuildChunkQuads(mesh, chunk, cx, cy, white))
+					return false;
+				continue;
+			}
+			// Still on its way back from the backing file
+			if (GetStreamedChunk(world, cx, cy) == NULL)
+				continue;
+			if (!ReserveQuads(mesh, 1))
+				return false;
+			const Rectangle dest = {((cx << CHUNK_SHIFT) - mesh->x) * gridSize, ((cy << CHUNK_SHIFT) - mesh->y) * gridSize, CHUNK_SIZE * gridSize, CHUNK_SIZE * gridSize};
+			PushQuad(mesh, dest, white, Fade(GRAY, 0.3f));
+		}
+	}
+	return true;
+}
+
+bool PrepareTileMesh(TileMeshRenderer *mesh, int x, int y, int width, int height)
+{
+	const bool inside = mesh->built && x >= mesh->x && y >= mesh->y && x + width <= mesh->x + mesh->width && y + height <= mesh->y + mesh->height;
+	if (inside && !mesh->stale)
+		return true;
+
+	const World *world = mesh->world;
+	const int x0 = x - TILE_MESH_MARGIN > 0 ? x - TILE_MESH_MARGIN : 0;
+	const int y0 = y - TILE_MESH_MARGIN > 0 ? y - TILE_MESH_MARGIN : 0;
+	const int x1 = x + width + TILE_MESH_MARGIN < world->width ? x + width + TILE_MESH_MARGIN : world->width;
+	const int y1 = y + height + TILE_MESH_MARGIN < world->height ? y + height + TILE_MESH_MARGIN : world->height;
+	mesh->x = x0;
+	mesh->y = y0;
+	mesh->width = x1 - x0;
+	mesh->height = y1 - y0;
+	mesh->stale = false;
+	mesh->built = mesh->width > 0 && mesh->height > 0 && BuildTileMesh(mesh);
+	if (!mesh->built)
+		return false;
+	UploadMesh(mesh);
+	mesh->rebuilds++;
+	return true;
+}
+
+void DrawTileMesh(const TileMeshRenderer *mesh)
+{
+	if (mesh->vertexCount == 0)
+		return;
+
+	// Whatever raylib batched so far goes first, so it stays underneath
+	rlDrawRenderBatchActive();
+
+	const float gridSize = (float)mesh->art->gridSize;
+	const Matrix origin = MatrixTranslate(mesh->x * gridSize, mesh->y * gridSize, 0.f);
+	const Matrix mvp = MatrixMultiply(MatrixMultiply(origin, rlGetMatrixModelview()), rlGetMatrixProjection());
+	const int *locs = rlGetShaderLocsDefault();
+	const float white[4] = {1.f, 1.f, 1.f, 1.f};
+	rlEnableShader(rlGetShaderIdDefault());
+	rlSetUniformMatrix(locs[SHADER_LOC_MATRIX_MVP], mvp);
+	rlSetUniform(locs[SHADER_LOC_COLOR_DIFFUSE], white, RL_SHADER_UNIFORM_VEC4, 1);
+	rlActiveTextureSlot(0);
+	rlEnableTexture(mesh->atlas.id);
+
+	// Without vertex array support the attributes are pointed at the buffer every time
+	if (!rlEnableVertexArray(mesh->vao))
+	{
+		rlEnableVertexBuffer(mesh->vbo);
+		SetMeshAttributes();
+	}
+	rlDrawVertexArray(0, mesh->vertexCount);
+	rlDisableVertexArray();
+	rlDisableVertexBuffer();
+
+	rlDisableTexture();
+	rlDisableShader();
+}
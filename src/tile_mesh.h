@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "raylib.h"
+
+#include "chunk_textures.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Tiles of margin the mesh keeps around the view on every side, so panning does not rebuild it
+#define TILE_MESH_MARGIN 32
+// Quads one mesh holds at most, 96 bytes each
+#define MAX_TILE_MESH_QUADS (1 << 18)
+
+typedef struct TileMeshVertex
+{
+	float x; // Relative to the mesh origin, the top left of its window
+	float y;
+	uint16_t u; // Normalised atlas coordinates
+	uint16_t v;
+	Color color;
+} TileMeshVertex;
+
+// Keeps every quad the visible tiles need in one vertex buffer on the GPU and draws it with
+// a single call. The buffer covers the view plus a margin and is only rebuilt when the view
+// leaves it or a dirty rectangle touches it, so a frame without changes uploads nothing.
+// Needs no shader of its own: flat terrain colours sample a white cell added below the atlas.
+typedef struct TileMeshRenderer
+{
+	struct World *world;
+	const TileArt *art;
+	Texture2D atlas; // The art's atlas with one more row, whose first cell is white
+	unsigned int vao;
+	unsigned int vbo;
+	int capacity; // Vertices the GPU buffer has room for
+	int vertexCount;
+	TileMeshVertex *vertices; // Scratch the mesh is built in
+	int vertexCapacity;
+	// Window the mesh covers, in tiles
+	int x;
+	int y;
+	int width;
+	int height;
+	bool stale; // A dirty rectangle touched the window
+	bool built;
+	// For the debug overlay
+	int rebuilds;
+} TileMeshRenderer;
+
+struct World;
+
+// Copies the atlas and subscribes to the world's dirty trackers. art has to outlive the
+// renderer. Returns false when the atlas cannot be read back or no subscriber slot is left
+bool InitTileMeshRenderer(TileMeshRenderer *mesh, struct World *world, const TileArt *art);
+void UnloadTileMeshRenderer(TileMeshRenderer *mesh);
+
+// Rebuilds the mesh when the rectangle (in tiles) leaves its window or the window changed.
+// Returns false when the rectangle needs more than MAX_TILE_MESH_QUADS
+bool PrepareTileMesh(TileMeshRenderer *mesh, int x, int y, int width, int height);
+// Inside BeginMode2D: draws the mesh in one call
+void DrawTileMesh(const TileMeshRenderer *mesh);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,257 @@
+#include "tilemap.h"
+
+#include <string.h>
+
+#include "rlgl.h"
+
+#include "world.h"
+
+#define WINDOW_TILES (TILEMAP_WINDOW_CHUNKS * CHUNK_SIZE)
+#define TEXEL_SIZE 4
+
+#define STRINGIFY_VALUE(value) #value
+#define STRINGIFY(value) STRINGIFY_VALUE(value)
+
+// Bytes of a texel
+enum
+{
+	TEXEL_TERRAIN,
+	TEXEL_TRACK,
+	TEXEL_STRUCTURE,
+	TEXEL_FLAGS,
+};
+
+// Runs with raylib's default vertex shader over a quad whose texture coordinates go from 0
+// to 1 across the prepared rectangle. Everything stays relative to the rectangle, so far
+// away tiles do not lose precision to large world coordinates
+static const char *TilemapShaderCode =
+	"#version 330\n"
+	"in vec2 fragTexCoord;\n"
+	"in vec4 fragColor;\n"
+	"out vec4 finalColor;\n"
+	"uniform sampler2D texture0;\n" // Atlas
+	"uniform sampler2D tileData;\n"
+	"uniform vec2 origin;\n" // Slot of the top left tile
+	"uniform vec2 span;\n"   // Size of the rectangle in tiles
+	"uniform vec2 cells;\n"  // Atlas cells across and down
+	"uniform float windowTiles;\n"
+	"uniform vec4 terrainColors[" STRINGIFY(TILE_TYPE_COUNT) "];\n"
+	"vec4 AtlasCell(float cell, vec2 inside, vec2 dx, vec2 dy)\n"
+	"{\n"
+	"    if (cell < 0.5) return vec4(0.0);\n"
+	"    vec2 corner = vec2(mod(cell - 1.0, cells.x), floor((cell - 1.0) / cells.x));\n"
+	// Gradients of the unbroken coordinate, so mip selection does not jump at cell edges
+	"    return textureGrad(texture0, (corner + inside) / cells, dx, dy);\n"
+	"}\n"
+	"vec4 Over(vec4 below, vec4 above)\n"
+	"{\n"
+	"    float alpha = above.a + below.a * (1.0 - above.a);\n"
+	"    vec3 color = above.rgb * above.a + below.rgb * below.a * (1.0 - above.a);\n"
+	"    return alpha > 0.0 ? vec4(color / alpha, alpha) : vec4(0.0);\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"    vec2 local = fragTexCoord * span;\n"
+	"    vec2 tile = floor(local);\n"
+	"    vec2 inside = local - tile;\n"
+	"    vec2 dx = dFdx(local) / cells;\n"
+	"    vec2 dy = dFdy(local) / cells;\n"
+	"    ivec2 slot = ivec2(mod(origin + tile, windowTiles));\n"
+	"    vec4 texel = floor(texelFetch(tileData, slot, 0) * 255.0 + 0.5);\n"
+	"    vec4 color = texel.x > 0.5 ? terrainColors[int(texel.x)] : vec4(0.0);\n"
+	"    color = Over(color, AtlasCell(texel.y, inside, dx, dy));\n"
+	"    color = Over(color, AtlasCell(texel.z, inside, dx, dy));\n"
+	"    if (texel.w > 0.5) color = Over(color, vec4(0.51, 0.51, 0.51, 0.3));\n"
+	"    finalColor = color * fragColor;\n"
+	"}\n";
+
+// Atlas cell + 1 of a rectangle in the atlas
+static uint8_t AtlasCell(const TileArt *art, Rectangle rect)
+{
+	const int columns = art->atlas.width / art->gridSize;
+	return (uint8_t)(1 + ((int)rect.y / art->gridSize) * columns + (int)rect.x / art->gridSize);
+}
+
+static int WindowSlot(int cx, int cy)
+{
+	const int sx = ((cx % TILEMAP_WINDOW_CHUNKS) + TILEMAP_WINDOW_CHUNKS) % TILEMAP_WINDOW_CHUNKS;
+	const int sy = ((cy % TILEMAP_WINDOW_CHUNKS) + TILEMAP_WINDOW_CHUNKS) % TILEMAP_WINDOW_CHUNKS;
+	return sy * TILEMAP_WINDOW_CHUNKS + sx;
+}
+
+// Fills texels for columns [fromX, toX) and rows [fromY, toY) of chunk (cx, cy), chunk local
+static void EncodeTexels(const TilemapRenderer *tilemap, int cx, int cy, int fromX, int fromY, int toX, int toY, uint8_t *texels)
+{
+	const int width = toX - fromX;
+	memset(texels, 0, (size_t)width * (toY - fromY) * TEXEL_SIZE);
+	const Chunk *chunk = GetChunk(tilemap->world, cx, cy);
+	if (chunk == NULL)
+	{
+		if (GetStreamedChunk(tilemap->world, cx, cy) == NULL)
+			return;
+		for (int i = 0; i < width * (toY - fromY); i++)
+			texels[i * TEXEL_SIZE + TEXEL_FLAGS] = TILEMAP_STAND_IN;
+		return;
+	}
+
+	const uint32_t columns = BitRange32(fromX, toX);
+	for (int y = fromY; y < toY; y++)
+	{
+		uint32_t bits = chunk->occupancy[y] & columns;
+		while (bits != 0)
+		{
+			const int x = CountTrailingZeros32(bits);
+			bits &= bits - 1;
+			const int index = y * CHUNK_SIZE + x;
+			uint8_t *texel = texels + ((size_t)(y - fromY) * width + (x - fromX)) * TEXEL_SIZE;
+			texel[TEXEL_TERRAIN] = GetChunkTile(chunk, LAYER_TERRAIN, index);
+			if (GetChunkTile(chunk, LAYER_TRACK, index) == RAIL)
+				texel[TEXEL_TRACK] = tilemap->railCells[GetChunkRailMask(chunk, index)];
+			const TileId structure = GetChunkTile(chunk, LAYER_STRUCTURE, index);
+			if (structure != BLANK_SPACE)
+				texel[TEXEL_STRUCTURE] = tilemap->tileCells[structure];
+		}
+	}
+}
+
+static void UploadChunkRect(TilemapRenderer *tilemap, int cx, int cy, int fromX, int fromY, int toX, int toY)
+{
+	uint8_t texels[CHUNK_AREA * TEXEL_SIZE];
+	EncodeTexels(tilemap, cx, cy, fromX, fromY, toX, toY, texels);
+	const int slot = WindowSlot(cx, cy);
+	const Rectangle rect = {
+		(float)((slot % TILEMAP_WINDOW_CHUNKS) * CHUNK_SIZE + fromX),
+		(float)((slot / TILEMAP_WINDOW_CHUNKS) * CHUNK_SIZE + fromY),
+		(float)(toX - fromX),
+		(float)(toY - fromY),
+	};
+	UpdateTextureRec(tilemap->data, rect, texels);
+}
+
+// Uploads the part of each dirty rectangle that lies in chunks the texture holds
+static void UploadDirtyRects(void *userData, const DirtyRect *rects, int count)
+{
+	TilemapRenderer *tilemap = (TilemapRenderer *)userData;
+	for (int r = 0; r < count; r++)
+	{
+		const DirtyRect *rect = &rects[r];
+		for (int cy = rect->y >> CHUNK_SHIFT; cy <= (rect->y + rect->height - 1) >> CHUNK_SHIFT; cy++)
+		{
+			for (int cx = rect->x >> CHUNK_SHIFT; cx <= (rect->x + rect->width - 1) >> CHUNK_SHIFT; cx++)
+			{
+				if (tilemap->slots[WindowSlot(cx, cy)] != ChunkKey(cx, cy) + 1)
+					continue;
+				const int chunkX = cx << CHUNK_SHIFT;
+				const int chunkY = cy << CHUNK_SHIFT;
+				const int fromX = (rect->x > chunkX ? rect->x : chunkX) - chunkX;
+				const int fromY = (rect->y > chunkY ? rect->y : chunkY) - chunkY;
+				const int toX = (rect->x + rect->width < chunkX + CHUNK_SIZE ? rect->x + rect->width : chunkX + CHUNK_SIZE) - chunkX;
+				const int toY = (rect->y + rect->height < chunkY + CHUNK_SIZE ? rect->y + rect->height : chunkY + CHUNK_SIZE) - chunkY;
+				UploadChunkRect(tilemap, cx, cy, fromX, fromY, toX, toY);
+				tilemap->rectUploads++;
+			}
+		}
+	}
+}
+
+bool InitTilemapRenderer(TilemapRenderer *tilemap, World *world, const TileArt *art)
+{
+	memset(tilemap, 0, sizeof(TilemapRenderer));
+	tilemap->world = world;
+	tilemap->art = art;
+	for (int type = 0; type < TILE_TYPE_COUNT; type++)
+		tilemap->tileCells[type] = GetTileLayer((TileId)type) == LAYER_STRUCTURE ? AtlasCell(art, art->tileRects[type]) : 0;
+	for (int mask = 0; mask < RAIL_MASK_COUNT; mask++)
+		tilemap->railCells[mask] = AtlasCell(art, art->railRects[mask]);
+
+	// Older GL versions fall back to the default shader, which cannot draw this
+	tilemap->shader = LoadShaderFromMemory(NULL, TilemapShaderCode);
+	if (tilemap->shader.id == rlGetShaderIdDefault())
+		return false;
+	tilemap->dataLoc = GetShaderLocation(tilemap->shader, "tileData");
+	tilemap->originLoc = GetShaderLocation(tilemap->shader, "origin");
+	tilemap->spanLoc = GetShaderLocation(tilemap->shader, "span");
+	tilemap->cellsLoc = GetShaderLocation(tilemap->shader, "cells");
+	tilemap->terrainLoc = GetShaderLocation(tilemap->shader, "terrainColors");
+	const float windowTiles = WINDOW_TILES;
+	SetShaderValue(tilemap->shader, GetShaderLocation(tilemap->shader, "windowTiles"), &windowTiles, SHADER_UNIFORM_FLOAT);
+
+	Vector4 terrainColors[TILE_TYPE_COUNT];
+	for (int type = 0; type < TILE_TYPE_COUNT; type++)
+		terrainColors[type] = ColorNormalize(art->terrainColors[type]);
+	SetShaderValueV(tilemap->shader, tilemap->terrainLoc, terrainColors, SHADER_UNIFORM_VEC4, TILE_TYPE_COUNT);
+	const Vector2 cells = {(float)(art->atlas.width / art->gridSize), (float)(art->atlas.height / art->gridSize)};
+	SetShaderValue(tilemap->shader, tilemap->cellsLoc, &cells, SHADER_UNIFORM_VEC2);
+
+	const Image blank = GenImageColor(WINDOW_TILES, WINDOW_TILES, BLANK);
+	tilemap->data = LoadTextureFromImage(blank);
+	UnloadImage(blank);
+	if (tilemap->data.id == 0)
+	{
+		UnloadShader(tilemap->shader);
+		return false;
+	}
+
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if (SubscribeDirtyRegions(&world->dirty[layer], UploadDirtyRects, tilemap))
+			continue;
+		for (int subscribed = 0; subscribed < layer; subscribed++)
+			UnsubscribeDirtyRegions(&world->dirty[subscribed], UploadDirtyRects, tilemap);
+		UnloadTexture(tilemap->data);
+		UnloadShader(tilemap->shader);
+		return false;
+	}
+	return true;
+}
+
+void UnloadTilemapRenderer(TilemapRenderer *tilemap)
+{
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		UnsubscribeDirtyRegions(&tilemap->world->dirty[layer], UploadDirtyRects, tilemap);
+	UnloadTexture(tilemap->data);
+	UnloadShader(tilemap->shader);
+}
+
+bool PrepareTilemap(TilemapRenderer *tilemap, int x, int y, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return true;
+	const int cx0 = x >> CHUNK_SHIFT;
+	const int cy0 = y >> CHUNK_SHIFT;
+	const int cx1 = (x + width - 1) >> CHUNK_SHIFT;
+	const int cy1 = (y + height - 1) >> CHUNK_SHIFT;
+	if (cx1 - cx0 >= TILEMAP_WINDOW_CHUNKS || cy1 - cy0 >= TILEMAP_WINDOW_CHUNKS)
+		return false;
+
+	for (int cy = cy0; cy <= cy1; cy++)
+	{
+		for (int cx = cx0; cx <= cx1; cx++)
+		{
+			uint64_t *slot = &tilemap->slots[WindowSlot(cx, cy)];
+			if (*slot == ChunkKey(cx, cy) + 1)
+				continue;
+			UploadChunkRect(tilemap, cx, cy, 0, 0, CHUNK_SIZE, CHUNK_SIZE);
+			*slot = ChunkKey(cx, cy) + 1;
+			tilemap->chunkUploads++;
+		}
+	}
+	return true;
+}
+
+void DrawTilemap(const TilemapRenderer *tilemap, int x, int y, int width, int height)
+{
+	const Texture2D atlas = tilemap->art->atlas;
+	const float gridSize = (float)tilemap->art->gridSize;
+	const Vector2 origin = {(float)(((x % WINDOW_TILES) + WINDOW_TILES) % WINDOW_TILES), (float)(((y % WINDOW_TILES) + WINDOW_TILES) % WINDOW_TILES)};
+	const Vector2 span = {(float)width, (float)height};
+
+	BeginShaderMode(tilemap->shader);
+	SetShaderValueTexture(tilemap->shader, tilemap->dataLoc, tilemap->data);
+	SetShaderValue(tilemap->shader, tilemap->originLoc, &origin, SHADER_UNIFORM_VEC2);
+	SetShaderValue(tilemap->shader, tilemap->spanLoc, &span, SHADER_UNIFORM_VEC2);
+	const Rectangle source = {0, 0, (float)atlas.width, (float)atlas.height};
+	const Rectangle dest = {x * gridSize, y * gridSize, width * gridSize, height * gridSize};
+	DrawTexturePro(atlas, source, dest, (Vector2){0, 0}, 0.f, WHITE);
+	EndShaderMode();
+}
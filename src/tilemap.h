@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "raylib.h"
+
+#include "chunk_textures.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Side of the data texture in chunks, enough for a 4K screen at zoom 0.125
+#define TILEMAP_WINDOW_CHUNKS 48
+
+// Set in the flags byte of tiles whose chunk is evicted and still loading
+#define TILEMAP_STAND_IN 1
+
+// Draws the visible map as one quad. The tiles around the camera live in a data texture
+// with one texel per tile: the terrain type, the atlas cell of the track and of the
+// structure (0 for none) and a flags byte. The texture wraps around, chunk (cx, cy)
+// sits at (cx, cy) modulo TILEMAP_WINDOW_CHUNKS, so panning only uploads the chunks that
+// come on screen, and edits upload just the dirty rectangles. A fragment shader looks up
+// the tile under every pixel and samples the atlas cells itself.
+typedef struct TilemapRenderer
+{
+	struct World *world;
+	const TileArt *art;
+	Shader shader;
+	int dataLoc;
+	int originLoc;
+	int spanLoc;
+	int cellsLoc;
+	int terrainLoc;
+	Texture2D data;
+	uint64_t slots[TILEMAP_WINDOW_CHUNKS * TILEMAP_WINDOW_CHUNKS]; // ChunkKey + 1 of what each slot holds, 0 for nothing
+	uint8_t tileCells[TILE_TYPE_COUNT]; // Atlas cell + 1 of each type, rails go by railCells
+	uint8_t railCells[RAIL_MASK_COUNT];
+	// Totals for the debug overlay
+	int chunkUploads;
+	int rectUploads;
+} TilemapRenderer;
+
+struct World;
+
+// Compiles the shader, creates the data texture and subscribes to the world's dirty
+// trackers. art has to outlive the renderer. Returns false when the shader does not build
+// on this GL version or no subscriber slot is left
+bool InitTilemapRenderer(TilemapRenderer *tilemap, struct World *world, const TileArt *art);
+void UnloadTilemapRenderer(TilemapRenderer *tilemap);
+
+// Uploads the chunks under the rectangle (in tiles) that are not in the data texture yet.
+// Returns false when the rectangle is wider or taller than the texture
+bool PrepareTilemap(TilemapRenderer *tilemap, int x, int y, int width, int height);
+// Inside BeginMode2D: draws the rectangle prepared this frame
+void DrawTilemap(const TilemapRenderer *tilemap, int x, int y, int width, int height);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+// Tile types
+//----------------------------------------------------------------------------------
+#define BLANK_SPACE 0
+#define RAIL 1
+#define BUILDING 2
+#define STATION 3
+#define WATER 4
+#define FOREST 5
+
+#define TILE_TYPE_COUNT 6
+//----------------------------------------------------------------------------------
+
+// Layers, drawn in this order. Every tile type but BLANK_SPACE lives on exactly one, so a
+// tile position can hold one tile per layer, track over terrain or a station on a rail
+//----------------------------------------------------------------------------------
+#define LAYER_TERRAIN 0
+#define LAYER_TRACK 1
+#define LAYER_STRUCTURE 2
+
+#define LAYER_COUNT 3
+//----------------------------------------------------------------------------------
+
+// Rail connection mask, one bit per neighbour a RAIL tile links up with
+//----------------------------------------------------------------------------------
+#define RAIL_NORTH 1
+#define RAIL_EAST 2
+#define RAIL_SOUTH 4
+#define RAIL_WEST 8
+
+#define RAIL_MASK_COUNT 16
+//----------------------------------------------------------------------------------
+
+// Only TILE_TYPE_COUNT values are ever stored, so a tile fits in a single byte
+typedef uint8_t TileId;
+
+// Layer a tile type is placed on, BLANK_SPACE reads as LAYER_TERRAIN
+static inline int GetTileLayer(TileId tile)
+{
+	static const uint8_t layers[TILE_TYPE_COUNT] = {LAYER_TERRAIN, LAYER_TRACK, LAYER_STRUCTURE, LAYER_STRUCTURE, LAYER_TERRAIN, LAYER_TERRAIN};
+	return tile < TILE_TYPE_COUNT ? layers[tile] : LAYER_TERRAIN;
+}
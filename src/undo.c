@@ -0,0 +1,227 @@
+#include "undo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "world.h"
+
+#define UNDO_HEADER_SIZE 8
+#define UNDO_TRAILER_SIZE 4
+// Longest varint of a 64 bit delta plus the two tiles
+#define UNDO_MAX_CHANGE_SIZE 12
+
+void InitUndoJournal(UndoJournal *journal, size_t budget)
+{
+	UnloadUndoJournal(journal);
+	journal->ring = (uint8_t *)malloc(budget);
+	journal->budget = journal->ring ? budget : 0;
+}
+
+void UnloadUndoJournal(UndoJournal *journal)
+{
+	free(journal->ring);
+	free(journal->scratch);
+	memset(journal, 0, sizeof(UndoJournal));
+}
+
+void ClearUndoJournal(UndoJournal *journal)
+{
+	journal->head = journal->tail = journal->redoEnd = 0;
+	journal->undoCount = journal->redoCount = 0;
+	journal->open = false;
+	journal->overflowed = false;
+}
+
+// Ring access by stream offset
+//----------------------------------------------------------------------------------
+static void WriteByte(UndoJournal *journal, uint64_t offset, uint8_t value)
+{
+	journal->ring[offset % journal->budget] = value;
+}
+
+static uint8_t ReadByte(const UndoJournal *journal, uint64_t offset)
+{
+	return journal->ring[offset % journal->budget];
+}
+
+static void WriteU32(UndoJournal *journal, uint64_t offset, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		WriteByte(journal, offset + i, (uint8_t)(value >> (8 * i)));
+}
+
+static uint32_t ReadU32(const UndoJournal *journal, uint64_t offset)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++)
+		value |= (uint32_t)ReadByte(journal, offset + i) << (8 * i);
+	return value;
+}
+//----------------------------------------------------------------------------------
+
+// Drops the oldest transactions until the open one can grow by size bytes
+static bool ReserveUndoSpace(UndoJournal *journal, uint64_t size)
+{
+	while (journal->write + size - journal->head > journal->budget)
+	{
+		if (journal->head == journal->openStart)
+			return false;
+		journal->head += ReadU32(journal, journal->head);
+		journal->undoCount--;
+	}
+	return true;
+}
+
+void BeginUndoTransaction(UndoJournal *journal)
+{
+	if (journal->open || journal->budget == 0)
+		return;
+
+	journal->open = true;
+	journal->overflowed = false;
+	journal->openCount = 0;
+}
+
+void RecordUndoChange(UndoJournal *journal, uint64_t index, TileId prev, TileId next)
+{
+	if (!journal->open || journal->overflowed)
+		return;
+
+	if (journal->openCount == 0)
+	{
+		// The first real change discards anything that could be redone, an empty
+		// transaction (a click on the gui) leaves the history alone
+		journal->redoEnd = journal->tail;
+		journal->redoCount = 0;
+		journal->openStart = journal->tail;
+		journal->write = journal->tail + UNDO_HEADER_SIZE;
+		journal->lastIndex = 0;
+	}
+
+	if (!ReserveUndoSpace(journal, UNDO_MAX_CHANGE_SIZE + UNDO_TRAILER_SIZE))
+	{
+		// Even an empty history cannot hold this stroke, forget about it entirely
+		journal->overflowed = true;
+		journal->head = journal->tail = journal->redoEnd = journal->openStart;
+		journal->undoCount = 0;
+		return;
+	}
+
+	const int64_t delta = (int64_t)(index - journal->lastIndex);
+	uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+	while (zigzag >= 0x80)
+	{
+		WriteByte(journal, journal->write++, (uint8_t)(zigzag | 0x80));
+		zigzag >>= 7;
+	}
+	WriteByte(journal, journal->write++, (uint8_t)zigzag);
+	WriteByte(journal, journal->write++, prev);
+	WriteByte(journal, journal->write++, next);
+
+	journal->lastIndex = index;
+	journal->openCount++;
+}
+
+bool EndUndoTransaction(UndoJournal *journal)
+{
+	if (!journal->open)
+		return true;
+	journal->open = false;
+
+	if (journal->overflowed)
+		return false;
+	if (journal->openCount == 0)
+		return true;
+
+	const uint32_t length = (uint32_t)(journal->write + UNDO_TRAILER_SIZE - journal->openStart);
+	WriteU32(journal, journal->openStart, length);
+	WriteU32(journal, journal->openStart + 4, journal->openCount);
+	WriteU32(journal, journal->write, length);
+
+	journal->tail = journal->redoEnd = journal->openStart + length;
+	journal->undoCount++;
+	return true;
+}
+
+static uint32_t DecodeTransaction(UndoJournal *journal, uint64_t start)
+{
+	const uint32_t count = ReadU32(journal, start + 4);
+	if (count > journal->scratchCapacity)
+	{
+		free(journal->scratch);
+		journal->scratch = (UndoChange *)malloc(count * sizeof(UndoChange));
+		journal->scratchCapacity = journal->scratch ? count : 0;
+		if (journal->scratch == NULL)
+			return 0;
+	}
+
+	uint64_t read = start + UNDO_HEADER_SIZE;
+	uint64_t index = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint64_t zigzag = 0;
+		int shift = 0;
+		uint8_t byte;
+		do
+		{
+			byte = ReadByte(journal, read++);
+			zigzag |= (uint64_t)(byte & 0x7F) << shift;
+			shift += 7;
+		} while (byte & 0x80);
+
+		index += (uint64_t)((int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1));
+		journal->scratch[i].index = index;
+		journal->scratch[i].prev = ReadByte(journal, read++);
+		journal->scratch[i].next = ReadByte(journal, read++);
+	}
+	return count;
+}
+
+// Changes are only recorded when the tile changes, so one side is never blank and gives the layer
+static int GetUndoChangeLayer(const UndoChange *change)
+{
+	return GetTileLayer(change->prev != BLANK_SPACE ? change->prev : change->next);
+}
+
+bool UndoWorld(World *world)
+{
+	UndoJournal *journal = &world->undo;
+	if (journal->open || journal->tail == journal->head)
+		return false;
+
+	const uint64_t start = journal->tail - ReadU32(journal, journal->tail - UNDO_TRAILER_SIZE);
+	const uint32_t count = DecodeTransaction(journal, start);
+
+	// Backwards, so a tile written twice in one stroke ends up with its first old value
+	for (uint32_t i = count; i-- > 0;)
+	{
+		const UndoChange *change = &journal->scratch[i];
+		SetLayerTile(world, GetUndoChangeLayer(change), (int)(change->index % (uint64_t)world->width), (int)(change->index / (uint64_t)world->width), change->prev);
+	}
+
+	journal->tail = start;
+	journal->undoCount--;
+	journal->redoCount++;
+	return true;
+}
+
+bool RedoWorld(World *world)
+{
+	UndoJournal *journal = &world->undo;
+	if (journal->open || journal->tail == journal->redoEnd)
+		return false;
+
+	const uint32_t length = ReadU32(journal, journal->tail);
+	const uint32_t count = DecodeTransaction(journal, journal->tail);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const UndoChange *change = &journal->scratch[i];
+		SetLayerTile(world, GetUndoChangeLayer(change), (int)(change->index % (uint64_t)world->width), (int)(change->index / (uint64_t)world->width), change->next);
+	}
+
+	journal->tail += length;
+	journal->undoCount++;
+	journal->redoCount--;
+	return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tiles.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Used when the world is created, can be changed with InitUndoJournal
+#define DEFAULT_UNDO_BUDGET (4 * 1024 * 1024)
+
+// prev and next are on the same layer, as in TileChange
+typedef struct UndoChange
+{
+	uint64_t index; // y * width + x
+	TileId prev;
+	TileId next;
+} UndoChange;
+
+// History of tile writes grouped into transactions (one paint stroke each), kept in a
+// ring buffer of at most budget bytes. The oldest transactions are dropped to make room.
+//
+// A transaction is laid out as
+//   [u32 length][u32 change count][changes...][u32 length]
+// and every change as a varint of the zigzagged index delta from the previous change,
+// then the old and the new tile. Strokes touch neighbouring tiles, so most changes take
+// three or four bytes. The trailing length lets undo step backwards from the newest one.
+typedef struct UndoJournal
+{
+	uint8_t *ring;
+	size_t budget;    // Size of ring in bytes
+	uint64_t head;    // Stream offset of the oldest transaction still kept
+	uint64_t tail;    // End of the newest transaction that can be undone
+	uint64_t redoEnd; // End of the newest transaction that can be redone
+	int undoCount;
+	int redoCount;
+
+	// Transaction being recorded
+	bool open;
+	bool overflowed; // The open transaction outgrew the whole budget and is being dropped
+	uint64_t openStart;
+	uint64_t write;
+	uint32_t openCount;
+	uint64_t lastIndex;
+
+	// Changes of the transaction being undone or redone, decoded so undo can run backwards
+	UndoChange *scratch;
+	size_t scratchCapacity;
+} UndoJournal;
+
+struct World;
+
+void InitUndoJournal(UndoJournal *journal, size_t budget);
+void UnloadUndoJournal(UndoJournal *journal);
+// Forgets all history but keeps the budget, for when the world is replaced wholesale
+void ClearUndoJournal(UndoJournal *journal);
+
+// Tile writes between Begin and End become one undo step, writes outside are not recorded.
+// A transaction without any change leaves the redo history alone
+void BeginUndoTransaction(UndoJournal *journal);
+// Returns false if the transaction was larger than the whole budget and had to be dropped
+bool EndUndoTransaction(UndoJournal *journal);
+// Called by SetTile for every write that changes a tile
+void RecordUndoChange(UndoJournal *journal, uint64_t index, TileId prev, TileId next);
+
+// Both return false when there is nothing to undo or redo, or a transaction is open
+bool UndoWorld(struct World *world);
+bool RedoWorld(struct World *world);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,438 @@
+// posix_memalign is hidden by strict C99 unless POSIX is requested
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "world.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// A chunk row has to fit the occupancy word exactly
+typedef char ChunkRowMatchesOccupancyWord[(CHUNK_SIZE == 32) ? 1 : -1];
+
+static void *AllocAligned(size_t size)
+{
+	void *memory = NULL;
+#if defined(_WIN32)
+	memory = _aligned_malloc(size, CHUNK_ALIGNMENT);
+#else
+	if (posix_memalign(&memory, CHUNK_ALIGNMENT, size) != 0)
+		memory = NULL;
+#endif
+	return memory;
+}
+
+static void FreeAligned(void *memory)
+{
+#if defined(_WIN32)
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+static Chunk *AllocChunk(void)
+{
+	Chunk *chunk = (Chunk *)AllocAligned(sizeof(Chunk));
+	if (chunk == NULL)
+		return NULL;
+	memset(chunk, 0, sizeof(Chunk));
+	chunk->refCount = 1;
+	return chunk;
+}
+
+static void FreeChunk(Chunk *chunk)
+{
+	if (chunk->source != NULL)
+		ReleaseStreamedChunk(chunk->source);
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		FreeTileLayer(chunk->layers[layer]);
+	free(chunk->railMasks);
+	for (int i = 0; i < MAX_TILE_ATTRIBUTES; i++)
+		free(chunk->attributes[i]);
+	FreeAreaTable(chunk);
+	FreeAligned(chunk);
+}
+
+static TileLayer *EnsureChunkLayer(Chunk *chunk, int layer)
+{
+	if (chunk->layers[layer] == NULL)
+		chunk->layers[layer] = CreateTileLayer(BLANK_SPACE);
+	return chunk->layers[layer];
+}
+
+void FreeChunkLayer(Chunk *chunk, int layer)
+{
+	FreeTileLayer(chunk->layers[layer]);
+	chunk->layers[layer] = NULL;
+}
+
+Chunk *CreateChunk(void)
+{
+	Chunk *chunk = AllocChunk();
+	if (chunk != NULL)
+		chunk->typeCounts[BLANK_SPACE] = CHUNK_AREA;
+	return chunk;
+}
+
+void RetainChunk(const Chunk *chunk)
+{
+	((Chunk *)chunk)->refCount++;
+}
+
+void ReleaseChunk(const Chunk *chunk)
+{
+	if (--((Chunk *)chunk)->refCount == 0)
+		FreeChunk((Chunk *)chunk);
+}
+
+// Reference counting for the chunk directory
+static void RetainChunkEntry(const void *chunk)
+{
+	RetainChunk((const Chunk *)chunk);
+}
+
+static void ReleaseChunkEntry(const void *chunk)
+{
+	ReleaseChunk((const Chunk *)chunk);
+}
+
+static void *CopyBuffer(const void *source, size_t size)
+{
+	if (source == NULL)
+		return NULL;
+	void *copy = malloc(size);
+	if (copy != NULL)
+		memcpy(copy, source, size);
+	return copy;
+}
+
+static Chunk *CloneChunk(const World *world, const Chunk *source)
+{
+	Chunk *chunk = AllocChunk();
+	if (chunk == NULL)
+		return NULL;
+
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		if (source->layers[layer] == NULL)
+			continue;
+		chunk->layers[layer] = CopyTileLayer(source->layers[layer]);
+		if (chunk->layers[layer] == NULL)
+		{
+			FreeChunk(chunk);
+			return NULL;
+		}
+	}
+	memcpy(chunk->occupancy, source->occupancy, sizeof(chunk->occupancy));
+	memcpy(chunk->planes, source->planes, sizeof(chunk->planes));
+	memcpy(chunk->typeCounts, source->typeCounts, sizeof(chunk->typeCounts));
+	chunk->nonEmpty = source->nonEmpty;
+	chunk->railMasks = (uint8_t *)CopyBuffer(source->railMasks, CHUNK_AREA);
+	for (int i = 0; i < MAX_TILE_ATTRIBUTES; i++)
+		chunk->attributes[i] = CopyBuffer(source->attributes[i], (size_t)CHUNK_AREA * world->attributes[i].size);
+	return chunk;
+}
+
+Chunk *GetMutableChunk(World *world, int cx, int cy)
+{
+	const uint64_t key = ChunkKey(cx, cy);
+	// A page shared with a snapshot is copied first, which leaves its chunks shared
+	if (!UnshareDirectoryPage(&world->chunks, key))
+		return NULL;
+	Chunk *chunk = (Chunk *)GetDirectoryEntry(&world->chunks, key);
+	if (chunk == NULL)
+		return NULL;
+	if (chunk->refCount == 1)
+	{
+		// About to change, the copy in the backing file goes stale
+		if (chunk->source != NULL)
+		{
+			ReleaseStreamedChunk(chunk->source);
+			chunk->source = NULL;
+		}
+		return chunk;
+	}
+
+	// Shared with a snapshot, which has to keep seeing the old contents, or interned and
+	// possibly standing in for other positions too
+	Chunk *copy = CloneChunk(world, chunk);
+	if (copy == NULL)
+		return NULL;
+	// The page is private now, so replacing the entry cannot fail
+	PutDirectoryEntry(&world->chunks, key, copy);
+	ReleaseChunk(chunk);
+	return copy;
+}
+
+// Stations sit on the line, so rails link up with them as well as with other rails
+static bool ConnectsToRail(TileId tile)
+{
+	return tile == RAIL || tile == STATION;
+}
+
+// Same as GetChunk, but an evicted chunk is loaded back first. Rail links across a chunk
+// border have to see the real tiles on the other side, and the neighbour's own mask has to
+// be written, not left for a stand in to lose
+static const Chunk *GetLoadedChunk(World *world, int cx, int cy)
+{
+	const Chunk *chunk = GetChunk(world, cx, cy);
+	if (chunk == NULL && world->stream != NULL)
+		chunk = LoadStreamedChunk(world, cx, cy);
+	return chunk;
+}
+
+// A rail on the track layer or a station above it. Skips the chunk directory while (x, y)
+// stays inside chunk, only crossing into a neighbour looks it up
+static bool ConnectsToRailNear(World *world, const Chunk *chunk, int cx, int cy, int x, int y)
+{
+	if (x < 0 || y < 0 || x >= world->width || y >= world->height)
+		return false;
+	if ((x >> CHUNK_SHIFT) != cx || (y >> CHUNK_SHIFT) != cy)
+		chunk = GetLoadedChunk(world, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+	if (chunk == NULL)
+		return false;
+	const int index = ChunkTileIndex(x, y);
+	return GetChunkTile(chunk, LAYER_TRACK, index) == RAIL || GetChunkTile(chunk, LAYER_STRUCTURE, index) == STATION;
+}
+
+static void RefreshRailMask(World *world, const Chunk *chunk, int x, int y)
+{
+	const int cx = x >> CHUNK_SHIFT;
+	const int cy = y >> CHUNK_SHIFT;
+	const int index = ChunkTileIndex(x, y);
+	uint8_t mask = 0;
+	if (GetChunkTile(chunk, LAYER_TRACK, index) == RAIL)
+	{
+		if (ConnectsToRailNear(world, chunk, cx, cy, x, y - 1))
+			mask |= RAIL_NORTH;
+		if (ConnectsToRailNear(world, chunk, cx, cy, x + 1, y))
+			mask |= RAIL_EAST;
+		if (ConnectsToRailNear(world, chunk, cx, cy, x, y + 1))
+			mask |= RAIL_SOUTH;
+		if (ConnectsToRailNear(world, chunk, cx, cy, x - 1, y))
+			mask |= RAIL_WEST;
+	}
+
+	// Neighbours are often unchanged, leave them alone so shared chunks are not copied for nothing
+	if (GetChunkRailMask(chunk, index) == mask)
+		return;
+
+	Chunk *writable = GetMutableChunk(world, cx, cy);
+	if (writable == NULL)
+		return;
+	if (writable->railMasks == NULL)
+	{
+		writable->railMasks = (uint8_t *)calloc(CHUNK_AREA, sizeof(uint8_t));
+		if (writable->railMasks == NULL)
+			return;
+	}
+	writable->railMasks[index] = mask;
+	MarkTileDirty(&world->dirty[LAYER_TRACK], x, y);
+}
+
+// Only the edited tile and its neighbours can change how rails link up
+static void RefreshRailMasksAround(World *world, int x, int y)
+{
+	static const int offsets[5][2] = {{0, 0}, {0, -1}, {1, 0}, {0, 1}, {-1, 0}};
+
+	const int cx = x >> CHUNK_SHIFT;
+	const int cy = y >> CHUNK_SHIFT;
+	const Chunk *home = GetChunk(world, cx, cy);
+	for (int i = 0; i < 5; i++)
+	{
+		const int nx = x + offsets[i][0];
+		const int ny = y + offsets[i][1];
+		const Chunk *chunk = home;
+		if (nx < 0 || ny < 0 || nx >= world->width || ny >= world->height)
+			continue;
+		if ((nx >> CHUNK_SHIFT) != cx || (ny >> CHUNK_SHIFT) != cy)
+			chunk = GetLoadedChunk(world, nx >> CHUNK_SHIFT, ny >> CHUNK_SHIFT);
+		if (chunk != NULL)
+			RefreshRailMask(world, chunk, nx, ny);
+	}
+}
+
+static bool HasAttributePlanes(const Chunk *chunk)
+{
+	for (int i = 0; i < MAX_TILE_ATTRIBUTES; i++)
+	{
+		if (chunk->attributes[i] != NULL)
+			return true;
+	}
+	return false;
+}
+
+Chunk *EnsureChunk(World *world, int cx, int cy)
+{
+	Chunk *chunk = GetMutableChunk(world, cx, cy);
+	if (chunk != NULL)
+		return chunk;
+	// A blank stand in for an evicted chunk would lose it on the next eviction
+	if (GetStreamedChunk(world, cx, cy) != NULL)
+		return LoadStreamedChunk(world, cx, cy);
+
+	chunk = CreateChunk();
+	if (chunk == NULL)
+		return NULL;
+	if (!PutDirectoryEntry(&world->chunks, ChunkKey(cx, cy), chunk))
+	{
+		ReleaseChunk(chunk);
+		return NULL;
+	}
+	return chunk;
+}
+
+static int CountLayerTiles(const Chunk *chunk, int layer)
+{
+	int count = 0;
+	for (int type = BLANK_SPACE + 1; type < TILE_TYPE_COUNT; type++)
+	{
+		if (GetTileLayer((TileId)type) == layer)
+			count += chunk->typeCounts[type];
+	}
+	return count;
+}
+
+// Frees the layer plane once nothing is on it and the chunk once nothing is left in it
+static void DropUnusedChunkParts(World *world, Chunk *chunk, int layer, int cx, int cy)
+{
+	if (CountLayerTiles(chunk, layer) == 0)
+		FreeChunkLayer(chunk, layer);
+	if (chunk->nonEmpty == 0 && !HasAttributePlanes(chunk))
+	{
+		RemoveDirectoryEntry(&world->chunks, ChunkKey(cx, cy));
+		ReleaseChunk(chunk);
+	}
+}
+
+void SetLayerTile(World *world, int layer, int x, int y, TileId tile)
+{
+	if (x < 0 || y < 0 || x >= world->width || y >= world->height)
+		return;
+	if (layer < 0 || layer >= LAYER_COUNT || tile >= TILE_TYPE_COUNT || (tile != BLANK_SPACE && GetTileLayer(tile) != layer))
+		return;
+
+	const int cx = x >> CHUNK_SHIFT;
+	const int cy = y >> CHUNK_SHIFT;
+	const int index = ChunkTileIndex(x, y);
+	const Chunk *current = GetLoadedChunk(world, cx, cy);
+	// Blank tiles in a missing chunk are already blank, and unchanged tiles must not copy shared chunks
+	if ((current ? GetChunkTile(current, layer, index) : BLANK_SPACE) == tile)
+		return;
+
+	Chunk *chunk = EnsureChunk(world, cx, cy);
+	if (chunk == NULL)
+		return;
+	const TileId prev = GetChunkTile(chunk, layer, index);
+	if (EnsureChunkLayer(chunk, layer) == NULL || !WriteTileLayer(&chunk->layers[layer], index, tile))
+	{
+		DropUnusedChunkParts(world, chunk, layer, cx, cy);
+		return;
+	}
+
+	// The position stays occupied while any layer has something on it. Types belong to one
+	// layer, so prev's plane only holds this layer's tile
+	const int row = y & CHUNK_MASK;
+	const uint32_t bit = 1u << (x & CHUNK_MASK);
+	uint32_t stacked = tile != BLANK_SPACE ? bit : 0;
+	for (int plane = 0; plane < TILE_PLANE_COUNT; plane++)
+	{
+		if (plane != prev - 1)
+			stacked |= chunk->planes[plane][row];
+	}
+	const int occupiedChange = (stacked & bit) == (chunk->occupancy[row] & bit) ? 0 : (stacked & bit) ? 1 : -1;
+	if (!UpdateWorldSummary(&world->summary, cx, cy, prev, tile, occupiedChange))
+	{
+		// Only the first tile painted in a block needs new nodes, the layer was all blank
+		// before it, so putting the blank back reuses its palette entry and cannot fail
+		WriteTileLayer(&chunk->layers[layer], index, prev);
+		DropUnusedChunkParts(world, chunk, layer, cx, cy);
+		return;
+	}
+
+	RecordUndoChange(&world->undo, (uint64_t)y * (uint64_t)world->width + (uint64_t)x, prev, tile);
+	MarkTileDirty(&world->dirty[layer], x, y);
+	PublishTileChange(&world->events, x, y, prev, tile);
+	chunk->areaTableStale = true;
+
+	if (prev != BLANK_SPACE)
+	{
+		chunk->planes[prev - 1][row] &= ~bit;
+		chunk->typeCounts[prev]--;
+	}
+	if (tile != BLANK_SPACE)
+	{
+		chunk->planes[tile - 1][row] |= bit;
+		chunk->typeCounts[tile]++;
+	}
+	if (occupiedChange != 0)
+	{
+		chunk->occupancy[row] ^= bit;
+		chunk->nonEmpty += occupiedChange;
+		chunk->typeCounts[BLANK_SPACE] -= occupiedChange;
+	}
+	DropUnusedChunkParts(world, chunk, layer, cx, cy);
+
+	if (ConnectsToRail(prev) || ConnectsToRail(tile))
+		RefreshRailMasksAround(world, x, y);
+}
+
+void SetTile(World *world, int x, int y, TileId tile)
+{
+	if (tile != BLANK_SPACE)
+	{
+		SetLayerTile(world, GetTileLayer(tile), x, y, tile);
+		return;
+	}
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		SetLayerTile(world, layer, x, y, BLANK_SPACE);
+}
+
+World *CreateWorld(int width, int height)
+{
+	if (width < 1 || height < 1 || width > MAX_WORLD_SIZE || height > MAX_WORLD_SIZE)
+		return NULL;
+
+	World *world = (World *)calloc(1, sizeof(World));
+	if (world == NULL)
+		return NULL;
+	world->width = width;
+	world->height = height;
+	InitChunkDirectory(&world->chunks, RetainChunkEntry, ReleaseChunkEntry);
+	InitWorldSummary(&world->summary, (width + CHUNK_MASK) >> CHUNK_SHIFT, (height + CHUNK_MASK) >> CHUNK_SHIFT);
+	InitUndoJournal(&world->undo, DEFAULT_UNDO_BUDGET);
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		InitDirtyTracker(&world->dirty[layer], width, height);
+	InitTileEventBus(&world->events);
+	return world;
+}
+
+void UnloadWorld(World *world)
+{
+	if (world == NULL)
+		return;
+
+	UnloadChunkStream(world->stream);
+	FreeChunkDirectory(&world->chunks);
+	UnloadChunkInterner(&world->interner);
+	UnloadAreaTablePool(&world->areaTables);
+	UnloadWorldSummary(&world->summary);
+	UnloadUndoJournal(&world->undo);
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+		UnloadDirtyTracker(&world->dirty[layer]);
+	UnloadTileEventBus(&world->events);
+	free(world);
+}
+
+void ToggleLocation(World *world, int x, int y)
+{
+	TileId curr = GetTile(world, x, y);
+	SetTile(world, x, y, (TileId)((curr + 1) % TILE_TYPE_COUNT));
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "area_table.h"
+#include "attributes.h"
+#include "bits.h"
+#include "chunk_directory.h"
+#include "chunk_map.h"
+#include "dirty.h"
+#include "events.h"
+#include "intern.h"
+#include "palette.h"
+#include "stream.h"
+#include "summary.h"
+#include "tiles.h"
+#include "undo.h"
+
+#if defined(__cplusplus)
+extern "C"
+{ // Prevents name mangling of functions
+#endif
+
+// Used when no size is given on the command line
+#define DEFAULT_WORLD_SIZE 1000
+// Keeps pixel coordinates (tiles * GRID_SIZE) well inside float precision
+#define MAX_WORLD_SIZE (1 << 20)
+
+// The world is split into square chunks that are only allocated once painted.
+// CHUNK_SIZE has to stay 32 so that one row of the occupancy bitmap is one word
+#define CHUNK_SHIFT 5
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+#define CHUNK_AREA (CHUNK_SIZE * CHUNK_SIZE)
+// One bit plane per tile type but BLANK_SPACE, which is wherever occupancy is clear
+#define TILE_PLANE_COUNT (TILE_TYPE_COUNT - 1)
+// Chunks start on a cache line so a chunk row never straddles two lines
+#define CHUNK_ALIGNMENT 64
+
+typedef struct Chunk
+{
+	// Above 1 while a snapshot shares the chunk or it is interned, writers copy it first. A
+	// snapshot shares whole directory pages, the writer's own copy of the page references
+	// each chunk in it again
+	int refCount;
+	// Palette packed tiles of each layer, row major. NULL while nothing is on the layer, so a
+	// chunk that only has buildings costs one small plane and drawing skips the other layers
+	// with a single test
+	TileLayer *layers[LAYER_COUNT];
+	// Bit x of occupancy[y] is set when tile (x, y) of the chunk has anything on any layer
+	uint32_t occupancy[CHUNK_SIZE];
+	int nonEmpty; // Number of set bits in occupancy
+	// Bit x of planes[type - 1][y] is set when tile (x, y) is of that type, the planes OR'd
+	// together give occupancy. Lets region statistics work on whole rows at once
+	uint32_t planes[TILE_PLANE_COUNT][CHUNK_SIZE];
+	// Level 0 of the summary pyramid, typeCounts[BLANK_SPACE] counts the tiles with nothing
+	// on any layer, CHUNK_AREA - nonEmpty
+	int typeCounts[TILE_TYPE_COUNT];
+	// RAIL_* mask per tile, kept up to date by SetTile so drawing never looks at neighbours.
+	// Only allocated once a rail in the chunk has something to connect to
+	uint8_t *railMasks;
+	// One plane per registered attribute, NULL until a tile in the chunk leaves the default
+	void *attributes[MAX_TILE_ATTRIBUTES];
+	// Copy in the stream's backing file this chunk was loaded from, dropped on the first
+	// change. Lets an unmodified chunk be evicted again without writing it
+	StreamedChunk *source;
+	// Taken from the world's pool once count queries keep covering only part of the chunk,
+	// flagged stale by every change after that and rebuilt by the next such query
+	AreaTable *areaTable;
+	bool areaTableStale;
+	uint32_t areaTableCut; // Pool clock of the last cut scanned without a table, 0 for none
+	bool interned;       // Held by the ChunkInterner table as the copy of its contents
+	uint32_t internPass; // Last InternWorldChunks pass that counted the chunk
+} Chunk;
+
+typedef struct World
+{
+	int width;       // In tiles
+	int height;      // In tiles
+	ChunkDirectory chunks; // Keyed by ChunkKey(cx, cy), missing chunks are all BLANK_SPACE
+	WorldSummary summary;
+	TileAttributeInfo attributes[MAX_TILE_ATTRIBUTES];
+	int attributeCount;
+	UndoJournal undo; // Records SetTile changes while a transaction is open
+	DirtyTracker dirty[LAYER_COUNT]; // Tiles whose type or rail links changed on each layer since the last flush
+	TileEventBus events; // Every SetTile change since the last flush, for subscribers that follow tiles one by one
+	ChunkStream *stream; // NULL unless EnableWorldStreaming was called
+	ChunkInterner interner; // Shared copies of repeated chunks, filled by InternWorldChunks
+	AreaTablePool areaTables; // Summed area tables of the chunks count queries keep cutting
+} World;
+
+static inline int ChunkTileIndex(int x, int y)
+{
+	return ((y & CHUNK_MASK) << CHUNK_SHIFT) | (x & CHUNK_MASK);
+}
+
+// Returns NULL when nothing is stored in the chunk. A chunk that gets erased back to blank
+// is freed unless it still holds attribute planes. Also NULL while a streaming world has
+// the chunk evicted or compacted, see GetStreamedChunk
+static inline const Chunk *GetChunk(const World *world, int cx, int cy)
+{
+	return (const Chunk *)GetDirectoryEntry(&world->chunks, ChunkKey(cx, cy));
+}
+
+static inline uint8_t GetChunkRailMask(const Chunk *chunk, int index)
+{
+	return chunk->railMasks ? chunk->railMasks[index] : 0;
+}
+
+static inline TileId GetChunkTile(const Chunk *chunk, int layer, int index)
+{
+	return chunk->layers[layer] ? ReadTileLayer(chunk->layers[layer], index) : BLANK_SPACE;
+}
+
+// Topmost tile of the position, BLANK_SPACE when every layer is empty
+static inline TileId GetChunkTopTile(const Chunk *chunk, int index)
+{
+	for (int layer = LAYER_COUNT - 1; layer >= 0; layer--)
+	{
+		const TileId tile = GetChunkTile(chunk, layer, index);
+		if (tile != BLANK_SPACE)
+			return tile;
+	}
+	return BLANK_SPACE;
+}
+
+static inline TileId GetLayerTile(const World *world, int layer, int x, int y)
+{
+	const Chunk *chunk = GetChunk(world, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+	return chunk ? GetChunkTile(chunk, layer, ChunkTileIndex(x, y)) : BLANK_SPACE;
+}
+
+// Topmost tile, what the position looks like from above
+static inline TileId GetTile(const World *world, int x, int y)
+{
+	const Chunk *chunk = GetChunk(world, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+	return chunk ? GetChunkTopTile(chunk, ChunkTileIndex(x, y)) : BLANK_SPACE;
+}
+
+// Puts tile on its layer (GetTileLayer), leaving the other layers alone. BLANK_SPACE
+// clears every layer. Writes outside the world are ignored
+void SetTile(World *world, int x, int y, TileId tile);
+// Writes one layer, tile has to be BLANK_SPACE or belong to the layer. Allocates the chunk
+// and the layer plane on the first non blank write and frees them once unused again
+void SetLayerTile(World *world, int layer, int x, int y, TileId tile);
+// Returns a chunk only this world references, copying it first if a snapshot shares it.
+// NULL when the chunk is missing or out of memory
+Chunk *GetMutableChunk(World *world, int cx, int cy);
+// Same as GetMutableChunk, but loads the chunk back if it is evicted and allocates an all
+// blank chunk if it is missing
+Chunk *EnsureChunk(World *world, int cx, int cy);
+// All blank chunk that is not in any world yet, for filling chunks in bulk before they are
+// put into the chunk directory. Safe to call from worker threads
+Chunk *CreateChunk(void);
+void RetainChunk(const Chunk *chunk);
+// Frees the chunk once nothing references it any more
+void ReleaseChunk(const Chunk *chunk);
+void FreeChunkLayer(Chunk *chunk, int layer);
+
+// Returns NULL if the dimensions are not within 1..MAX_WORLD_SIZE
+World *CreateWorld(int width, int height);
+void UnloadWorld(World *world);
+void ToggleLocation(World *world, int x, int y);
+
+#if defined(__cplusplus)
+}
+#endif